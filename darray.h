@@ -24,24 +24,416 @@
 #define _DARRAY_H_
 
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef __cplusplus
+#   include <type_traits>
+#endif
+#ifdef DA_ENABLE_STATS
+#   include <time.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#   include <errno.h>
+#   include <fcntl.h>
+#   include <pthread.h>
+#   include <sched.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <sys/uio.h>
+#   include <unistd.h>
+#   define DA_HAVE_FD_IO
+#   if defined(MAP_ANONYMOUS) || defined(MAP_ANON)
+#       define DA_HAVE_MMAP
+#   endif
+#endif
 
 /* DARRAY MEMORY LAYOUT
  * ====================
- * +--------+---------+---------+-----+------------------+
- * | header | elem[0] | elem[1] | ... | elem[capacity-1] |
- * +--------+---------+---------+-----+------------------+
- *          ^
- *          Handle to the darray points to the first
- *          element of the array.
+ * +---------+--------+---------+---------+-----+------------------+
+ * | padding | header | elem[0] | elem[1] | ... | elem[capacity-1] |
+ * +---------+--------+---------+---------+-----+------------------+
+ *                    ^
+ *                    Handle to the darray points to the first
+ *                    element of the array.
+ *
+ * The padding section is sized so that the handle lands on the alignment
+ * boundary requested when the darray was allocated. It is empty for most
+ * darrays.
+ *
+ * Elements pushed with `da_push_front` go in free slots in front of elem[0],
+ * taken out of the padding section, and the header moves down with the handle.
+ * The header always starts at the last size_t boundary before the handle, less
+ * the size of the header.
  *
  * HEADER DATA
  * ===========
  *  size_t : sizeof contained element
  *  size_t : length of the darray
  *  size_t : capacity of the darray
+ *  size_t : alignment of the handle
+ *  size_t : number of padding bytes before the header
+ *  ptr    : growth policy of the darray (NULL for the default policy)
+ *  ptr    : allocator of the darray (NULL for malloc/realloc/free)
+ *  size_t : DA_FLAG_* bit flags
+ *  size_t : start of the gap of a gap buffer (see DA_FLAG_GAP)
+ *  size_t : number of free element slots in front of elem[0]
+ *  size_t : number of references to the block (see `da_share`)
+ *  ptr    : `struct da_stats` of the darray (unused without DA_ENABLE_STATS)
+ *
+ * The header is DA_HANDLE_OFFSET bytes, twelve size_t slots, in every build.
+ */
+
+// Give memory back automatically when the length of the darray drops below a
+// quarter of its capacity. See `struct da_attr`.
+#define DA_FLAG_AUTO_SHRINK ((size_t)1 << 0)
+// Set by the library while the darray is a gap buffer whose gap is not at the
+// end, in which case its elements are not contiguous. See `da_gap_insert`.
+// Must not be passed in `struct da_attr`.
+#define DA_FLAG_GAP ((size_t)1 << 1)
+// Set by the library once the darray has been passed to `da_share`, and cleared
+// once it turns out to hold the only reference to its block again. Must not be
+// passed in `struct da_attr`.
+#define DA_FLAG_SHARED ((size_t)1 << 2)
+
+/**@enum
+ * @brief Strategies used to compute a new capacity when a darray grows.
+ */
+enum da_growth_kind
+{
+    // Multiply the required capacity by `factor`.
+    DA_GROWTH_GEOMETRIC,
+    // Round the required capacity up to a multiple of `increment`.
+    DA_GROWTH_INCREMENT,
+    // Round the required capacity up to the next power of two.
+    DA_GROWTH_POW2,
+    // Ask `callback` for the new capacity.
+    DA_GROWTH_CALLBACK
+};
+
+/**@struct
+ * @brief Growth policy of a darray. A darray only holds a pointer to its
+ *  policy, so the policy must outlive every darray that uses it.
+ *
+ * @note `min` is the smallest capacity the policy will ever return. The
+ *  value returned by `callback` must be at least its `nelem` parameter.
+ */
+struct da_growth
+{
+    enum da_growth_kind kind;
+    double factor;
+    size_t increment;
+    size_t min;
+    size_t (*callback)(size_t nelem, void* ctx);
+    void* ctx;
+};
+
+#define DA_GROWTH_GEOMETRIC_INIT(/* double */factor, /* size_t */min)         \
+    {DA_GROWTH_GEOMETRIC, (factor), 0, (min), NULL, NULL}
+#define DA_GROWTH_INCREMENT_INIT(/* size_t */increment, /* size_t */min)      \
+    {DA_GROWTH_INCREMENT, 0.0, (increment), (min), NULL, NULL}
+#define DA_GROWTH_POW2_INIT(/* size_t */min)                                  \
+    {DA_GROWTH_POW2, 0.0, 0, (min), NULL, NULL}
+#define DA_GROWTH_CALLBACK_INIT(/* size_t(*)(size_t, void*) */callback,       \
+    /* void* */ctx)                                                           \
+    {DA_GROWTH_CALLBACK, 0.0, 0, 0, (callback), (ctx)}
+
+/**@struct
+ * @brief Memory allocator used by a darray. Like the growth policy, a darray
+ *  only holds a pointer to its allocator, so the allocator must outlive every
+ *  darray that uses it.
+ *
+ * @note `alloc` and `realloc` must return blocks aligned to at least
+ *  DA_MALLOC_ALIGNMENT bytes, or `NULL` on failure. The library always passes
+ *  the exact size of a block to `realloc` and `free`.
+ */
+struct da_allocator
+{
+    void* (*alloc)(void* ctx, size_t size);
+    void* (*realloc)(void* ctx, void* ptr, size_t old_size, size_t new_size);
+    void (*free)(void* ctx, void* ptr, size_t size);
+    void* ctx;
+};
+
+/**@struct
+ * @brief Optional attributes of a darray chosen at allocation time.
+ *
+ * @note Zero initialized attributes produce the same darray as `da_alloc`.
+ */
+struct da_attr
+{
+    // Alignment of the handle in bytes. Zero selects DA_ALIGNMENT_DEFAULT.
+    size_t align;
+    // Growth policy. NULL selects the default policy.
+    const struct da_growth* growth;
+    // Allocator. NULL selects malloc/realloc/free.
+    const struct da_allocator* allocator;
+    // Bitwise OR of DA_FLAG_* values.
+    size_t flags;
+};
+
+/**@struct
+ * @brief Bump allocator handing out memory from a list of large chunks.
+ *  Individual frees are (almost) no-ops; all memory handed out by the arena
+ *  is reclaimed at once with `da_arena_reset`.
+ *
+ * @note Darrays allocated from an arena must not be used after the arena is
+ *  reset or destroyed. Calling `da_free` on them is optional.
+ */
+struct da_arena
+{
+    // Allocator to pass to `struct da_attr`.
+    struct da_allocator allocator;
+    struct _da_arena_chunk* head;
+    struct _da_arena_chunk* curr;
+    size_t chunk_size;
+};
+
+// Size classes of the pool allocator are the powers of two in the range
+// [2^DA_POOL_MIN_CLASS, 2^DA_POOL_MAX_CLASS]. Larger blocks bypass the pool.
+#define DA_POOL_MIN_CLASS 6
+#define DA_POOL_MAX_CLASS 20
+#define DA_POOL_NCLASSES (DA_POOL_MAX_CLASS - DA_POOL_MIN_CLASS + 1)
+
+/**@struct
+ * @brief Size-class pool allocator. Freed blocks are kept on per-class free
+ *  lists and reused by later allocations of the same class instead of going
+ *  back to malloc.
+ */
+struct da_pool
+{
+    // Allocator to pass to `struct da_attr`.
+    struct da_allocator allocator;
+    void* free_lists[DA_POOL_NCLASSES];
+};
+
+#ifdef DA_HAVE_MMAP
+// Advise the kernel to back virtual memory darrays with huge pages.
+#define DA_VM_HUGEPAGE ((size_t)1 << 0)
+
+/**@struct
+ * @brief Allocator backing each darray with its own reserved range of virtual
+ *  memory. Growing within the reservation only commits more pages, so the
+ *  darray is never copied and its handle never moves. Growing past the
+ *  reservation remaps the range (zero-copy on Linux).
+ */
+struct da_vm
+{
+    // Allocator to pass to `struct da_attr`.
+    struct da_allocator allocator;
+    size_t reserve;
+    size_t flags;
+    size_t page_size;
+};
+
+// Map the file read-only. Any modification of the darray is a fault.
+#define DA_MAP_READONLY ((size_t)1 << 0)
+#endif // DA_HAVE_MMAP
+
+// Version of the on-disk format written by `da_save`.
+#define DA_FILE_VERSION 1
+
+// Size of the cache lines that threads are kept from sharing.
+#define DA_CACHE_LINE_SIZE 64
+
+/**@struct
+ * @brief Fixed capacity ring buffer over a darray. Elements are pushed at the
+ *  tail and popped from the head, which wrap around the darray, so no element
+ *  is ever moved and the ring never reallocates. The head is written only by
+ *  the consumer and the tail only by the producer, and each sits on a cache
+ *  line of its own, away from the fields both sides read. Only the `da_ring_*`
+ *  functions may modify the ring.
+ */
+struct da_ring
+{
+    // Darray holding the elements. Its length is not maintained.
+    void* darr;
+    // Capacity of `darr` minus one. The capacity is a power of two.
+    size_t mask;
+    size_t elsz;
+    char _pad0[DA_CACHE_LINE_SIZE];
+    // Count of elements ever popped.
+    size_t head;
+    char _pad1[DA_CACHE_LINE_SIZE - sizeof(size_t)];
+    // Count of elements ever pushed.
+    size_t tail;
+    char _pad2[DA_CACHE_LINE_SIZE - sizeof(size_t)];
+};
+
+#ifdef DA_HAVE_FD_IO
+/**@struct
+ * @brief Progress of a darray being read from a file descriptor with
+ *  `da_reader_read`. Reading stops whenever a non-blocking descriptor has no
+ *  data and picks up where it left off on the next call. Only the
+ *  `da_reader_*` functions may modify the reader.
+ */
+struct da_reader
+{
+    size_t size;
+    // Longest darray accepted, checked before the darray is allocated.
+    size_t max_length;
+    const struct da_attr* attr;
+    // Bytes of the current darray read so far.
+    size_t offset;
+    // Offset of the first element, known once the file header is read.
+    size_t data_offset;
+    // The file header, then the darray header, as they arrive.
+    size_t header[16];
+    void* darr;
+};
+#endif // DA_HAVE_FD_IO
+
+/**@struct
+ * @brief Structure of arrays: `ncolumns` columns of elements sharing a single
+ *  length and capacity, stored in one block. Element `i` of a record lives at
+ *  index `i` of every column. Each column can be used as a plain array,
+ *  aligned to DA_SOA_ALIGNMENT, so loops over one field stream through
+ *  memory touching nothing else. Only the `da_soa_*` functions may change the
+ *  length or capacity.
+ */
+struct da_soa
+{
+    // First element of each column.
+    void** columns;
+    // `sizeof` the elements of each column.
+    size_t* sizes;
+    size_t ncolumns;
+    size_t length;
+    size_t capacity;
+    void* block;
+};
+
+// Alignment of the columns of a `struct da_soa`, enough for any SIMD load.
+#define DA_SOA_ALIGNMENT 64
+
+/**@struct
+ * @brief Segmented array: elements stored in fixed-size segments of
+ *  `1 << shift` elements each, listed in order in the darray `segments`.
+ *  Segments are never moved, so pushing never copies existing elements and
+ *  pointers to elements stay valid until the elements are popped or `seg` is
+ *  destroyed. Only the `da_seg_*` functions may change the length.
+ */
+struct da_seg
+{
+    // Darray of the segments, in order. Each segment is a darray aligned to
+    // `align`.
+    void** segments;
+    size_t elsz;
+    size_t align;
+    size_t shift;
+    size_t length;
+};
+
+// Segment size selected by `da_seg_init` when none is given, in bytes.
+#define DA_SEG_SEGMENT_BYTES 4096
+
+/**@struct
+ * @brief Bit-packed array of integers. Each value is stored as its difference
+ *  from `base`, modulo 2^64, in `bits` bits of the darray `words`. The width
+ *  grows as needed when wider values are stored, repacking every value. Only
+ *  the `da_packed_*` functions may modify the structure.
+ */
+struct da_packed
+{
+    // Darray of the words holding the packed values.
+    uint64_t* words;
+    // Frame of reference subtracted from every value before it is packed.
+    uint64_t base;
+    // Bits per value.
+    unsigned bits;
+    size_t length;
+};
+
+// Interpretation of the elements sorted by `da_sort_radix`.
+enum da_sort_key
+{
+    // Unsigned integers of 1, 2, 4 or 8 bytes.
+    DA_SORT_UNSIGNED,
+    // Two's complement signed integers of 1, 2, 4 or 8 bytes.
+    DA_SORT_SIGNED,
+    // IEEE 754 `float` or `double`.
+    DA_SORT_FLOAT
+};
+
+#if defined(__GNUC__) || defined(__clang__)
+#   define DA_HAVE_ATOMICS
+#endif
+
+#ifdef DA_HAVE_ATOMICS
+// Number of elements in the first segment of a `struct da_concurrent`. Each
+// following segment is twice as large as the one before it.
+#define DA_CONCURRENT_FIRST_SEGMENT 64
+// Maximum number of segments of a `struct da_concurrent`.
+#define DA_CONCURRENT_NSEGMENTS 48
+
+/**@struct
+ * @brief Segment of a `struct da_concurrent`: a darray holding the elements
+ *  and one flag per element, set once that element has been written.
+ */
+struct _da_concurrent_segment
+{
+    void* darr;
+    unsigned char* ready;
+};
+
+/**@struct
+ * @brief Darray that any number of threads may append to concurrently without
+ *  locking or waiting on each other. Appenders claim slots with an atomic
+ *  counter, write into the segment holding that slot and mark it ready.
+ *  Segments are never moved: the first appender to need a segment allocates
+ *  it and installs it with a compare-and-swap, so growth copies nothing.
+ *  Readers advance the committed prefix over ready slots, so they always see
+ *  completely written elements, and a stalled appender only holds back the
+ *  prefix, never the other appenders.
+ */
+struct da_concurrent
+{
+    struct _da_concurrent_segment* segments[DA_CONCURRENT_NSEGMENTS];
+    struct da_attr attr;
+    size_t elsz;
+    size_t reserved;
+    size_t committed;
+    int failed;
+};
+
+/**@struct
+ * @brief Darray shared between threads, guarded by a spin lock. Initialize
+ *  `darr` with any darray and `lock` with 0.
+ */
+struct da_shared
+{
+    void* darr;
+    int lock;
+};
+
+/**@struct
+ * @brief Per-thread buffer of pushes bound for a `struct da_shared`. Elements
+ *  are collected without any synchronization and appended to the shared
+ *  darray in one copy when the buffer fills up, so the lock is taken once per
+ *  batch rather than once per element. Each thread must use its own batch.
  */
+struct da_batch
+{
+    struct da_shared* shared;
+    void* buffer;
+};
+#endif // DA_HAVE_ATOMICS
+
+#if defined(DA_HAVE_ATOMICS) && (defined(__unix__) || defined(__APPLE__))
+#   define DA_HAVE_THREADS
+#endif
+
+#ifdef DA_HAVE_THREADS
+// Process the elements of `darr` in the index range [begin, end).
+typedef void (*da_range_fn)(void* darr, size_t begin, size_t end, void* ctx);
+// Fold the elements of `darr` in the index range [begin, end) into `acc`.
+typedef void (*da_reduce_fn)(void* acc, void* darr, size_t begin, size_t end,
+    void* ctx);
+// Fold the accumulator `other` into `acc`.
+typedef void (*da_combine_fn)(void* acc, const void* other, void* ctx);
+#endif // DA_HAVE_THREADS
 
 /**@function
  * @brief Allocate a darray of `nelem` elements each of size `size`.
@@ -53,6 +445,60 @@
  */
 static inline void* da_alloc(size_t nelem, size_t size);
 
+/**@function
+ * @brief Allocate a darray of `nelem` elements each of size `size` whose
+ *  handle is aligned to an `align` byte boundary.
+ *
+ * @param nelem : Initial number of elements in the darray.
+ * @param size : `sizeof` each element.
+ * @param align : Alignment of the handle in bytes. Must be a power of two.
+ *
+ * @return Pointer to a new darray. If `align` is not a power of two or
+ *  allocation failed, `NULL` is returned.
+ *
+ * @note The alignment is stored in the darray header and is preserved
+ *  through every reallocation performed by the library.
+ */
+static inline void* da_alloc_aligned(size_t nelem, size_t size, size_t align);
+
+/**@function
+ * @brief Allocate a darray of `nelem` elements each of size `size` using the
+ *  attributes in `attr`.
+ *
+ * @param nelem : Initial number of elements in the darray.
+ * @param size : `sizeof` each element.
+ * @param attr : Attributes of the new darray. May be `NULL`, in which case
+ *  this function is equivalent to `da_alloc`.
+ *
+ * @return Pointer to a new darray. If an attribute is invalid or allocation
+ *  failed, `NULL` is returned.
+ */
+static inline void* da_alloc_attr(size_t nelem, size_t size,
+    const struct da_attr* attr);
+
+/**@function
+ * @brief Create an empty darray in caller provided storage, such as a local
+ *  buffer or a member of a struct, instead of on the heap. The darray holds as
+ *  many elements as fit in `buf` and moves to the heap through the normal
+ *  reallocation path the first time it has to grow. `da_free` only frees
+ *  the heap copy, so an inline darray may simply be abandoned if it never
+ *  grew. `buf` must outlive the darray until then.
+ *
+ * @param buf : Storage for the darray header and elements.
+ * @param bufsize : Size of `buf` in bytes. DA_INLINE_BUFFER_SIZE gives the
+ *  size required for a number of elements.
+ * @param size : `sizeof` each element.
+ *
+ * @return Pointer to the new darray, or `NULL` if `size` is zero or `buf`
+ *  cannot even hold the darray header.
+ */
+static inline void* da_init_inline(void* buf, size_t bufsize, size_t size);
+
+// Size of a buffer passed to `da_init_inline` that holds at least `nelem`
+// elements of size `size` wherever it is placed in memory.
+#define DA_INLINE_BUFFER_SIZE(nelem, size) \
+    (DA_HANDLE_OFFSET + DA_ALIGNMENT_DEFAULT - 1 + (nelem)*(size))
+
 /**@function
  * @brief Free a darray.
  *
@@ -86,452 +532,5501 @@ static inline size_t da_capacity(void* darr);
 static inline size_t da_sizeof_elem(void* darr);
 
 /**@function
- * @brief Change the length of the darray to `nelem`. Data for elements with
- *  indices >= `nelem` may be lost when downsizing.
+ * @brief Returns the alignment of the darray handle in bytes.
  *
- * @param darr : Target darray. Upon function completion, `darr` may or may not
- *  point to its previous block on the heap, potentially breaking references.
- * @return Pointer to the new location of the darray upon successful function
- *  completion. If `da_resize` returns `NULL`, allocation failed and `darr` is
- *  left untouched.
+ * @param darr : Target darray.
+ * @return Alignment the darray was allocated with.
+ */
+static inline size_t da_alignment(void* darr);
+
+/**@function
+ * @brief Returns the DA_FLAG_* flags the darray was allocated with.
  *
- * @note Affects the length attribute of the darray.
+ * @param darr : Target darray.
+ * @return Bitwise OR of the flags of the darray.
  */
-static inline void* da_resize(void* darr, size_t nelem);
+static inline size_t da_flags(void* darr);
 
 /**@function
- * @brief Guarantee that at least `nelem` elements beyond the current length of
- *  the darray can be inserted/pushed without requiring resizing.
+ * @brief Change the growth policy used when `darr` needs more capacity.
+ *
+ * @param darr : Target darray.
+ * @param growth : New growth policy, or `NULL` for the default policy.
+ *
+ * @note Does not reallocate memory. The new policy takes effect the next time
+ *  the darray grows.
+ */
+static inline void da_set_growth(void* darr, const struct da_growth* growth);
+
+/**@function
+ * @brief Add a reference to `darr` in constant time, sharing its block with
+ *  the caller instead of copying it. The block is copied the first time one of
+ *  the references is pushed to, inserted into, removed from, resized or
+ *  reserved, which leaves the other references unchanged. Each reference is
+ *  released with `da_free`.
+ *
+ * @param darr : Target darray.
+ * @return `darr`, now holding one more reference.
+ *
+ * @note Every function that changes the length or layout of a darray copies
+ *  it first, or, like `da_remove_sorted`, refuses a shared darray. Writes
+ *  through the bracket operator and functions that only change elements in
+ *  place (`da_fill`, `da_swap`, `da_sort`, etc.) do not copy. Call
+ *  `da_unshare` before using them on a darray that may be shared.
+ * @note Taking and releasing references is atomic when the compiler provides
+ *  atomics, so references to the same darray may be held by different
+ *  threads.
+ * @note Ring buffers, gap buffers and darrays mapped with DA_MAP_READONLY can
+ *  not be shared.
+ */
+static inline void* da_share(void* darr);
+
+/**@function
+ * @brief Make sure the caller holds the only reference to the block of `darr`,
+ *  copying it if it is shared.
  *
  * @param darr : Target darray. Upon function completion, `darr` may or may not
  *  point to its previous block on the heap, potentially breaking references.
- * @return Pointer to the new location of the darray upon successful function
- *  completion. If `da_reserve` returns `NULL`, allocation failed and `darr` is
- *  left untouched.
+ * @return Pointer to the darray upon successful function completion. If
+ *  `da_unshare` returns `NULL`, allocation failed and `darr` is left
+ *  untouched.
  *
- * @note Does NOT affect the length attribute of the darray.
+ * @note If `da_pop`, `da_remove` or `da_swap_remove` fail to copy a shared
+ *  darray, `darr` and its elements are left untouched and the element that
+ *  would have been removed is returned. The failure can be detected by
+ *  `da_refcount(darr)` still exceeding 1.
  */
-static inline void* da_reserve(void* darr, size_t nelem);
+static inline void* da_unshare(void* darr);
 
-/**@macro
- * @brief Insert a value at the back of `darr`.
+/**@function
+ * @brief Returns the number of references to the block of `darr`.
  *
- * @param darr : const lvalue pointing to the target darray.
- * @param value : Value to be pushed onto the back of the darray.
+ * @param darr : Target darray.
+ * @return One for a darray that is not shared.
+ */
+static inline size_t da_refcount(void* darr);
+
+/**@function
+ * @brief Initialize a bump arena that allocates memory in chunks of at least
+ *  `chunk_size` bytes.
  *
- * @note Affects the length of the darray.
- * @note This macro implimentation is the fast version of `da_spush`. Unlike the
- *  rest of the API, failed allocations from resizing with `da_push` may
- *  cause your program to blow up as reallocs are always reassigned back to
- *  `darr`. With this version of push, the user sacrifices safety for speed.
+ * @param arena : Target arena.
+ * @param chunk_size : Minimum size of each chunk requested from malloc.
  */
-#define /* void */da_push(/* void* */darr, /* ELEM_TYPE */value)               \
-                                                           _da_push(darr, value)
+static inline void da_arena_init(struct da_arena* arena, size_t chunk_size);
 
-/**@macro
- * @brief Push a value to the back of `darr`. This is the safe version of
- *  `da_push`.
+/**@function
+ * @brief Reclaim all memory handed out by `arena` at once. Chunks are kept and
+ *  reused by future allocations.
  *
- * @param darr : const lvalue pointing to the target darray.
- * @param value : Value to be pushed onto the back of the darray.
- * @param backup : lvalue that will store a backup of `darr` in in case of
- *  reallocation failure.
+ * @param arena : Target arena.
+ */
+static inline void da_arena_reset(struct da_arena* arena);
+
+/**@function
+ * @brief Release every chunk owned by `arena` back to the system.
  *
- * @note Affects the length of the darray.
- * @note If malloc fails to allocate memory during automatic array resizeing
- *  a backup of the darray will be saved to `backup` and `darr` will be
- *  set to `NULL`.
+ * @param arena : Target arena.
  */
-#define /* void* */da_spush(/* void* */darr, /* ELEM_TYPE */value,             \
-    /* void* */backup)                                                         \
-                                              _da_safe_push(darr, value, backup)
+static inline void da_arena_destroy(struct da_arena* arena);
 
-/**@macro
- * @brief Remove a value from the back of `darr` and return it.
+/**@function
+ * @brief Initialize a size-class pool allocator.
  *
- * @param darr : const lvalue pointing to the target darray.
+ * @param pool : Target pool.
+ */
+static inline void da_pool_init(struct da_pool* pool);
+
+/**@function
+ * @brief Release every cached block owned by `pool` back to the system.
  *
- * @return Value popped off of the back of the darray.
+ * @param pool : Target pool.
  *
- * @note Affects the length of the darray.
- * @note `da_pop` will never reallocate memory, so popping is always
- *  allocation-safe.
+ * @note Darrays still allocated from the pool are not affected and may be
+ *  freed later with `da_free`, which will cache their memory again.
  */
-#define /* ELEM_TYPE */da_pop(/* void* */darr)                                 \
-                                                                   _da_pop(darr)
+static inline void da_pool_destroy(struct da_pool* pool);
 
-/**@macro
- * @brief Insert a value into `darr` at the specified index, moving the values
- * beyond `index` back one element.
+#ifdef DA_HAVE_MMAP
+/**@function
+ * @brief Initialize a virtual memory allocator.
  *
- * @param darr : const lvalue pointing to the target darray.
- * @param index : Array index where the new value will appear.
- * @param value : Value to be inserted onto the darray.
+ * @param vm : Target allocator.
+ * @param reserve : Bytes of address space reserved up front for each darray.
+ *  Only the pages actually in use are committed. Larger reservations trade
+ *  address space (which is plentiful on 64-bit systems) for fewer remaps.
+ * @param flags : Bitwise OR of DA_VM_* flags.
+ */
+static inline void da_vm_init(struct da_vm* vm, size_t reserve, size_t flags);
+#endif // DA_HAVE_MMAP
+
+/**@function
+ * @brief Write the elements of a darray to a file that can later be mapped
+ *  with `da_map_file`. The file mirrors the in-memory layout of the darray,
+ *  so it is only readable on machines with the same word size and byte order.
+ *  The growth policy and allocator of the darray are not saved.
  *
- * @note Affects the length of the darray.
- * @note This macro implimentation is the fast version of `da_sinsert`. Unlike
- *  the rest of the API, failed allocations from resizing with `da_insert` may
- *  cause your program to blow up as reallocs are always reassigned back to
- *  `darr`. With this version of insert, the user sacrifices safety for
- *  speed.
+ * @param darr : Target darray.
+ * @param path : Path of the file to create or overwrite.
+ *
+ * @return 0 on success, -1 on failure.
  */
-#define /* void */da_insert(/* void* */darr, /* size_t */index,                \
-    /* ELEM_TYPE */value)                                                      \
-                                                  _da_insert(darr, index, value)
+static inline int da_save(void* darr, const char* path);
 
-/**@macro
- * @brief Insert a value into `darr` at the specified index, moving the values
- * beyond `index` back one element. This is the safe version of `da_insert`.
+#ifdef DA_HAVE_MMAP
+/**@function
+ * @brief Map a file written by `da_save` directly into memory as a darray,
+ *  without reading it or copying its elements. Unless `DA_MAP_READONLY` is
+ *  given the mapping is copy-on-write: the darray may be modified freely, but
+ *  changes never reach the file. Growing the darray past its saved length
+ *  moves it onto the heap.
  *
- * @param darr : const lvalue pointing to the target darray.
- * @param index : Array index where the new value will appear.
- * @param value : Value to be inserted onto the array.
- * @param backup : lvalue that will store a backup of `darr` in in case of
- *  resize failure.
+ * @param path : Path of the file to map.
+ * @param size : `sizeof` each element. Must match the saved darray.
+ * @param flags : Bitwise OR of DA_MAP_* flags.
  *
- * @note Affects the length of the darray.
- * @note If malloc fails to allocate memory during automatic array resizeing
- *  a backup of the darray will be saved to `backup` and `darr` will be set to
- *  `NULL`.
+ * @return Pointer to the mapped darray, to be released with `da_free`. If the
+ *  file could not be mapped or is not a valid darray file, `NULL` is returned.
  */
-#define /* void* */da_sinsert(/* void* */darr, /* size_t */index,              \
-    /* ELEM_TYPE */value, /* void* */backup)                                   \
-                                     _da_safe_insert(darr, index, value, backup)
+static inline void* da_map_file(const char* path, size_t size, size_t flags);
+#endif // DA_HAVE_MMAP
 
-/**@macro
- * @brief Remove the value at index from `darr` and return it, moving the
- * values past `index` up one element.
+#ifdef DA_HAVE_FD_IO
+/**@function
+ * @brief Write a darray to a file descriptor in the format of `da_save`,
+ *  handing the headers and the elements to a single `writev` without copying
+ *  them. Short writes are resumed, so `fd` may be a pipe or a socket.
  *
- * @param darr : const lvalue pointing to the target darray.
- * @param index : Array index of the value to be removed.
+ * @param darr : Target darray.
+ * @param fd : File descriptor open for writing.
  *
- * @return Value removed from the darray.
+ * @return 0 on success, -1 on failure, in which case part of the darray may
+ *  already have been written.
  *
- * @note Affects the length of the darray.
- * @note `da_remove` will never reallocate memory, so removing is always
- *  allocation-safe.
+ * @note `fd` must be blocking. A non-blocking descriptor that fills up fails
+ *  with `errno` set to EAGAIN or EWOULDBLOCK; use `da_write_fd_resume` then.
  */
-#define /* ELEM_TYPE */da_remove(/* void* */darr, /* size_t */index)           \
-                                                         _da_remove(darr, index)
+static inline int da_write_fd(void* darr, int fd);
 
-/**@macro
- * @brief Set every element of `darr` to `value`.
+/**@function
+ * @brief Write the part of `darr` from byte `*offset` of the stream written by
+ *  `da_write_fd` onward, stopping early if `fd` would block.
  *
- * @param darr : const lvalue pointing to the target darray.
- * @param VALUE_TYPE : type of `value`.
- * @param value : Value to fill the array with.
+ * @param darr : Target darray. It must not change until the write completes.
+ * @param fd : File descriptor open for writing.
+ * @param offset : Bytes of the stream already written, 0 for a new darray.
+ *  Advanced by the bytes written during the call.
+ *
+ * @return 0 once the whole darray is written, 1 if `fd` would block before
+ *  that, in which case the call is repeated with the same `offset` once `fd`
+ *  is writable, or -1 on failure.
  */
-#define /* void */da_fill(/* void* */darr, VALUE_TYPE, /* VALUE_TYPE */value)  \
-                                               _da_fill(darr, VALUE_TYPE, value)
+static inline int da_write_fd_resume(void* darr, int fd, size_t* offset);
 
-/**@macro
- * @brief `da_foreach` acts as a loop-block that forward iterates through all
- *  elements of `darr`. In each iteration a variable with identifier `itername`
- *  will point to an element of `darr` starting at at its first element.
+/**@function
+ * @brief Read a darray written by `da_write_fd` or `da_save` from a file
+ *  descriptor. The darray is allocated once at its final size and its
+ *  elements are read straight into it, over as many reads as `fd` needs.
  *
- * @param darr : const lvalue pointing to the target darray.
- * @param ELEM_TYPE : type of the elements of darr.
- * @param itername : identifier for the iterator within the foreach block.
+ * @param fd : File descriptor open for reading, positioned at the start of a
+ *  darray.
+ * @param size : `sizeof` each element. Must match the written darray.
+ * @param attr : Attributes of the new darray. `NULL` keeps the alignment and
+ *  flags of the written darray with the default growth policy and allocator.
+ *
+ * @return Pointer to the new darray, or `NULL` if reading or allocation
+ *  failed or the data is not a valid darray.
+ *
+ * @note `fd` must be blocking, and the length found in the stream is trusted.
+ *  Use `struct da_reader` to read from non-blocking descriptors or to limit
+ *  the length of the darray.
  */
-#define da_foreach(/* void* */darr, ELEM_TYPE, itername)                       \
-                                          _da_foreach(darr, ELEM_TYPE, itername)
+static inline void* da_read_fd(int fd, size_t size, const struct da_attr* attr);
 
-/**@macro
- * @brief `da_foreachr` acts as a loop-block that reverse iterates through all
- *  elements of `darr`. In each iteration a variable with identifier `itername`
- *  will point to an element of `darr` starting at its last element.
+/**@function
+ * @brief Initialize a reader of darrays written by `da_write_fd` or `da_save`.
  *
- * @param darr : const lvalue pointing to the target darray.
- * @param ELEM_TYPE : type of the elements of darr.
- * @param itername : identifier for the iterator within the foreachr block.
+ * @param reader : Target reader.
+ * @param size : `sizeof` each element. Must match the written darrays.
+ * @param max_length : Longest darray accepted. Longer darrays fail before
+ *  anything is allocated for them.
+ * @param attr : Attributes of the new darrays, as for `da_read_fd`. Must stay
+ *  valid for as long as the reader is used.
  */
-#define da_foreachr(/* void* */darr, ELEM_TYPE, itername)                      \
-                                         _da_foreachr(darr, ELEM_TYPE, itername)
+static inline void da_reader_init(struct da_reader* reader, size_t size,
+    size_t max_length, const struct da_attr* attr);
 
 /**@function
- * @brief Swap the values of the two specified elements of `darr`.
+ * @brief Read as much of a darray from `fd` as is available.
  *
- * @param darr : Target darray.
- * @param index_a : Index of the first element.
- * @param index_b : Index of the second element.
+ * @param reader : Target reader.
+ * @param fd : File descriptor open for reading.
+ * @param darr : Set to the new darray once it is complete.
+ *
+ * @return 0 once a darray is complete and stored in `*darr`, after which the
+ *  reader is ready for the next darray of the stream. 1 if `fd` would block
+ *  first, in which case the call is repeated once `fd` is readable. -1 if
+ *  reading or allocation failed, the stream ended, the data is not a valid
+ *  darray or it is longer than allowed. The reader must then be destroyed.
  */
-static inline void da_swap(void* darr, size_t index_a, size_t index_b);
+static inline int da_reader_read(struct da_reader* reader, int fd,
+    void** darr);
+
+/**@function
+ * @brief Free the darray `reader` has partially read, if any.
+ *
+ * @param reader : Target reader.
+ */
+static inline void da_reader_destroy(struct da_reader* reader);
+#endif // DA_HAVE_FD_IO
+
+#ifdef DA_HAVE_ATOMICS
+/**@function
+ * @brief Initialize a concurrent darray holding elements of size `size`.
+ *
+ * @param cda : Target concurrent darray.
+ * @param size : `sizeof` each element.
+ * @param attr : Attributes of the underlying darrays. May be `NULL`.
+ *
+ * @return 0 on success, -1 if allocation failed.
+ */
+static inline int da_concurrent_init(struct da_concurrent* cda, size_t size,
+    const struct da_attr* attr);
+
+/**@function
+ * @brief Free a concurrent darray along with every darray it has outgrown.
+ */
+static inline void da_concurrent_destroy(struct da_concurrent* cda);
+
+/**@function
+ * @brief Append the element pointed to by `value` to `cda`. Safe to call from
+ *  any number of threads at once, and never waits on another thread.
+ *
+ * @return 0 on success, -1 if allocation failed. After a failed allocation no
+ *  more elements can be appended.
+ */
+static inline int da_concurrent_push(struct da_concurrent* cda,
+    const void* value);
+
+/**@function
+ * @brief Get the length of a consistent prefix of `cda` while other threads
+ *  keep appending. Every element of the prefix has been completely written
+ *  and may be read with `da_concurrent_at`.
+ */
+static inline size_t da_concurrent_snapshot(struct da_concurrent* cda);
+
+/**@function
+ * @brief Returns a pointer to element `index` of `cda`, which must lie within
+ *  a prefix returned by `da_concurrent_snapshot`. The element stays valid
+ *  until `cda` is destroyed, but must not be modified.
+ */
+static inline void* da_concurrent_at(struct da_concurrent* cda, size_t index);
+
+/**@function
+ * @brief Turn `cda` into an ordinary darray once every appending thread has
+ *  finished. The elements are copied into one block unless they all fit in
+ *  the first segment. `cda` must not be used afterwards.
+ *
+ * @return Darray holding every appended element, to be freed with `da_free`,
+ *  or `NULL` if allocation failed, in which case `cda` is destroyed anyway.
+ */
+static inline void* da_concurrent_release(struct da_concurrent* cda);
+
+/**@function
+ * @brief Acquire the lock of a shared darray, e.g. to read it while other
+ *  threads are flushing batches into it.
+ */
+static inline void da_shared_lock(struct da_shared* shared);
+
+/**@function
+ * @brief Release the lock of a shared darray.
+ */
+static inline void da_shared_unlock(struct da_shared* shared);
+
+/**@function
+ * @brief Initialize a batch buffering up to `nelem` elements of size `size`
+ *  for the shared darray `shared`.
+ *
+ * @return 0 on success, -1 if allocation failed.
+ */
+static inline int da_batch_init(struct da_batch* batch,
+    struct da_shared* shared, size_t size, size_t nelem);
+
+/**@function
+ * @brief Flush the remaining elements of `batch` and free its buffer.
+ *
+ * @return 0 on success, -1 if the final flush failed to allocate, in which
+ *  case the remaining elements are lost.
+ */
+static inline int da_batch_destroy(struct da_batch* batch);
+
+/**@function
+ * @brief Buffer the element pointed to by `value`, flushing the batch first if
+ *  it is full.
+ *
+ * @return 0 on success, -1 if a flush failed to allocate. The element is not
+ *  pushed in that case, and the batch keeps its elements for a later flush.
+ */
+static inline int da_batch_push(struct da_batch* batch, const void* value);
+
+/**@function
+ * @brief Append every buffered element of `batch` to its shared darray.
+ *
+ * @return 0 on success, -1 if allocation failed, in which case both the
+ *  shared darray and the batch are left untouched.
+ */
+static inline int da_batch_flush(struct da_batch* batch);
+#endif // DA_HAVE_ATOMICS
+
+#ifdef DA_HAVE_THREADS
+/**@function
+ * @brief Call `fn` on every element of `darr` using `nthreads` threads. The
+ *  index range is split into chunks whose boundaries fall on cache line
+ *  boundaries, so no two threads ever write to the same cache line. Idle
+ *  threads claim the next unprocessed chunk, balancing uneven work.
+ *
+ * @param darr : Target darray.
+ * @param nthreads : Number of threads, including the calling thread. 0 uses
+ *  one thread per online processor.
+ * @param fn : Function called on ranges of `darr`, concurrently from several
+ *  threads.
+ * @param ctx : Passed to every call of `fn`.
+ *
+ * @note If threads cannot be created, the remaining work is done by the
+ *  calling thread.
+ */
+static inline void da_parallel_for(void* darr, size_t nthreads, da_range_fn fn,
+    void* ctx);
+
+/**@function
+ * @brief Reduce the elements of `darr` to a single value using `nthreads`
+ *  threads. Each thread folds its chunks into a private accumulator starting
+ *  from a copy of `identity`, and the accumulators are combined at the end.
+ *
+ * @param darr : Target darray.
+ * @param nthreads : Number of threads, including the calling thread. 0 uses
+ *  one thread per online processor.
+ * @param reduce : Folds a range of `darr` into an accumulator.
+ * @param combine : Folds one accumulator into another. Must be associative and
+ *  commutative, as chunks are not reduced in any particular order.
+ * @param identity : Initial value of every accumulator.
+ * @param result : Set to the reduced value. May alias `identity`.
+ * @param acc_size : `sizeof` the accumulator.
+ * @param ctx : Passed to every call of `reduce` and `combine`.
+ *
+ * @return 0 on success, -1 if allocation failed.
+ */
+static inline int da_parallel_reduce(void* darr, size_t nthreads,
+    da_reduce_fn reduce, da_combine_fn combine, const void* identity,
+    void* result, size_t acc_size, void* ctx);
+#endif // DA_HAVE_THREADS
+
+/**@function
+ * @brief Change the length of the darray to `nelem`. Data for elements with
+ *  indices >= `nelem` may be lost when downsizing.
+ *
+ * @param darr : Target darray. Upon function completion, `darr` may or may not
+ *  point to its previous block on the heap, potentially breaking references.
+ * @return Pointer to the new location of the darray upon successful function
+ *  completion. If `da_resize` returns `NULL`, allocation failed and `darr` is
+ *  left untouched.
+ *
+ * @note Affects the length attribute of the darray.
+ * @note Downsizing keeps the current capacity, unless the darray was allocated
+ *  with DA_FLAG_AUTO_SHRINK and `nelem` is below a quarter of the capacity.
+ *  Use `da_shrink_to_fit` to release unused capacity explicitly.
+ */
+static inline void* da_resize(void* darr, size_t nelem);
+
+/**@function
+ * @brief Guarantee that at least `nelem` elements beyond the current length of
+ *  the darray can be inserted/pushed without requiring resizing.
+ *
+ * @param darr : Target darray. Upon function completion, `darr` may or may not
+ *  point to its previous block on the heap, potentially breaking references.
+ * @return Pointer to the new location of the darray upon successful function
+ *  completion. If `da_reserve` returns `NULL`, allocation failed and `darr` is
+ *  left untouched.
+ *
+ * @note Does NOT affect the length attribute of the darray.
+ */
+static inline void* da_reserve(void* darr, size_t nelem);
+
+/**@function
+ * @brief Reduce the capacity of the darray to its length, handing unused
+ *  memory back to the allocator.
+ *
+ * @param darr : Target darray. Upon function completion, `darr` may or may not
+ *  point to its previous block on the heap, potentially breaking references.
+ * @return Pointer to the new location of the darray upon successful function
+ *  completion. If `da_shrink_to_fit` returns `NULL`, allocation failed and
+ *  `darr` is left untouched.
+ *
+ * @note Does NOT affect the length attribute of the darray.
+ */
+static inline void* da_shrink_to_fit(void* darr);
+
+/**@macro
+ * @brief Insert a value at the back of `darr`.
+ *
+ * @param darr : const lvalue pointing to the target darray.
+ * @param value : Value to be pushed onto the back of the darray.
+ *
+ * @note Affects the length of the darray.
+ * @note This macro implimentation is the fast version of `da_spush`. Unlike the
+ *  rest of the API, failed allocations from resizing with `da_push` may
+ *  cause your program to blow up as reallocs are always reassigned back to
+ *  `darr`. With this version of push, the user sacrifices safety for speed.
+ */
+#define /* void */da_push(/* void* */darr, /* ELEM_TYPE */value)               \
+                                                           _da_push(darr, value)
+
+/**@macro
+ * @brief Push a value to the back of `darr`. This is the safe version of
+ *  `da_push`.
+ *
+ * @param darr : const lvalue pointing to the target darray.
+ * @param value : Value to be pushed onto the back of the darray.
+ * @param backup : lvalue that will store a backup of `darr` in in case of
+ *  reallocation failure.
+ *
+ * @note Affects the length of the darray.
+ * @note If malloc fails to allocate memory during automatic array resizeing
+ *  a backup of the darray will be saved to `backup` and `darr` will be
+ *  set to `NULL`.
+ */
+#define /* void* */da_spush(/* void* */darr, /* ELEM_TYPE */value,             \
+    /* void* */backup)                                                         \
+                                              _da_safe_push(darr, value, backup)
+
+/**@function
+ * @brief Copy `n` elements from `src` onto the back of `darr`, reallocating at
+ *  most once.
+ *
+ * @param darr : Target darray. Upon function completion, `darr` may or may not
+ *  point to its previous block on the heap, potentially breaking references.
+ * @param src : Array of at least `n` elements of size `da_sizeof_elem(darr)`.
+ *  `src` must not point into `darr`.
+ * @param n : Number of elements to append.
+ * @return Pointer to the new location of the darray upon successful function
+ *  completion. If `da_append` returns `NULL`, allocation failed and `darr` is
+ *  left untouched.
+ *
+ * @note Affects the length of the darray.
+ */
+static inline void* da_append(void* darr, const void* src, size_t n);
+
+/**@macro
+ * @brief Remove a value from the back of `darr` and return it.
+ *
+ * @param darr : const lvalue pointing to the target darray.
+ *
+ * @return Value popped off of the back of the darray.
+ *
+ * @note Affects the length of the darray.
+ * @note `da_pop` will never allocate memory, so popping is always
+ *  allocation-safe. Darrays allocated with DA_FLAG_AUTO_SHRINK may be moved
+ *  to a smaller block, in which case `darr` is reassigned.
+ */
+#define /* ELEM_TYPE */da_pop(/* void* */darr)                                 \
+                                                                   _da_pop(darr)
+
+/**@function
+ * @brief Insert `value` at the front of `darr`. For element sizes that are a
+ *  multiple of sizeof(size_t), or for any size with DA_ENABLE_FRONT_SLACK,
+ *  this takes amortized constant time: free slots are kept in front of the
+ *  first element, which the handle and the header move into, so the elements
+ *  are never shifted and `darr[i]` indexing is unaffected. When no slot is
+ *  left the darray is reallocated with room in front for as many elements as
+ *  its growth policy would add at the back. Other darrays shift every element
+ *  up by one slot, in linear time.
+ *
+ * @param darr : Target darray. Upon function completion, `darr` no longer
+ *  points to the darray, breaking references.
+ * @param value : Element of size `da_sizeof_elem(darr)`. `value` must not
+ *  point into `darr`.
+ * @return Pointer to the new location of the darray upon successful function
+ *  completion. If `da_push_front` returns `NULL`, allocation failed and `darr`
+ *  is left untouched.
+ *
+ * @note Affects the length and capacity of the darray. The capacity counts the
+ *  slots from the first element to the end of the block, i.e. the elements
+ *  that can be pushed at the back without reallocating.
+ * @note DA_ENABLE_FRONT_SLACK changes how every header is reached, so it must
+ *  be defined the same way in every translation unit.
+ * @note With DA_ENABLE_FRONT_SLACK, the handle moves by one element at a time,
+ *  so only the alignment of the element type is guaranteed for darrays used
+ *  with `da_push_front`.
+ */
+static inline void* da_push_front(void* darr, const void* value);
+
+/**@function
+ * @brief Remove the first element of `darr`, copying it to `value` if `value`
+ *  is not `NULL`. Where `da_push_front` keeps front slack, this takes constant
+ *  time and the vacated slot is kept for later calls to `da_push_front`.
+ *  Other darrays shift every element down by one slot.
+ *
+ * @param darr : Target darray.
+ * @param value : Buffer of size `da_sizeof_elem(darr)`, or `NULL`.
+ * @return Pointer to the new location of the darray. `darr` no longer points to
+ *  the darray, breaking references.
+ *
+ * @note Affects the length and capacity of the darray.
+ * @note `da_pop_front` will never allocate memory, so popping is always
+ *  allocation-safe, unless `darr` is shared. A shared darray is copied first,
+ *  and `NULL` is returned with `darr` left untouched if the copy fails.
+ */
+static inline void* da_pop_front(void* darr, void* value);
+
+/**@function
+ * @brief Initialize a ring buffer holding up to `capacity` elements of size
+ *  `size`, rounded up to a power of two.
+ *
+ *  With DA_HAVE_ATOMICS the ring is a lock-free single producer single
+ *  consumer queue: one thread may push/write while another pops/reads.
+ *
+ * @param ring : Target ring.
+ * @param capacity : Minimum number of elements the ring can hold.
+ * @param size : `sizeof` each element.
+ * @param attr : Attributes of the darray holding the elements. May be `NULL`.
+ *
+ * @return 0 on success, -1 if allocation failed.
+ */
+static inline int da_ring_init(struct da_ring* ring, size_t capacity,
+    size_t size, const struct da_attr* attr);
+
+/**@function
+ * @brief Free the darray holding the elements of `ring`.
+ */
+static inline void da_ring_destroy(struct da_ring* ring);
+
+/**@function
+ * @brief Number of elements waiting in `ring`.
+ */
+static inline size_t da_ring_length(struct da_ring* ring);
+
+/**@function
+ * @brief Copy the element pointed to by `value` to the tail of `ring`.
+ *
+ * @return 0 on success, -1 if the ring is full.
+ */
+static inline int da_ring_push(struct da_ring* ring, const void* value);
+
+/**@function
+ * @brief Remove the element at the head of `ring`, copying it to `value` if
+ *  `value` is not `NULL`.
+ *
+ * @return 0 on success, -1 if the ring is empty.
+ */
+static inline int da_ring_pop(struct da_ring* ring, void* value);
+
+/**@function
+ * @brief Copy up to `n` elements from `src` to the tail of `ring`, in at most
+ *  two calls to memcpy.
+ *
+ * @return Number of elements written, less than `n` if the ring filled up.
+ */
+static inline size_t da_ring_write(struct da_ring* ring, const void* src,
+    size_t n);
+
+/**@function
+ * @brief Remove up to `n` elements from the head of `ring`, copying them to
+ *  `dst` in at most two calls to memcpy.
+ *
+ * @return Number of elements read, less than `n` if the ring ran empty.
+ */
+static inline size_t da_ring_read(struct da_ring* ring, void* dst, size_t n);
+
+/**@function
+ * @brief Initialize a structure of arrays with `nelem` records whose columns
+ *  hold elements of the sizes in `sizes`. The records are left uninitialized.
+ *
+ * @param soa : Target structure of arrays.
+ * @param ncolumns : Number of columns.
+ * @param sizes : `sizeof` the elements of each of the `ncolumns` columns.
+ * @param nelem : Initial number of records.
+ *
+ * @return 0 on success, -1 if allocation failed.
+ */
+static inline int da_soa_init(struct da_soa* soa, size_t ncolumns,
+    const size_t* sizes, size_t nelem);
+
+/**@function
+ * @brief Free the columns of `soa`.
+ */
+static inline void da_soa_destroy(struct da_soa* soa);
+
+/**@macro
+ * @brief Column `index` of `soa` as an array of `ELEM_TYPE`. The pointer is
+ *  invalidated by any function that reallocates `soa`.
+ */
+#define /* ELEM_TYPE* */da_soa_column(/* struct da_soa* */soa, ELEM_TYPE,      \
+    /* size_t */index)                      ((ELEM_TYPE*)(soa)->columns[index])
+
+/**@function
+ * @brief Make room for at least `nelem` more records in `soa`. Every column is
+ *  moved into a single new block.
+ *
+ * @return 0 on success, -1 if allocation failed, in which case `soa` is left
+ *  untouched.
+ */
+static inline int da_soa_reserve(struct da_soa* soa, size_t nelem);
+
+/**@function
+ * @brief Append a record to `soa`, copying the field of column `i` from
+ *  `values[i]`. The values must not point into `soa`.
+ *
+ * @return 0 on success, -1 if allocation failed, in which case `soa` is left
+ *  untouched.
+ */
+static inline int da_soa_push(struct da_soa* soa, const void* const* values);
+
+/**@function
+ * @brief Insert a record before the record at `index` of `soa`, copying the
+ *  field of column `i` from `values[i]`. The values must not point into `soa`.
+ *
+ * @return 0 on success, -1 if allocation failed, in which case `soa` is left
+ *  untouched.
+ */
+static inline int da_soa_insert(struct da_soa* soa, size_t index,
+    const void* const* values);
+
+/**@function
+ * @brief Remove the record at `index` from `soa`, moving the records past it
+ *  up one index in every column.
+ */
+static inline void da_soa_remove(struct da_soa* soa, size_t index);
+
+/**@function
+ * @brief Remove the record at `index` from `soa` in constant time by moving
+ *  the last record into its place.
+ */
+static inline void da_soa_swap_remove(struct da_soa* soa, size_t index);
+
+/**@function
+ * @brief Initialize an empty segmented array of elements of size `size`.
+ *
+ * @param seg : Target segmented array.
+ * @param size : `sizeof` each element.
+ * @param segment_size : Number of elements per segment, rounded up to a power
+ *  of two. Zero selects as many elements as fit in DA_SEG_SEGMENT_BYTES.
+ *
+ * @return 0 on success, -1 if `size` is zero or allocation failed.
+ *
+ * @note Segments are aligned to DA_ALIGNMENT_DEFAULT. Use `da_seg_init_aligned`
+ *  for over-aligned element types.
+ */
+static inline int da_seg_init(struct da_seg* seg, size_t size,
+    size_t segment_size);
+
+/**@function
+ * @brief Initialize an empty segmented array of elements of size `size`
+ *  whose segments are aligned to an `align` byte boundary.
+ *
+ * @param seg : Target segmented array.
+ * @param size : `sizeof` each element.
+ * @param segment_size : Number of elements per segment, as for `da_seg_init`.
+ * @param align : Alignment of each segment in bytes. Must be a power of two.
+ *
+ * @return 0 on success, -1 if `size` is zero, `align` is not a power of two
+ *  or allocation failed.
+ */
+static inline int da_seg_init_aligned(struct da_seg* seg, size_t size,
+    size_t segment_size, size_t align);
+
+/**@function
+ * @brief Free every segment of `seg`.
+ */
+static inline void da_seg_destroy(struct da_seg* seg);
+
+/**@function
+ * @brief Returns a pointer to element `index` of `seg` in constant time.
+ */
+static inline void* da_seg_at(const struct da_seg* seg, size_t index);
+
+/**@function
+ * @brief Allocate segments for at least `nelem` more elements of `seg`.
+ *
+ * @return 0 on success, -1 if allocation failed, in which case the length of
+ *  `seg` is unchanged.
+ */
+static inline int da_seg_reserve(struct da_seg* seg, size_t nelem);
+
+/**@function
+ * @brief Copy the element pointed to by `value` onto the back of `seg`. At
+ *  most one segment is allocated and no element is ever moved.
+ *
+ * @return 0 on success, -1 if allocation failed, in which case `seg` is left
+ *  untouched.
+ */
+static inline int da_seg_push(struct da_seg* seg, const void* value);
+
+/**@function
+ * @brief Remove the last element of `seg`, copying it to `value` unless
+ *  `value` is `NULL`. Segments are kept for reuse until `seg` is destroyed.
+ *
+ * @return 0 on success, -1 if `seg` is empty.
+ */
+static inline int da_seg_pop(struct da_seg* seg, void* value);
+
+/**@macro
+ * @brief `da_seg_foreach` acts as a loop-block that forward iterates through
+ *  all elements of `seg`. In each iteration a variable with identifier
+ *  `itername` will point to an element of `seg`.
+ *
+ * @param seg : Target segmented array.
+ * @param ELEM_TYPE : type of the elements of seg.
+ * @param itername : identifier for the iterator within the foreach block.
+ *
+ * @note The length of `seg` must not change within the foreach block.
+ */
+#define da_seg_foreach(/* struct da_seg* */seg, ELEM_TYPE, itername)           \
+                                       _da_seg_foreach(seg, ELEM_TYPE, itername)
+
+/**@macro
+ * @brief `da_seg_foreach_chunk` acts as a loop-block that iterates over the
+ *  segments of `seg` in order. In each iteration a variable with identifier
+ *  `chunkname` will point to the first element of a segment, and a `size_t`
+ *  with identifier `countname` will hold the number of elements of `seg` in
+ *  that segment. Elements within a segment are contiguous.
+ *
+ * @param seg : Target segmented array.
+ * @param ELEM_TYPE : type of the elements of seg.
+ * @param chunkname : identifier for the segment pointer within the foreach
+ *  block.
+ * @param countname : identifier for the segment length within the foreach
+ *  block.
+ *
+ * @note The length of `seg` must not change within the foreach block.
+ */
+#define da_seg_foreach_chunk(/* struct da_seg* */seg, ELEM_TYPE, chunkname,    \
+    countname)                                                                 \
+                    _da_seg_foreach_chunk(seg, ELEM_TYPE, chunkname, countname)
+
+/**@function
+ * @brief Initialize an empty packed integer array.
+ *
+ * @param packed : Target packed array.
+ * @param bits : Initial bits per value, at most 64. Zero lets the first values
+ *  stored choose the width.
+ * @param base : Frame of reference. Values close above `base` take the fewest
+ *  bits, so the smallest value expected is a good choice.
+ *
+ * @return 0 on success, -1 if `bits` is out of range or allocation failed.
+ */
+static inline int da_packed_init(struct da_packed* packed, unsigned bits,
+    uint64_t base);
+
+/**@function
+ * @brief Free the words of `packed`.
+ */
+static inline void da_packed_destroy(struct da_packed* packed);
+
+/**@function
+ * @brief Returns the value at `index` of `packed`.
+ */
+static inline uint64_t da_packed_get(const struct da_packed* packed,
+    size_t index);
+
+/**@function
+ * @brief Replace the value at `index` of `packed` with `value`, widening the
+ *  array first if `value` does not fit in its current width.
+ *
+ * @return 0 on success, -1 if allocation failed, in which case `packed` is
+ *  left untouched.
+ */
+static inline int da_packed_set(struct da_packed* packed, size_t index,
+    uint64_t value);
+
+/**@function
+ * @brief Guarantee that at least `nelem` more values of the current width can
+ *  be pushed onto `packed` without reallocating.
+ *
+ * @return 0 on success, -1 if allocation failed.
+ */
+static inline int da_packed_reserve(struct da_packed* packed, size_t nelem);
+
+/**@function
+ * @brief Push `value` onto the back of `packed`, widening the array first if
+ *  `value` does not fit in its current width.
+ *
+ * @return 0 on success, -1 if allocation failed, in which case `packed` is
+ *  left untouched.
+ */
+static inline int da_packed_push(struct da_packed* packed, uint64_t value);
+
+/**@function
+ * @brief Push every element of `darr` onto the back of `packed`. The elements
+ *  must be unsigned integers of 1, 2, 4 or 8 bytes. The array is widened at
+ *  most once and reallocated at most once.
+ *
+ * @return 0 on success, -1 if the element size is not supported or allocation
+ *  failed, in which case the values of `packed` are left untouched.
+ */
+static inline int da_packed_encode(struct da_packed* packed, void* darr);
+
+/**@function
+ * @brief Unpack `count` values of `packed` starting at `index` onto the back
+ *  of `darr`, truncating each to the element size of `darr`, which must be 1,
+ *  2, 4 or 8 bytes.
+ *
+ * @param darr : Target darray. Upon function completion, `darr` may or may not
+ *  point to its previous block on the heap, potentially breaking references.
+ * @return Pointer to the new location of the darray upon successful function
+ *  completion. If `da_packed_decode` returns `NULL`, allocation failed or the
+ *  element size is not supported, and `darr` is left untouched.
+ */
+static inline void* da_packed_decode(const struct da_packed* packed,
+    size_t index, size_t count, void* darr);
+
+/**@macro
+ * @brief Insert a value into `darr` at the specified index, moving the values
+ * beyond `index` back one element.
+ *
+ * @param darr : const lvalue pointing to the target darray.
+ * @param index : Array index where the new value will appear.
+ * @param value : Value to be inserted onto the darray.
+ *
+ * @note Affects the length of the darray.
+ * @note This macro implimentation is the fast version of `da_sinsert`. Unlike
+ *  the rest of the API, failed allocations from resizing with `da_insert` may
+ *  cause your program to blow up as reallocs are always reassigned back to
+ *  `darr`. With this version of insert, the user sacrifices safety for
+ *  speed.
+ */
+#define /* void */da_insert(/* void* */darr, /* size_t */index,                \
+    /* ELEM_TYPE */value)                                                      \
+                                                  _da_insert(darr, index, value)
+
+/**@macro
+ * @brief Insert a value into `darr` at the specified index, moving the values
+ * beyond `index` back one element. This is the safe version of `da_insert`.
+ *
+ * @param darr : const lvalue pointing to the target darray.
+ * @param index : Array index where the new value will appear.
+ * @param value : Value to be inserted onto the array.
+ * @param backup : lvalue that will store a backup of `darr` in in case of
+ *  resize failure.
+ *
+ * @note Affects the length of the darray.
+ * @note If malloc fails to allocate memory during automatic array resizeing
+ *  a backup of the darray will be saved to `backup` and `darr` will be set to
+ *  `NULL`.
+ */
+#define /* void* */da_sinsert(/* void* */darr, /* size_t */index,              \
+    /* ELEM_TYPE */value, /* void* */backup)                                   \
+                                     _da_safe_insert(darr, index, value, backup)
+
+/**@function
+ * @brief Copy `n` elements from `src` into `darr` starting at the specified
+ *  index, moving the values beyond `index` back `n` elements. The darray is
+ *  reallocated at most once and the tail is moved only once.
+ *
+ * @param darr : Target darray. Upon function completion, `darr` may or may not
+ *  point to its previous block on the heap, potentially breaking references.
+ * @param index : Array index where the first new value will appear.
+ * @param src : Array of at least `n` elements of size `da_sizeof_elem(darr)`.
+ *  `src` must not point into `darr`.
+ * @param n : Number of elements to insert.
+ * @return Pointer to the new location of the darray upon successful function
+ *  completion. If `da_insert_n` returns `NULL`, allocation failed and `darr` is
+ *  left untouched.
+ *
+ * @note Affects the length of the darray.
+ */
+static inline void* da_insert_n(void* darr, size_t index, const void* src,
+    size_t n);
+
+/**@macro
+ * @brief Remove the value at index from `darr` and return it, moving the
+ * values past `index` up one element.
+ *
+ * @param darr : const lvalue pointing to the target darray.
+ * @param index : Array index of the value to be removed.
+ *
+ * @return Value removed from the darray.
+ *
+ * @note Affects the length of the darray.
+ * @note `da_remove` will never allocate memory, so removing is always
+ *  allocation-safe. Darrays allocated with DA_FLAG_AUTO_SHRINK may be moved
+ *  to a smaller block, in which case `darr` is reassigned.
+ */
+#define /* ELEM_TYPE */da_remove(/* void* */darr, /* size_t */index)           \
+                                                         _da_remove(darr, index)
+
+/**@macro
+ * @brief Remove the value at index from `darr` and return it, moving the last
+ * element of `darr` into the vacated slot. Unlike `da_remove` this does not
+ * preserve the order of the elements, but always runs in constant time.
+ *
+ * @param darr : const lvalue pointing to the target darray.
+ * @param index : Array index of the value to be removed.
+ *
+ * @return Value removed from the darray.
+ *
+ * @note Affects the length of the darray.
+ * @note `da_swap_remove` will never allocate memory, so removing is always
+ *  allocation-safe. Darrays allocated with DA_FLAG_AUTO_SHRINK may be moved
+ *  to a smaller block, in which case `darr` is reassigned.
+ */
+#define /* ELEM_TYPE */da_swap_remove(/* void* */darr, /* size_t */index)      \
+                                                    _da_swap_remove(darr, index)
+
+/**@function
+ * @brief Remove the elements at each of the `n` indices in `indices` from
+ *  `darr`, filling the vacated slots with elements from the back of `darr`.
+ *  Unlike `da_remove_range` this does not preserve the order of the elements,
+ *  but moves at most one element per removed index.
+ *
+ * @param darr : Target darray. Upon function completion, `darr` may or may not
+ *  point to the darray, if it was shared and had to be copied.
+ * @param indices : Indices of the elements to be removed, sorted in ascending
+ *  order and without duplicates.
+ * @param n : Number of indices in `indices`.
+ * @return Pointer to the darray upon successful function completion. If
+ *  `da_swap_remove_many` returns `NULL`, `darr` was shared and could not be
+ *  copied, and is left untouched.
+ *
+ * @note Affects the length of the darray.
+ */
+static inline void* da_swap_remove_many(void* darr, const size_t* indices,
+    size_t n);
+
+/**@function
+ * @brief Remove `count` consecutive elements starting at index `first` from
+ *  `darr`, moving the values past the removed range up `count` elements.
+ *
+ * @param darr : Target darray. Upon function completion, `darr` may or may not
+ *  point to the darray, if it was shared and had to be copied.
+ * @param first : Index of the first element to be removed.
+ * @param count : Number of elements to be removed.
+ * @return Pointer to the darray upon successful function completion. If
+ *  `da_remove_range` returns `NULL`, `darr` was shared and could not be
+ *  copied, and is left untouched.
+ *
+ * @note Affects the length of the darray.
+ * @note `da_remove_range` will never reallocate memory, so removing is always
+ *  allocation-safe, unless `darr` is shared.
+ */
+static inline void* da_remove_range(void* darr, size_t first, size_t count);
+
+/**@function
+ * @brief Insert `value` before the element at logical index `index` of `darr`,
+ *  treating `darr` as a gap buffer. The unused capacity of the darray is kept
+ *  as a gap right after the inserted element, so a run of inserts and removes
+ *  around the same position moves no elements other than the ones crossed
+ *  when the gap is moved there.
+ *
+ *  While the gap is not at the end of the darray DA_FLAG_GAP is set in
+ *  `da_flags(darr)` and the elements are not contiguous: they must be reached
+ *  through `da_gap_at`, and only `da_gap_*` functions, `da_length`,
+ *  `da_capacity`, `da_sizeof_elem`, `da_alignment`, `da_flags`, `da_save` and
+ *  `da_free` may be called on the darray. `da_gap_materialize` turns it back
+ *  into an ordinary darray.
+ *
+ * @param darr : Target darray. Upon function completion, `darr` may or may not
+ *  point to its previous block on the heap, potentially breaking references.
+ * @param index : Logical index where `value` will appear.
+ * @param value : Element of size `da_sizeof_elem(darr)`. `value` must not
+ *  point into `darr`.
+ * @return Pointer to the new location of the darray upon successful function
+ *  completion. If `da_gap_insert` returns `NULL`, allocation failed and `darr`
+ *  is left untouched.
+ *
+ * @note Affects the length of the darray.
+ */
+static inline void* da_gap_insert(void* darr, size_t index, const void* value);
+
+/**@function
+ * @brief Remove the element at logical index `index` from gap buffer `darr`.
+ *  Removing the element just before or just after the gap moves no elements.
+ *
+ * @param darr : Target darray. Upon function completion, `darr` may or may not
+ *  point to the darray, if it was shared and had to be copied.
+ * @param index : Logical index of the element to be removed.
+ * @return Pointer to the darray upon successful function completion. If
+ *  `da_gap_remove` returns `NULL`, `darr` was shared and could not be copied,
+ *  and is left untouched.
+ *
+ * @note Affects the length of the darray.
+ * @note `da_gap_remove` will never reallocate memory, so removing is always
+ *  allocation-safe, unless `darr` is shared.
+ */
+static inline void* da_gap_remove(void* darr, size_t index);
+
+/**@function
+ * @brief Get a pointer to the element at logical index `index` of gap buffer
+ *  `darr`. Works on ordinary darrays too.
+ */
+static inline void* da_gap_at(void* darr, size_t index);
+
+/**@function
+ * @brief Move the gap of gap buffer `darr` to the end, so that its elements are
+ *  contiguous and `darr` may again be indexed directly and used with the rest
+ *  of the library. Does nothing if DA_FLAG_GAP is not set.
+ *
+ * @param darr : Target darray.
+ *
+ * @note `da_gap_materialize` never allocates memory.
+ */
+static inline void da_gap_materialize(void* darr);
+
+/**@macro
+ * @brief Set every element of `darr` to `value`.
+ *
+ * @param darr : const lvalue pointing to the target darray.
+ * @param VALUE_TYPE : type of `value`.
+ * @param value : Value to fill the array with.
+ */
+#define /* void */da_fill(/* void* */darr, VALUE_TYPE, /* VALUE_TYPE */value)  \
+                                               _da_fill(darr, VALUE_TYPE, value)
+
+/**@macro
+ * @brief Set `count` elements of `darr` starting at index `first` to `value`.
+ *
+ * @param darr : const lvalue pointing to the target darray.
+ * @param VALUE_TYPE : type of `value`.
+ * @param value : Value to fill the range with.
+ * @param first : Index of the first element to be set.
+ * @param count : Number of elements to be set.
+ */
+#define /* void */da_fill_range(/* void* */darr, VALUE_TYPE,                   \
+    /* VALUE_TYPE */value, /* size_t */first, /* size_t */count)               \
+                           _da_fill_range(darr, VALUE_TYPE, value, first, count)
+
+/**@function
+ * @brief Change the length of the darray to `nelem`, setting every element
+ *  added beyond the previous length to the value pointed to by `value`.
+ *  Existing elements are not touched.
+ *
+ * @param darr : Target darray. Upon function completion, `darr` may or may not
+ *  point to its previous block on the heap, potentially breaking references.
+ * @param nelem : New length of the darray.
+ * @param value : Pointer to a single element of size `da_sizeof_elem(darr)`.
+ *  `value` must not point into `darr`.
+ * @return Pointer to the new location of the darray upon successful function
+ *  completion. If `da_resize_fill` returns `NULL`, allocation failed and
+ *  `darr` is left untouched.
+ *
+ * @note Affects the length attribute of the darray.
+ */
+static inline void* da_resize_fill(void* darr, size_t nelem,
+    const void* value);
+
+/**@macro
+ * @brief `da_foreach` acts as a loop-block that forward iterates through all
+ *  elements of `darr`. In each iteration a variable with identifier `itername`
+ *  will point to an element of `darr` starting at at its first element.
+ *
+ * @param darr : const lvalue pointing to the target darray.
+ * @param ELEM_TYPE : type of the elements of darr.
+ * @param itername : identifier for the iterator within the foreach block.
+ */
+#define da_foreach(/* void* */darr, ELEM_TYPE, itername)                       \
+                                          _da_foreach(darr, ELEM_TYPE, itername)
+
+/**@macro
+ * @brief `da_foreachr` acts as a loop-block that reverse iterates through all
+ *  elements of `darr`. In each iteration a variable with identifier `itername`
+ *  will point to an element of `darr` starting at its last element.
+ *
+ * @param darr : const lvalue pointing to the target darray.
+ * @param ELEM_TYPE : type of the elements of darr.
+ * @param itername : identifier for the iterator within the foreachr block.
+ */
+#define da_foreachr(/* void* */darr, ELEM_TYPE, itername)                      \
+                                         _da_foreachr(darr, ELEM_TYPE, itername)
+
+/**@macro
+ * @brief `da_foreach_fast` acts like `da_foreach`, but reads the length of
+ *  `darr` once before the loop rather than on every iteration. Stores through
+ *  the iterator may alias the darray header, so `da_foreach` has to reload the
+ *  length after each of them.
+ *
+ * @param darr : const lvalue pointing to the target darray.
+ * @param ELEM_TYPE : type of the elements of darr.
+ * @param itername : identifier for the iterator within the foreach block.
+ *
+ * @note The length of `darr` must not change within the foreach block.
+ */
+#define da_foreach_fast(/* void* */darr, ELEM_TYPE, itername)                  \
+                                     _da_foreach_fast(darr, ELEM_TYPE, itername)
+
+/**@macro
+ * @brief `da_foreach_prefetch` acts like `da_foreach_fast`, but at the start
+ *  of each iteration prefetches the element `distance` elements ahead of
+ *  `itername`. Useful when the elements are large and the loop body is light,
+ *  so the hardware prefetcher cannot keep up.
+ *
+ * @param darr : const lvalue pointing to the target darray.
+ * @param ELEM_TYPE : type of the elements of darr.
+ * @param itername : identifier for the iterator within the foreach block.
+ * @param distance : Number of elements to prefetch ahead.
+ *
+ * @note The length of `darr` must not change within the foreach block.
+ * @note Only the first cache line of the element ahead is prefetched.
+ */
+#define da_foreach_prefetch(/* void* */darr, ELEM_TYPE, itername,              \
+    /* size_t */distance)                                                      \
+                       _da_foreach_prefetch(darr, ELEM_TYPE, itername, distance)
+
+/**@macro
+ * @brief `da_foreach_chunk` acts as a loop-block that forward iterates through
+ *  the elements of `darr` in blocks of `chunk_size` elements. In each
+ *  iteration a variable with identifier `chunkname` will point to the first
+ *  element of a block, and a `size_t` with identifier `countname` will hold
+ *  the number of elements in the block. Every block holds exactly
+ *  `chunk_size` elements except possibly the last, so a body written for
+ *  full blocks can be vectorized by the compiler.
+ *
+ * @param darr : const lvalue pointing to the target darray.
+ * @param ELEM_TYPE : type of the elements of darr.
+ * @param chunkname : identifier for the block pointer within the foreach
+ *  block.
+ * @param countname : identifier for the block length within the foreach block.
+ * @param chunk_size : Number of elements per block. Must not be zero.
+ *
+ * @note The length of `darr` must not change within the foreach block.
+ */
+#define da_foreach_chunk(/* void* */darr, ELEM_TYPE, chunkname, countname,     \
+    /* size_t */chunk_size)                                                    \
+        _da_foreach_chunk(darr, ELEM_TYPE, chunkname, countname, chunk_size)
+
+/**@function
+ * @brief Swap the values of the two specified elements of `darr`.
+ *
+ * @param darr : Target darray.
+ * @param index_a : Index of the first element.
+ * @param index_b : Index of the second element.
+ */
+static inline void da_swap(void* darr, size_t index_a, size_t index_b);
+
+/**@function
+ * @brief Swap the `count` elements of `darr` starting at `index_a` with the
+ *  `count` elements starting at `index_b`.
+ *
+ * @param darr : Target darray.
+ * @param index_a : Index of the first element of the first block.
+ * @param index_b : Index of the first element of the second block.
+ * @param count : Number of elements in each block.
+ *
+ * @note The two blocks must not overlap.
+ */
+static inline void da_swap_range(void* darr, size_t index_a, size_t index_b,
+    size_t count);
+
+/**@function
+ * @brief Sort the elements of `darr` in ascending order according to `cmp`,
+ *  which has the same contract as the comparator passed to `qsort`. The sort
+ *  is an introsort: quicksort with a median of three pivot, falling back to
+ *  heapsort on adversarial input and to insertion sort on short ranges. It is
+ *  not stable.
+ *
+ * @param darr : Target darray.
+ * @param cmp : Comparison function.
+ */
+static inline void da_sort(void* darr, int (*cmp)(const void*, const void*));
+
+/**@function
+ * @brief Sort darrays of integers or floating point numbers in ascending order
+ *  with an LSD radix sort. Runs in linear time and never calls a comparator.
+ *  Passes over bytes in which every element agrees are skipped. Negative zero
+ *  sorts before positive zero, and NaNs sort by bit pattern at the ends.
+ *
+ * @param darr : Target darray.
+ * @param key : How to interpret the elements of `darr`.
+ *
+ * @return 0 on success, -1 if the element size is not supported for `key` or
+ *  allocation of the scratch buffer failed. `darr` is left untouched on
+ *  failure.
+ */
+static inline int da_sort_radix(void* darr, enum da_sort_key key);
+
+/**@function
+ * @brief Find the first element of the sorted darray `darr` that does not
+ *  order before `key`. The search is branchless and prefetches both possible
+ *  next probes, so it is not slowed down by mispredictions or cache misses on
+ *  large darrays.
+ *
+ * @param darr : Target darray, sorted according to `cmp`.
+ * @param key : Pointer to the value searched for.
+ * @param cmp : Comparison function, as passed to `da_sort`.
+ *
+ * @return Index of the first element not less than `key`, or the length of
+ *  the darray if there is none.
+ */
+static inline size_t da_lower_bound(void* darr, const void* key,
+    int (*cmp)(const void*, const void*));
+
+/**@function
+ * @brief Like `da_lower_bound`, but finds the first element that orders after
+ *  `key`.
+ *
+ * @return Index of the first element greater than `key`, or the length of the
+ *  darray if there is none.
+ */
+static inline size_t da_upper_bound(void* darr, const void* key,
+    int (*cmp)(const void*, const void*));
+
+/**@function
+ * @brief Insert a copy of the element pointed to by `value` into the sorted
+ *  darray `darr`, keeping it sorted. The element is placed after any equal
+ *  elements.
+ *
+ * @param darr : Target darray, sorted according to `cmp`. Upon function
+ *  completion, `darr` may or may not point to its previous block on the heap,
+ *  potentially breaking references.
+ * @param value : Pointer to the element to insert.
+ * @param cmp : Comparison function, as passed to `da_sort`.
+ *
+ * @return Pointer to the new location of the darray upon successful function
+ *  completion. If `da_insert_sorted` returns `NULL`, allocation failed and
+ *  `darr` is left untouched.
+ */
+static inline void* da_insert_sorted(void* darr, const void* value,
+    int (*cmp)(const void*, const void*));
+
+/**@function
+ * @brief Remove the first element equal to `key` from the sorted darray
+ *  `darr`, if there is one.
+ *
+ * @param darr : Target darray, sorted according to `cmp`.
+ * @param key : Pointer to the value to remove.
+ * @param cmp : Comparison function, as passed to `da_sort`.
+ *
+ * @return 1 if an element was removed, 0 if `key` was not found, -1 if
+ *  `darr` is shared, in which case it is left untouched.
+ *
+ * @note Never allocates memory. Call `da_unshare` first on a darray that may
+ *  be shared.
+ */
+static inline int da_remove_sorted(void* darr, const void* key,
+    int (*cmp)(const void*, const void*));
+
+/**@function
+ * @brief Insert the `n` sorted elements at `src` into the sorted darray `darr`,
+ *  keeping it sorted. The two are merged from the back, so every element of
+ *  `darr` is moved at most once, rather than once per inserted element.
+ *  Inserted elements are placed after existing elements that compare equal.
+ *
+ * @param darr : Target darray, sorted according to `cmp`. Upon function
+ *  completion, `darr` may or may not point to its previous block on the heap,
+ *  potentially breaking references.
+ * @param src : Sorted elements to insert. Must not point into `darr`.
+ * @param n : Number of elements at `src`.
+ * @param cmp : Comparison function, as passed to `da_sort`.
+ *
+ * @return Pointer to the new location of the darray upon successful function
+ *  completion. If `da_merge_sorted` returns `NULL`, allocation failed and
+ *  `darr` is left untouched.
+ */
+static inline void* da_merge_sorted(void* darr, const void* src, size_t n,
+    int (*cmp)(const void*, const void*));
+
+#ifdef DA_HAVE_THREADS
+/**@function
+ * @brief Sort `darr` like `da_sort`, using `nthreads` threads. Each thread
+ *  sorts one slice of the darray, and the slices are then merged in parallel
+ *  rounds through a scratch buffer. Unlike `da_sort` this is stable.
+ *
+ * @param darr : Target darray.
+ * @param nthreads : Number of threads, including the calling thread. 0 uses
+ *  one thread per online processor.
+ * @param cmp : Comparison function, called concurrently from several threads.
+ *
+ * @return 0 on success, -1 if allocation failed, in which case `darr` is left
+ *  untouched.
+ */
+static inline int da_sort_parallel(void* darr, size_t nthreads,
+    int (*cmp)(const void*, const void*));
+#endif // DA_HAVE_THREADS
+
+/**@macro
+ * @brief Define `void NAME_sort(ELEM_TYPE* darr)`, an introsort specialized
+ *  for `ELEM_TYPE`. The comparison `LESS(a, b)`, evaluating to nonzero if the
+ *  `ELEM_TYPE` lvalue `a` orders before `b`, is expanded inline, as are the
+ *  element moves, so the sort runs without any indirect calls.
+ *
+ * @param ELEM_TYPE : type of the elements of the darrays.
+ * @param NAME : prefix of the generated function.
+ * @param LESS : function-like macro or function comparing two elements.
+ */
+#define DA_DECLARE_SORT(ELEM_TYPE, NAME, LESS)                                 \
+                                         _DA_DECLARE_SORT(ELEM_TYPE, NAME, LESS)
+
+/**@macro
+ * @brief Define a family of functions operating on darrays of `ELEM_TYPE`,
+ *  named with the prefix `NAME`. Because the element size is a compile time
+ *  constant, the compiler can inline and vectorize the element moves that the
+ *  generic API performs with run-time sizes. The generated functions are
+ *  interchangeable with the rest of the API:
+ *
+ *  ELEM_TYPE* NAME_alloc(size_t nelem);
+ *  ELEM_TYPE* NAME_push(ELEM_TYPE* darr, ELEM_TYPE value);
+ *  ELEM_TYPE* NAME_insert(ELEM_TYPE* darr, size_t index, ELEM_TYPE value);
+ *  ELEM_TYPE NAME_pop(ELEM_TYPE** darr);
+ *  ELEM_TYPE NAME_remove(ELEM_TYPE** darr, size_t index);
+ *  ELEM_TYPE NAME_swap_remove(ELEM_TYPE** darr, size_t index);
+ *
+ *  `NAME_push` and `NAME_insert` return the new location of the darray, or
+ *  `NULL` if allocation failed, in which case `darr` is left untouched. The
+ *  removal functions reassign `*darr` if the darray was moved to a smaller
+ *  block by DA_FLAG_AUTO_SHRINK.
+ *
+ * @param ELEM_TYPE : type of the elements of the darrays.
+ * @param NAME : prefix of the generated functions.
+ */
+#define DA_DECLARE_TYPED(ELEM_TYPE, NAME) _DA_DECLARE_TYPED(ELEM_TYPE, NAME)
+
+#ifdef DA_ENABLE_STATS
+// Number of buckets of the push latency histogram of `struct da_stats`.
+#define DA_STATS_LATENCY_BUCKETS 32
+
+/**@struct
+ * @brief Counters recorded for every darray when DA_ENABLE_STATS is defined.
+ *  The record follows the darray through reallocations and is freed along
+ *  with it. DA_ENABLE_STATS changes how darrays are created and freed, so it
+ *  must be defined the same way in every translation unit.
+ */
+struct da_stats
+{
+    size_t elsz;
+    // Number of times the block of the darray was reallocated.
+    size_t reallocs;
+    // Bytes copied because the block moved or its padding changed.
+    size_t bytes_copied;
+    // Bytes shifted by insertions and removals in the middle of the darray.
+    size_t bytes_moved;
+    size_t peak_length;
+    size_t peak_capacity;
+    // `push_latency[i]` counts `da_push` calls that took less than 2^(i+1)
+    // and, for i > 0, at least 2^i nanoseconds.
+    size_t push_latency[DA_STATS_LATENCY_BUCKETS];
+    struct da_stats* prev;
+    struct da_stats* next;
+};
+
+/**@function
+ * @brief Get the counters of `darr`, or `NULL` if they could not be allocated.
+ */
+static inline struct da_stats* da_stats(void* darr);
+
+/**@function
+ * @brief Print the counters in `stats` to `stream` in a human readable form.
+ */
+static inline void da_stats_dump(const struct da_stats* stats, FILE* stream);
+
+/**@function
+ * @brief Call `fn` on the counters of every live darray. Darrays must not be
+ *  allocated or freed by `fn`.
+ *
+ * @note With GCC or clang the registry is shared by every translation unit.
+ *  Other compilers keep one registry per translation unit.
+ */
+static inline void da_stats_foreach(void (*fn)(struct da_stats* stats,
+    void* ctx), void* ctx);
+#endif // DA_ENABLE_STATS
 
 ///////////////////////////////// DEFINITIONS //////////////////////////////////
 #define DA_SIZEOF_ELEM_OFFSET 0
-#define DA_LENGTH_OFFSET   (1*sizeof(size_t))
-#define DA_CAPACITY_OFFSET (2*sizeof(size_t))
-#define DA_HANDLE_OFFSET   (3*sizeof(size_t))
+#define DA_LENGTH_OFFSET    (1*sizeof(size_t))
+#define DA_CAPACITY_OFFSET  (2*sizeof(size_t))
+#define DA_ALIGNMENT_OFFSET (3*sizeof(size_t))
+#define DA_PADDING_OFFSET   (4*sizeof(size_t))
+#define DA_GROWTH_OFFSET    (5*sizeof(size_t))
+#define DA_ALLOCATOR_OFFSET (6*sizeof(size_t))
+#define DA_FLAGS_OFFSET     (7*sizeof(size_t))
+#define DA_GAP_OFFSET       (8*sizeof(size_t))
+#define DA_FRONT_OFFSET     (9*sizeof(size_t))
+#define DA_REFCOUNT_OFFSET  (10*sizeof(size_t))
+// Without DA_ENABLE_STATS the stats slot is unused, keeping the header a
+// multiple of 16 bytes so default darrays need no padding.
+#ifdef DA_ENABLE_STATS
+#   define DA_STATS_OFFSET  (11*sizeof(size_t))
+#endif
+#define DA_HANDLE_OFFSET    (12*sizeof(size_t))
+
+// The handle of a darray used with `da_push_front` moves one element at a time.
+// By default front slack is only used for element sizes that are a multiple of
+// sizeof(size_t), which keeps every handle word aligned. DA_ENABLE_FRONT_SLACK
+// extends it to every element size, and the handle is then rounded down to
+// keep the header aligned.
+#ifdef DA_ENABLE_FRONT_SLACK
+#   define DA_HEAD_FROM_HANDLE(darr_h) \
+    (((char*)((uintptr_t)(darr_h) & ~(uintptr_t)(sizeof(size_t)-1))) \
+        - DA_HANDLE_OFFSET)
+#else
+#   define DA_HEAD_FROM_HANDLE(darr_h) (((char*)(darr_h)) - DA_HANDLE_OFFSET)
+#endif
+#define DA_P_SIZEOF_ELEM_FROM_HANDLE(darr_h) \
+    ((size_t*)(DA_HEAD_FROM_HANDLE(darr_h) + DA_SIZEOF_ELEM_OFFSET))
+#define DA_P_LENGTH_FROM_HANDLE(darr_h) \
+    ((size_t*)(DA_HEAD_FROM_HANDLE(darr_h) + DA_LENGTH_OFFSET))
+#define DA_P_CAPACITY_FROM_HANDLE(darr_h) \
+    ((size_t*)(DA_HEAD_FROM_HANDLE(darr_h) + DA_CAPACITY_OFFSET))
+#define DA_P_ALIGNMENT_FROM_HANDLE(darr_h) \
+    ((size_t*)(DA_HEAD_FROM_HANDLE(darr_h) + DA_ALIGNMENT_OFFSET))
+#define DA_P_PADDING_FROM_HANDLE(darr_h) \
+    ((size_t*)(DA_HEAD_FROM_HANDLE(darr_h) + DA_PADDING_OFFSET))
+#define DA_P_GROWTH_FROM_HANDLE(darr_h) \
+    ((const struct da_growth**)(DA_HEAD_FROM_HANDLE(darr_h) + DA_GROWTH_OFFSET))
+#define DA_P_ALLOCATOR_FROM_HANDLE(darr_h) \
+    ((const struct da_allocator**) \
+        (DA_HEAD_FROM_HANDLE(darr_h) + DA_ALLOCATOR_OFFSET))
+#define DA_P_FLAGS_FROM_HANDLE(darr_h) \
+    ((size_t*)(DA_HEAD_FROM_HANDLE(darr_h) + DA_FLAGS_OFFSET))
+#define DA_P_GAP_FROM_HANDLE(darr_h) \
+    ((size_t*)(DA_HEAD_FROM_HANDLE(darr_h) + DA_GAP_OFFSET))
+#define DA_P_FRONT_FROM_HANDLE(darr_h) \
+    ((size_t*)(DA_HEAD_FROM_HANDLE(darr_h) + DA_FRONT_OFFSET))
+#define DA_P_REFCOUNT_FROM_HANDLE(darr_h) \
+    ((size_t*)(DA_HEAD_FROM_HANDLE(darr_h) + DA_REFCOUNT_OFFSET))
+#ifdef DA_ENABLE_STATS
+#   define DA_P_STATS_FROM_HANDLE(darr_h) \
+        ((struct da_stats**)(DA_HEAD_FROM_HANDLE(darr_h) + DA_STATS_OFFSET))
+#endif
+#define DA_BLOCK_FROM_HANDLE(darr_h) \
+    (DA_HEAD_FROM_HANDLE(darr_h) - *DA_P_PADDING_FROM_HANDLE(darr_h))
+
+// Convert the void* returned by a reallocating function back to the type of
+// the handle `darr`, since C++ won't do it implicitly.
+#ifdef __cplusplus
+#   define DA_HANDLE_CAST(darr, ptr) \
+        (static_cast<std::remove_reference<decltype(darr)>::type>(ptr))
+#else
+#   define DA_HANDLE_CAST(darr, ptr) (ptr)
+#endif
+
+// Alignment guaranteed by malloc/realloc for every block they return.
+#ifdef __cplusplus
+#   define DA_MALLOC_ALIGNMENT (alignof(max_align_t))
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#   define DA_MALLOC_ALIGNMENT (_Alignof(max_align_t))
+#else
+    // C99 has no max_align_t. Two words is what common mallocs guarantee.
+#   define DA_MALLOC_ALIGNMENT (2*sizeof(size_t))
+#endif
+// Alignment of darrays allocated with `da_alloc`.
+#define DA_ALIGNMENT_DEFAULT DA_MALLOC_ALIGNMENT
+
+// Hint that the memory at `addr` is about to be read.
+#if defined(__GNUC__) || defined(__clang__)
+#   define DA_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#   define DA_PREFETCH(addr) ((void)(addr))
+#endif
+
+#ifdef DA_HAVE_ATOMICS
+// Back off while waiting for another thread. Waits are normally a handful of
+// cycles, but the thread being waited on may have been preempted, so after a
+// while the processor is handed over instead of spinning out the time slice.
+static inline void _da_spin(unsigned* spins)
+{
+    if (++*spins < 64)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+        return;
+    }
+#if defined(__unix__) || defined(__APPLE__)
+    sched_yield();
+#endif
+}
+#endif // DA_HAVE_ATOMICS
+
+#define DA_CAPACITY_FACTOR 1.3
+#define DA_CAPACITY_MIN 10
+#define DA_NEW_CAPACITY_FROM_LENGTH(length) \
+    (length < DA_CAPACITY_MIN ? DA_CAPACITY_MIN : (length*DA_CAPACITY_FACTOR))
+
+// Capacity that a darray with growth policy `growth` should have in order to
+// hold at least `nelem` elements.
+static inline size_t _da_new_capacity(const struct da_growth* growth,
+    size_t nelem)
+{
+    size_t capacity;
+    if (growth == NULL)
+    {
+        capacity = DA_NEW_CAPACITY_FROM_LENGTH(nelem);
+        return capacity < nelem ? nelem : capacity;
+    }
+    switch (growth->kind)
+    {
+    case DA_GROWTH_GEOMETRIC:
+        capacity = (size_t)(nelem*growth->factor);
+        break;
+    case DA_GROWTH_INCREMENT:
+        capacity = growth->increment == 0 ? nelem :
+            ((nelem + growth->increment - 1)/growth->increment)
+                * growth->increment;
+        break;
+    case DA_GROWTH_POW2:
+        capacity = 1;
+        while (capacity < nelem && capacity != 0)
+        {
+            capacity <<= 1;
+        }
+        break;
+    case DA_GROWTH_CALLBACK:
+        capacity = growth->callback(nelem, growth->ctx);
+        break;
+    default:
+        capacity = nelem;
+        break;
+    }
+    if (capacity < growth->min)
+    {
+        capacity = growth->min;
+    }
+    // Guard against policies that shrink or overflow.
+    return capacity < nelem ? nelem : capacity;
+}
+
+#ifdef DA_ENABLE_STATS
+// Registry of the counters of every live darray.
+#if defined(__GNUC__) || defined(__clang__)
+// Weak so that every translation unit links to the same registry.
+__attribute__((weak)) struct da_stats* _da_stats_list = NULL;
+__attribute__((weak)) int _da_stats_list_lock = 0;
+#else
+static struct da_stats* _da_stats_list = NULL;
+static int _da_stats_list_lock = 0;
+#endif
+
+static inline void _da_stats_lock(void)
+{
+#ifdef DA_HAVE_ATOMICS
+    unsigned spins = 0;
+    while (__atomic_exchange_n(&_da_stats_list_lock, 1, __ATOMIC_ACQUIRE))
+    {
+        _da_spin(&spins);
+    }
+#endif
+}
+
+static inline void _da_stats_unlock(void)
+{
+#ifdef DA_HAVE_ATOMICS
+    __atomic_store_n(&_da_stats_list_lock, 0, __ATOMIC_RELEASE);
+#endif
+}
+
+static inline uint64_t _da_stats_now(void)
+{
+#if defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000u + (uint64_t)ts.tv_nsec;
+#else
+    return (uint64_t)clock()*(1000000000u/CLOCKS_PER_SEC);
+#endif
+}
+
+static inline void _da_stats_init(void* darr)
+{
+    struct da_stats* stats = (struct da_stats*)calloc(1, sizeof(*stats));
+    *DA_P_STATS_FROM_HANDLE(darr) = stats;
+    if (stats == NULL)
+    {
+        return;
+    }
+    stats->elsz = *DA_P_SIZEOF_ELEM_FROM_HANDLE(darr);
+    stats->peak_length = *DA_P_LENGTH_FROM_HANDLE(darr);
+    stats->peak_capacity = *DA_P_CAPACITY_FROM_HANDLE(darr);
+    _da_stats_lock();
+    stats->next = _da_stats_list;
+    if (_da_stats_list != NULL)
+    {
+        _da_stats_list->prev = stats;
+    }
+    _da_stats_list = stats;
+    _da_stats_unlock();
+}
+
+static inline void _da_stats_free(void* darr)
+{
+    struct da_stats* stats = *DA_P_STATS_FROM_HANDLE(darr);
+    if (stats == NULL)
+    {
+        return;
+    }
+    _da_stats_lock();
+    if (stats->prev != NULL)
+    {
+        stats->prev->next = stats->next;
+    }
+    else
+    {
+        _da_stats_list = stats->next;
+    }
+    if (stats->next != NULL)
+    {
+        stats->next->prev = stats->prev;
+    }
+    _da_stats_unlock();
+    free(stats);
+}
+
+static inline void _da_stats_realloc(void* darr, size_t copied)
+{
+    struct da_stats* stats = *DA_P_STATS_FROM_HANDLE(darr);
+    if (stats != NULL)
+    {
+        size_t capacity = *DA_P_CAPACITY_FROM_HANDLE(darr);
+        stats->reallocs += 1;
+        stats->bytes_copied += copied;
+        if (capacity > stats->peak_capacity)
+        {
+            stats->peak_capacity = capacity;
+        }
+    }
+}
+
+static inline void _da_stats_moved(void* darr, size_t bytes)
+{
+    struct da_stats* stats = *DA_P_STATS_FROM_HANDLE(darr);
+    if (stats != NULL)
+    {
+        stats->bytes_moved += bytes;
+    }
+}
+
+static inline void _da_stats_length(void* darr)
+{
+    struct da_stats* stats = *DA_P_STATS_FROM_HANDLE(darr);
+    size_t length = *DA_P_LENGTH_FROM_HANDLE(darr);
+    if (stats != NULL && length > stats->peak_length)
+    {
+        stats->peak_length = length;
+    }
+}
+
+static inline void _da_stats_push(void* darr, uint64_t start)
+{
+    uint64_t elapsed = _da_stats_now() - start;
+    struct da_stats* stats = *DA_P_STATS_FROM_HANDLE(darr);
+    _da_stats_length(darr);
+    if (stats == NULL)
+    {
+        return;
+    }
+    size_t bucket = 0;
+    while ((elapsed >>= 1) != 0 && bucket + 1 < DA_STATS_LATENCY_BUCKETS)
+    {
+        bucket += 1;
+    }
+    stats->push_latency[bucket] += 1;
+}
+
+static inline struct da_stats* da_stats(void* darr)
+{
+    return *DA_P_STATS_FROM_HANDLE(darr);
+}
+
+static inline void da_stats_dump(const struct da_stats* stats, FILE* stream)
+{
+    fprintf(stream, "darray stats %p: elsz=%zu reallocs=%zu bytes_copied=%zu "
+        "bytes_moved=%zu peak_length=%zu peak_capacity=%zu\n",
+        (const void*)stats, stats->elsz, stats->reallocs, stats->bytes_copied,
+        stats->bytes_moved, stats->peak_length, stats->peak_capacity);
+    fprintf(stream, "  push latency (ns):");
+    for (size_t i = 0; i < DA_STATS_LATENCY_BUCKETS; ++i)
+    {
+        if (stats->push_latency[i] != 0)
+        {
+            fprintf(stream, " <%llu:%zu", 2ull << i, stats->push_latency[i]);
+        }
+    }
+    fprintf(stream, "\n");
+}
+
+static inline void da_stats_foreach(void (*fn)(struct da_stats* stats,
+    void* ctx), void* ctx)
+{
+    _da_stats_lock();
+    for (struct da_stats* stats = _da_stats_list; stats != NULL;
+        stats = stats->next)
+    {
+        fn(stats, ctx);
+    }
+    _da_stats_unlock();
+}
+
+#   define _DA_STATS_INIT(darr) _da_stats_init(darr)
+#   define _DA_STATS_FREE(darr) _da_stats_free(darr)
+#   define _DA_STATS_REALLOC(darr, copied) _da_stats_realloc(darr, copied)
+#   define _DA_STATS_MOVED(darr, bytes) _da_stats_moved(darr, bytes)
+#   define _DA_STATS_LENGTH(darr) _da_stats_length(darr)
+#   define _DA_STATS_CLOCK(name) uint64_t name = _da_stats_now()
+#   define _DA_STATS_PUSH(darr, start) _da_stats_push(darr, start)
+#else
+// Without DA_ENABLE_STATS the hooks expand to nothing and their arguments are
+// never evaluated.
+#   define _DA_STATS_INIT(darr) ((void)0)
+#   define _DA_STATS_FREE(darr) ((void)0)
+#   define _DA_STATS_REALLOC(darr, copied) ((void)0)
+#   define _DA_STATS_MOVED(darr, bytes) ((void)0)
+#   define _DA_STATS_LENGTH(darr) ((void)0)
+#   define _DA_STATS_CLOCK(name) ((void)0)
+#   define _DA_STATS_PUSH(darr, start) ((void)0)
+#endif // DA_ENABLE_STATS
+
+// Swap `n` bytes through a fixed size buffer. With a constant `n` the memcpys
+// are lowered to plain (vector) loads and stores.
+#define _DA_SWAP_CHUNK(/* char* */a, /* char* */b, /* size_t */n)             \
+do                                                                             \
+{                                                                              \
+    unsigned char __tmp[n];                                                    \
+    memcpy(__tmp, (a), (n));                                                   \
+    memcpy((a), (b), (n));                                                     \
+    memcpy((b), __tmp, (n));                                                   \
+}while(0)
+
+#define DA_SWAP_CHUNK_SIZE 32
+
+static inline void _da_memswap(void* p1, void* p2, size_t sz)
+{
+    char* a = (char*)p1;
+    char* b = (char*)p2;
+    if (a == b)
+    {
+        return;
+    }
+    // Fast paths for the most common element sizes.
+    switch (sz)
+    {
+    case 4:  _DA_SWAP_CHUNK(a, b, 4);  return;
+    case 8:  _DA_SWAP_CHUNK(a, b, 8);  return;
+    case 16: _DA_SWAP_CHUNK(a, b, 16); return;
+    case 32: _DA_SWAP_CHUNK(a, b, 32); return;
+    }
+    // Everything else is swapped in large chunks followed by the remainder.
+    for (; sz >= DA_SWAP_CHUNK_SIZE; sz -= DA_SWAP_CHUNK_SIZE)
+    {
+        _DA_SWAP_CHUNK(a, b, DA_SWAP_CHUNK_SIZE);
+        a += DA_SWAP_CHUNK_SIZE;
+        b += DA_SWAP_CHUNK_SIZE;
+    }
+    if (sz >= 16)
+    {
+        _DA_SWAP_CHUNK(a, b, 16);
+        a += 16; b += 16; sz -= 16;
+    }
+    if (sz >= 8)
+    {
+        _DA_SWAP_CHUNK(a, b, 8);
+        a += 8; b += 8; sz -= 8;
+    }
+    if (sz >= 4)
+    {
+        _DA_SWAP_CHUNK(a, b, 4);
+        a += 4; b += 4; sz -= 4;
+    }
+    for (size_t i = 0; i < sz; ++i)
+    {
+        char tmp = a[i];
+        a[i] = b[i];
+        b[i] = tmp;
+    }
+}
+
+// Size of the stack buffer holding repeated copies of the fill pattern.
+#define DA_FILL_BUFFER_SIZE 512
+
+// Set `count` elements of size `elsz` starting at `dst` to the element pointed
+// to by `value`. `value` must not point into the destination range.
+static inline void _da_fill_bytes(void* dst, const void* value, size_t elsz,
+    size_t count)
+{
+    const unsigned char* v = (const unsigned char*)value;
+    unsigned char* d = (unsigned char*)dst;
+    size_t i = 1;
+    // Values made of a single repeated byte (0, -1, etc.) go to memset.
+    while (i < elsz && v[i] == v[0])
+    {
+        ++i;
+    }
+    if (i >= elsz)
+    {
+        memset(d, v[0], elsz*count);
+        return;
+    }
+    if (elsz > DA_FILL_BUFFER_SIZE/2)
+    {
+        for (i = 0; i < count; ++i, d += elsz)
+        {
+            memcpy(d, v, elsz);
+        }
+        return;
+    }
+    // Everything else is broadcast into a buffer of whole elements that is
+    // written out with large memcpys. The buffer stays in L1 so the only
+    // memory traffic is the stores to the darray.
+    unsigned char buf[DA_FILL_BUFFER_SIZE];
+    size_t per_buf = DA_FILL_BUFFER_SIZE / elsz;
+    size_t nbuf = per_buf < count ? per_buf : count;
+    for (i = 0; i < nbuf; ++i)
+    {
+        memcpy(buf + i*elsz, v, elsz);
+    }
+    for (; count >= per_buf; count -= per_buf, d += per_buf*elsz)
+    {
+        memcpy(d, buf, per_buf*elsz);
+    }
+    memcpy(d, buf, count*elsz);
+}
+
+// Elements up to this size are moved through a buffer on the stack by
+// `da_remove`. Larger elements are moved without a buffer.
+#define DA_REMOVE_BUFFER_SIZE 256
+
+// Performes the following transform without touching the heap:
+// [0][1][2][3][rest...] => [0][2][3][1][rest...]
+//     ^                              ^
+//     target index                   target moved to back
+static inline void _da_remove_mem_mov(void* darr, size_t target_index)
+{
+    size_t length = da_length(darr);
+    size_t elsz = da_sizeof_elem(darr);
+    char* p_target = (char*)darr + target_index*elsz;
+    char* p_last = (char*)darr + (length-1)*elsz;
+    size_t tail = p_last - p_target;
+    _DA_STATS_MOVED(darr, tail);
+
+    // Small elements are parked in a stack buffer while the tail moves up.
+    if (elsz <= DA_REMOVE_BUFFER_SIZE)
+    {
+        char buf[DA_REMOVE_BUFFER_SIZE];
+        memcpy(buf, p_target, elsz);
+        memmove(p_target, p_target + elsz, tail);
+        memcpy(p_last, buf, elsz);
+    }
+    // Large elements are parked in the first unused slot of the darray, which
+    // then moves up along with the tail.
+    // [0][1][2][3][ ] => [0][1][2][3][1] => [0][2][3][1][ ]
+    else if (length < da_capacity(darr))
+    {
+        memcpy(p_last + elsz, p_target, elsz);
+        memmove(p_target, p_target + elsz, tail + elsz);
+    }
+    // A full darray of large elements is rotated one buffer-sized slice of
+    // the elements at a time.
+    else
+    {
+        char buf[DA_REMOVE_BUFFER_SIZE];
+        for (size_t offset = 0; offset < elsz; offset += sizeof(buf))
+        {
+            size_t slice = elsz - offset < sizeof(buf)
+                ? elsz - offset : sizeof(buf);
+            memcpy(buf, p_target + offset, slice);
+            for (char* p = p_target; p < p_last; p += elsz)
+            {
+                memcpy(p + offset, p + elsz + offset, slice);
+            }
+            memcpy(p_last + offset, buf, slice);
+        }
+    }
+}
+
+static inline int _da_is_pow2(size_t n)
+{
+    return n != 0 && (n & (n - 1)) == 0;
+}
+
+// Number of bytes that must sit in front of the header of a darray stored in
+// `block` for its handle to land on an `align` byte boundary.
+static inline size_t _da_padding(void* block, size_t align)
+{
+    uintptr_t handle = (uintptr_t)block + DA_HANDLE_OFFSET;
+    return (align - (handle & (align - 1))) & (align - 1);
+}
+
+// Size of the block required to hold a darray of `capacity` elements of size
+// `elsz` with the handle aligned to `align` bytes. Blocks returned by malloc
+// are already aligned to DA_MALLOC_ALIGNMENT, so for small alignments the
+// padding is known ahead of time. Larger alignments reserve enough slack for
+// the worst case.
+static inline size_t _da_block_size(size_t capacity, size_t elsz, size_t align)
+{
+    size_t slack = align <= DA_MALLOC_ALIGNMENT
+        ? _da_padding(NULL, align) : align - 1;
+    return slack + DA_HANDLE_OFFSET + capacity*elsz;
+}
+
+static inline void* _da_mem_alloc(const struct da_allocator* allocator,
+    size_t size)
+{
+    return allocator == NULL
+        ? malloc(size) : allocator->alloc(allocator->ctx, size);
+}
+
+static inline void* _da_mem_realloc(const struct da_allocator* allocator,
+    void* ptr, size_t old_size, size_t new_size)
+{
+    return allocator == NULL ? realloc(ptr, new_size)
+        : allocator->realloc(allocator->ctx, ptr, old_size, new_size);
+}
+
+static inline void _da_mem_free(const struct da_allocator* allocator,
+    void* ptr, size_t size)
+{
+    if (allocator == NULL)
+    {
+        free(ptr);
+    }
+    else
+    {
+        allocator->free(allocator->ctx, ptr, size);
+    }
+}
+
+// References are taken with a relaxed increment since the caller already holds
+// one. Releasing a reference orders every access made through it before the
+// block is freed or written by the last holder.
+#ifdef DA_HAVE_ATOMICS
+#   define _DA_REF_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#   define _DA_REF_TAKE(p) ((void)__atomic_fetch_add((p), 1, __ATOMIC_RELAXED))
+#   define _DA_REF_RELEASE(p) __atomic_sub_fetch((p), 1, __ATOMIC_ACQ_REL)
+#else
+#   define _DA_REF_LOAD(p) (*(p))
+#   define _DA_REF_TAKE(p) ((void)++*(p))
+#   define _DA_REF_RELEASE(p) (--*(p))
+#endif
+
+// The fast paths of the library only test DA_FLAG_SHARED, which is written
+// solely by a thread holding the only reference, so it is read without
+// atomics. The reference count itself is only loaded once the flag is set.
+static inline int _da_is_shared(void* darr)
+{
+    size_t* p_flags = DA_P_FLAGS_FROM_HANDLE(darr);
+    if (!(*p_flags & DA_FLAG_SHARED))
+    {
+        return 0;
+    }
+    if (_DA_REF_LOAD(DA_P_REFCOUNT_FROM_HANDLE(darr)) != 1)
+    {
+        return 1;
+    }
+    *p_flags &= ~DA_FLAG_SHARED;
+    return 0;
+}
+
+static inline void* _da_cow(void* darr, size_t capacity);
+
+// Move the header and the first `keep` elements of `darr` within its block so
+// that `front` free slots precede the first element. `front + keep` may not
+// exceed the number of slots of the block.
+static inline void* _da_front_move(void* darr, size_t front, size_t keep)
+{
+    size_t elsz = da_sizeof_elem(darr);
+    char* block = DA_BLOCK_FROM_HANDLE(darr);
+    size_t header[DA_HANDLE_OFFSET/sizeof(size_t)];
+    memcpy(header, DA_HEAD_FROM_HANDLE(darr), DA_HANDLE_OFFSET);
+    char* handle = block + DA_HANDLE_OFFSET + front*elsz
+        + _da_padding(block, header[DA_ALIGNMENT_OFFSET/sizeof(size_t)]);
+    memmove(handle, darr, keep*elsz);
+    header[DA_CAPACITY_OFFSET/sizeof(size_t)] +=
+        header[DA_FRONT_OFFSET/sizeof(size_t)];
+    header[DA_CAPACITY_OFFSET/sizeof(size_t)] -= front;
+    header[DA_FRONT_OFFSET/sizeof(size_t)] = front;
+    header[DA_PADDING_OFFSET/sizeof(size_t)] =
+        (size_t)(DA_HEAD_FROM_HANDLE(handle) - block);
+    memcpy(DA_HEAD_FROM_HANDLE(handle), header, DA_HANDLE_OFFSET);
+    _DA_STATS_MOVED(handle, keep*elsz);
+    return handle;
+}
+
+// Reallocate the block backing `darr` to hold `new_capacity` elements while
+// preserving the alignment of the handle. The header and the first `keep`
+// elements are moved if realloc places the block at an address with a
+// different padding requirement.
+static inline void* _da_realloc(void* darr, size_t new_capacity, size_t keep)
+{
+    // Front slack is given up first, and restored if reallocation fails since
+    // `darr` must then be left as it was.
+    size_t front = *DA_P_FRONT_FROM_HANDLE(darr);
+    if (front != 0)
+    {
+        darr = _da_front_move(darr, 0, da_length(darr));
+    }
+    size_t elsz = da_sizeof_elem(darr);
+    size_t align = da_alignment(darr);
+    size_t old_padding = *DA_P_PADDING_FROM_HANDLE(darr);
+    size_t old_size = _da_block_size(da_capacity(darr), elsz, align);
+    size_t new_size = _da_block_size(new_capacity, elsz, align);
+    char* old_block = DA_BLOCK_FROM_HANDLE(darr);
+    char* block = (char*)_da_mem_realloc(*DA_P_ALLOCATOR_FROM_HANDLE(darr),
+        old_block, old_size, new_size);
+    if (block == NULL)
+    {
+        if (front != 0)
+        {
+            _da_front_move(darr, front, da_length(darr));
+        }
+        return NULL;
+    }
+    size_t new_padding = _da_padding(block, align);
+    if (new_padding != old_padding)
+    {
+        memmove(block + new_padding, block + old_padding,
+            DA_HANDLE_OFFSET + keep*elsz);
+    }
+    darr = block + new_padding + DA_HANDLE_OFFSET;
+    *DA_P_PADDING_FROM_HANDLE(darr)  = new_padding;
+    *DA_P_CAPACITY_FROM_HANDLE(darr) = new_capacity;
+    _DA_STATS_REALLOC(darr,
+        (block != old_block ? (old_size < new_size ? old_size : new_size) : 0)
+        + (new_padding != old_padding ? DA_HANDLE_OFFSET + keep*elsz : 0));
+    return darr;
+}
+
+// Grow `darr` so that it can hold at least `min_capacity` elements according to
+// its growth policy. The length of the darray is left unchanged.
+static inline void* _da_grow(void* darr, size_t min_capacity)
+{
+    size_t new_capacity =
+        _da_new_capacity(*DA_P_GROWTH_FROM_HANDLE(darr), min_capacity);
+    // A shared darray is copied into a block of its own, which is given the
+    // new capacity right away.
+    if (_da_is_shared(darr))
+    {
+        return _da_cow(darr, new_capacity);
+    }
+    // A darray drained with `da_pop_front` may have room enough in front.
+    size_t front = *DA_P_FRONT_FROM_HANDLE(darr);
+    if (front != 0 && da_capacity(darr) + front >= new_capacity)
+    {
+        return _da_front_move(darr, 0, da_length(darr));
+    }
+    return _da_realloc(darr, new_capacity, da_length(darr));
+}
+
+static inline void* _da_alloc_capacity(size_t nelem, size_t capacity,
+    size_t size, const struct da_attr* attr);
+
+static inline void* da_alloc(size_t nelem, size_t size)
+{
+    return da_alloc_attr(nelem, size, NULL);
+}
+
+static inline void* da_alloc_aligned(size_t nelem, size_t size, size_t align)
+{
+    struct da_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.align = align;
+    return _da_is_pow2(align) ? da_alloc_attr(nelem, size, &attr) : NULL;
+}
+
+static inline void* da_alloc_attr(size_t nelem, size_t size,
+    const struct da_attr* attr)
+{
+    return _da_alloc_capacity(nelem,
+        _da_new_capacity(attr == NULL ? NULL : attr->growth, nelem), size, attr);
+}
+
+// Allocate a darray of `nelem` elements with room for exactly `capacity`.
+static inline void* _da_alloc_capacity(size_t nelem, size_t capacity,
+    size_t size, const struct da_attr* attr)
+{
+    size_t align = DA_ALIGNMENT_DEFAULT;
+    const struct da_growth* growth = NULL;
+    const struct da_allocator* allocator = NULL;
+    size_t flags = 0;
+    if (attr != NULL)
+    {
+        align = attr->align == 0 ? DA_ALIGNMENT_DEFAULT : attr->align;
+        growth = attr->growth;
+        allocator = attr->allocator;
+        flags = attr->flags & ~(DA_FLAG_GAP | DA_FLAG_SHARED);
+    }
+    if (!_da_is_pow2(align))
+    {
+        return NULL;
+    }
+    char* block = (char*)_da_mem_alloc(allocator,
+        _da_block_size(capacity, size, align));
+    if (block == NULL)
+    {
+        return NULL;
+    }
+    size_t padding = _da_padding(block, align);
+    void* darr = block + padding + DA_HANDLE_OFFSET;
+    *DA_P_SIZEOF_ELEM_FROM_HANDLE(darr) = size;
+    *DA_P_LENGTH_FROM_HANDLE(darr)      = nelem;
+    *DA_P_CAPACITY_FROM_HANDLE(darr)    = capacity;
+    *DA_P_ALIGNMENT_FROM_HANDLE(darr)   = align;
+    *DA_P_PADDING_FROM_HANDLE(darr)     = padding;
+    *DA_P_GROWTH_FROM_HANDLE(darr)      = growth;
+    *DA_P_ALLOCATOR_FROM_HANDLE(darr)   = allocator;
+    *DA_P_FLAGS_FROM_HANDLE(darr)       = flags;
+    *DA_P_GAP_FROM_HANDLE(darr)         = nelem;
+    *DA_P_FRONT_FROM_HANDLE(darr)       = 0;
+    *DA_P_REFCOUNT_FROM_HANDLE(darr)    = 1;
+    _DA_STATS_INIT(darr);
+    return darr;
+}
+
+static inline void da_free(void* darr)
+{
+    size_t* p_refcount = DA_P_REFCOUNT_FROM_HANDLE(darr);
+    if (_DA_REF_LOAD(p_refcount) != 1 && _DA_REF_RELEASE(p_refcount) != 0)
+    {
+        return;
+    }
+    _DA_STATS_FREE(darr);
+    _da_mem_free(*DA_P_ALLOCATOR_FROM_HANDLE(darr), DA_BLOCK_FROM_HANDLE(darr),
+        _da_block_size(da_capacity(darr) + *DA_P_FRONT_FROM_HANDLE(darr),
+            da_sizeof_elem(darr), da_alignment(darr)));
+}
+
+static inline size_t da_length(void* darr)
+{
+    return *DA_P_LENGTH_FROM_HANDLE(darr);
+}
+
+static inline size_t da_capacity(void* darr)
+{
+    return *DA_P_CAPACITY_FROM_HANDLE(darr);
+}
+
+static inline size_t da_sizeof_elem(void* darr)
+{
+    return *DA_P_SIZEOF_ELEM_FROM_HANDLE(darr);
+}
+
+static inline size_t da_alignment(void* darr)
+{
+    return *DA_P_ALIGNMENT_FROM_HANDLE(darr);
+}
+
+static inline size_t da_flags(void* darr)
+{
+    return *DA_P_FLAGS_FROM_HANDLE(darr);
+}
+
+static inline void da_set_growth(void* darr, const struct da_growth* growth)
+{
+    *DA_P_GROWTH_FROM_HANDLE(darr) = growth;
+}
+
+static inline void* da_share(void* darr)
+{
+    _DA_REF_TAKE(DA_P_REFCOUNT_FROM_HANDLE(darr));
+    // Once shared the flag stays set until the last holder clears it, so it is
+    // only ever written by the one thread that held the darray alone.
+    size_t* p_flags = DA_P_FLAGS_FROM_HANDLE(darr);
+    if (!(*p_flags & DA_FLAG_SHARED))
+    {
+        *p_flags |= DA_FLAG_SHARED;
+    }
+    return darr;
+}
+
+// Copy a shared darray into a block of its own with room for `capacity`
+// elements and release the reference to the shared block. Allocators that can
+// only reallocate the block they came with (inline storage, mapped files) are
+// replaced by the default allocator for the copy.
+static inline void* _da_cow(void* darr, size_t capacity)
+{
+    size_t length = da_length(darr);
+    size_t elsz = da_sizeof_elem(darr);
+    const struct da_allocator* allocator = *DA_P_ALLOCATOR_FROM_HANDLE(darr);
+    struct da_attr attr;
+    attr.align = da_alignment(darr);
+    attr.growth = *DA_P_GROWTH_FROM_HANDLE(darr);
+    attr.allocator =
+        allocator != NULL && allocator->alloc == NULL ? NULL : allocator;
+    attr.flags = da_flags(darr);
+    void* copy = _da_alloc_capacity(length,
+        capacity < length ? length : capacity, elsz, &attr);
+    if (copy == NULL)
+    {
+        return NULL;
+    }
+    memcpy(copy, darr, length*elsz);
+    _DA_STATS_REALLOC(copy, length*elsz);
+    da_free(darr);
+    return copy;
+}
+
+static inline void* da_unshare(void* darr)
+{
+    return _da_is_shared(darr) ? _da_cow(darr, da_capacity(darr)) : darr;
+}
+
+static inline size_t da_refcount(void* darr)
+{
+    return _DA_REF_LOAD(DA_P_REFCOUNT_FROM_HANDLE(darr));
+}
+
+// True if an auto shrinking darray with `capacity` has become sparse enough at
+// `length` elements to be moved to a smaller block.
+static inline int _da_should_shrink(void* darr, size_t length, size_t capacity)
+{
+    return (da_flags(darr) & DA_FLAG_AUTO_SHRINK)
+        && length < capacity/4 && capacity > DA_CAPACITY_MIN;
+}
+
+// Called right before an element of `darr` is popped/removed. Halves the
+// capacity of an auto shrinking darray once its length is about to drop below
+// a quarter of its capacity. Every current element is preserved so that the
+// value being removed can still be returned. A failed shrink is harmless, so
+// the original darray is returned on failure. A shared darray is copied
+// instead. If the copy fails the original darray is returned still shared, and
+// callers must then leave its elements alone.
+static inline void* _da_auto_shrink(void* darr)
+{
+    size_t length = da_length(darr);
+    size_t capacity = da_capacity(darr);
+    if (_da_is_shared(darr))
+    {
+        void* copy = _da_cow(darr,
+            _da_should_shrink(darr, length-1, capacity) ? capacity/2 : capacity);
+        return copy == NULL ? darr : copy;
+    }
+    if (!_da_should_shrink(darr, length-1, capacity))
+    {
+        return darr;
+    }
+    void* ptr = _da_realloc(darr, capacity/2, length);
+    return ptr == NULL ? darr : ptr;
+}
+
+static inline void* da_resize(void* darr, size_t nelem)
+{
+    if (_da_is_shared(darr))
+    {
+        darr = _da_cow(darr,
+            _da_new_capacity(*DA_P_GROWTH_FROM_HANDLE(darr), nelem));
+        if (darr == NULL)
+        {
+            return NULL;
+        }
+    }
+    size_t length = da_length(darr);
+    size_t capacity = da_capacity(darr);
+    if (nelem > capacity || _da_should_shrink(darr, nelem, capacity))
+    {
+        size_t new_capacity =
+            _da_new_capacity(*DA_P_GROWTH_FROM_HANDLE(darr), nelem);
+        darr = _da_realloc(darr, new_capacity,
+            length < new_capacity ? length : new_capacity);
+        if (darr == NULL)
+        {
+            return NULL;
+        }
+    }
+    *DA_P_LENGTH_FROM_HANDLE(darr) = nelem;
+    _DA_STATS_LENGTH(darr);
+    return darr;
+}
+
+static inline void* da_reserve(void* darr, size_t nelem)
+{
+    size_t curr_capacity = da_capacity(darr);
+    size_t curr_length = da_length(darr);
+    size_t min_capacity = curr_length + nelem;
+    if (curr_capacity >= min_capacity && !_da_is_shared(darr))
+    {
+        return darr;
+    }
+    return _da_grow(darr, min_capacity);
+}
+
+static inline void* da_shrink_to_fit(void* darr)
+{
+    size_t length = da_length(darr);
+    if (_da_is_shared(darr))
+    {
+        return _da_cow(darr, length);
+    }
+    if (length == da_capacity(darr) && *DA_P_FRONT_FROM_HANDLE(darr) == 0)
+    {
+        return darr;
+    }
+    return _da_realloc(darr, length, length);
+}
+
+static inline void* da_append(void* darr, const void* src, size_t n)
+{
+    darr = da_reserve(darr, n);
+    if (darr == NULL)
+    {
+        return NULL;
+    }
+    size_t* p_len = DA_P_LENGTH_FROM_HANDLE(darr);
+    size_t elsz = da_sizeof_elem(darr);
+    memcpy((char*)darr + (*p_len)*elsz, src, n*elsz);
+    *p_len += n;
+    _DA_STATS_LENGTH(darr);
+    return darr;
+}
+
+static inline void* da_insert_n(void* darr, size_t index, const void* src,
+    size_t n)
+{
+    darr = da_reserve(darr, n);
+    if (darr == NULL)
+    {
+        return NULL;
+    }
+    size_t* p_len = DA_P_LENGTH_FROM_HANDLE(darr);
+    size_t elsz = da_sizeof_elem(darr);
+    memmove(
+        (char*)darr + (index+n)*elsz,
+        (char*)darr + index*elsz,
+        elsz*(*p_len-index)
+    );
+    _DA_STATS_MOVED(darr, elsz*(*p_len-index));
+    memcpy((char*)darr + index*elsz, src, n*elsz);
+    *p_len += n;
+    _DA_STATS_LENGTH(darr);
+    return darr;
+}
+
+static inline void* da_resize_fill(void* darr, size_t nelem,
+    const void* value)
+{
+    size_t length = da_length(darr);
+    darr = da_resize(darr, nelem);
+    if (darr == NULL)
+    {
+        return NULL;
+    }
+    if (nelem > length)
+    {
+        size_t elsz = da_sizeof_elem(darr);
+        _da_fill_bytes((char*)darr + length*elsz, value, elsz, nelem - length);
+    }
+    return darr;
+}
+
+static inline void* da_remove_range(void* darr, size_t first, size_t count)
+{
+    darr = da_unshare(darr);
+    if (darr == NULL)
+    {
+        return NULL;
+    }
+    size_t* p_len = DA_P_LENGTH_FROM_HANDLE(darr);
+    size_t elsz = da_sizeof_elem(darr);
+    memmove(
+        (char*)darr + first*elsz,
+        (char*)darr + (first+count)*elsz,
+        elsz*(*p_len-first-count)
+    );
+    _DA_STATS_MOVED(darr, elsz*(*p_len-first-count));
+    *p_len -= count;
+    return darr;
+}
+
+static inline void* da_swap_remove_many(void* darr, const size_t* indices,
+    size_t n)
+{
+    darr = da_unshare(darr);
+    if (darr == NULL)
+    {
+        return NULL;
+    }
+    size_t* p_len = DA_P_LENGTH_FROM_HANDLE(darr);
+    size_t elsz = da_sizeof_elem(darr);
+    // Working from the highest index down guarantees the element moved into
+    // each hole is never one that is still waiting to be removed.
+    while (n-- > 0)
+    {
+        size_t last = --(*p_len);
+        if (indices[n] != last)
+        {
+            memcpy(
+                (char*)darr + indices[n]*elsz,
+                (char*)darr + last*elsz,
+                elsz
+            );
+        }
+    }
+    return darr;
+}
+
+// Move the header of `darr` so that the handle moves by `delta` bytes, taking
+// one element slot in front of the darray if `delta` is negative or giving
+// one back if it is positive.
+static inline void* _da_front_shift(void* darr, ptrdiff_t delta)
+{
+    char* block = DA_BLOCK_FROM_HANDLE(darr);
+    char* handle = (char*)darr + delta;
+    memmove(DA_HEAD_FROM_HANDLE(handle), DA_HEAD_FROM_HANDLE(darr),
+        DA_HANDLE_OFFSET);
+    *DA_P_PADDING_FROM_HANDLE(handle) =
+        (size_t)(DA_HEAD_FROM_HANDLE(handle) - block);
+    return handle;
+}
+
+// Whether the handle of a darray of elements of size `elsz` may move into
+// front slack without losing the alignment of its header.
+static inline int _da_front_slack(size_t elsz)
+{
+#ifdef DA_ENABLE_FRONT_SLACK
+    (void)elsz;
+    return 1;
+#else
+    return elsz % sizeof(size_t) == 0;
+#endif
+}
+
+static inline void* da_push_front(void* darr, const void* value)
+{
+    if (_da_is_shared(darr))
+    {
+        darr = _da_cow(darr, da_capacity(darr));
+        if (darr == NULL)
+        {
+            return NULL;
+        }
+    }
+    if (!_da_front_slack(da_sizeof_elem(darr)))
+    {
+        size_t length = da_length(darr);
+        size_t elsz = da_sizeof_elem(darr);
+        if (length == da_capacity(darr))
+        {
+            void* ptr = _da_grow(darr, length + 1);
+            if (ptr == NULL)
+            {
+                return NULL;
+            }
+            darr = ptr;
+        }
+        memmove((char*)darr + elsz, darr, length*elsz);
+        _DA_STATS_MOVED(darr, length*elsz);
+        memcpy(darr, value, elsz);
+        *DA_P_LENGTH_FROM_HANDLE(darr) += 1;
+        _DA_STATS_LENGTH(darr);
+        return darr;
+    }
+    if (*DA_P_FRONT_FROM_HANDLE(darr) == 0)
+    {
+        size_t length = da_length(darr);
+        size_t room = _da_new_capacity(*DA_P_GROWTH_FROM_HANDLE(darr),
+            length + 1) - length;
+        void* ptr = _da_realloc(darr, da_capacity(darr) + room, length);
+        if (ptr == NULL)
+        {
+            return NULL;
+        }
+        darr = _da_front_move(ptr, room, length);
+    }
+    size_t elsz = da_sizeof_elem(darr);
+    darr = _da_front_shift(darr, -(ptrdiff_t)elsz);
+    *DA_P_FRONT_FROM_HANDLE(darr)    -= 1;
+    *DA_P_CAPACITY_FROM_HANDLE(darr) += 1;
+    *DA_P_LENGTH_FROM_HANDLE(darr)   += 1;
+    memcpy(darr, value, elsz);
+    _DA_STATS_LENGTH(darr);
+    return darr;
+}
+
+static inline void* da_pop_front(void* darr, void* value)
+{
+    if (_da_is_shared(darr))
+    {
+        darr = _da_cow(darr, da_capacity(darr));
+        if (darr == NULL)
+        {
+            return NULL;
+        }
+    }
+    size_t elsz = da_sizeof_elem(darr);
+    if (value != NULL)
+    {
+        memcpy(value, darr, elsz);
+    }
+    if (!_da_front_slack(elsz))
+    {
+        size_t length = --(*DA_P_LENGTH_FROM_HANDLE(darr));
+        memmove(darr, (char*)darr + elsz, length*elsz);
+        _DA_STATS_MOVED(darr, length*elsz);
+        return darr;
+    }
+    darr = _da_front_shift(darr, (ptrdiff_t)elsz);
+    *DA_P_FRONT_FROM_HANDLE(darr)    += 1;
+    *DA_P_CAPACITY_FROM_HANDLE(darr) -= 1;
+    *DA_P_LENGTH_FROM_HANDLE(darr)   -= 1;
+    // An empty darray costs nothing to move back to the start of its block.
+    if (da_length(darr) == 0)
+    {
+        darr = _da_front_move(darr, 0, 0);
+    }
+    return darr;
+}
+
+// The head of a ring is only written by the consumer and the tail only by the
+// producer. Each side publishes its own counter with a release store and reads
+// the other with an acquire load, which orders the element copies.
+#ifdef DA_HAVE_ATOMICS
+#   define _DA_RING_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#   define _DA_RING_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#else
+#   define _DA_RING_LOAD(p) (*(p))
+#   define _DA_RING_STORE(p, v) (*(p) = (v))
+#endif
+
+static inline int da_ring_init(struct da_ring* ring, size_t capacity,
+    size_t size, const struct da_attr* attr)
+{
+    size_t pow2 = 1;
+    while (pow2 < capacity && pow2 != 0)
+    {
+        pow2 <<= 1;
+    }
+    memset(ring, 0, sizeof(*ring));
+    ring->darr = pow2 == 0 ? NULL : _da_alloc_capacity(0, pow2, size, attr);
+    ring->mask = pow2 - 1;
+    ring->elsz = size;
+    return ring->darr == NULL ? -1 : 0;
+}
+
+static inline void da_ring_destroy(struct da_ring* ring)
+{
+    da_free(ring->darr);
+    ring->darr = NULL;
+}
+
+static inline size_t da_ring_length(struct da_ring* ring)
+{
+    size_t head = _DA_RING_LOAD(&ring->head);
+    return _DA_RING_LOAD(&ring->tail) - head;
+}
+
+static inline int da_ring_push(struct da_ring* ring, const void* value)
+{
+    size_t tail = ring->tail;
+    if (tail - _DA_RING_LOAD(&ring->head) == ring->mask + 1)
+    {
+        return -1;
+    }
+    size_t elsz = ring->elsz;
+    memcpy((char*)ring->darr + (tail & ring->mask)*elsz, value, elsz);
+    _DA_RING_STORE(&ring->tail, tail + 1);
+    return 0;
+}
+
+static inline int da_ring_pop(struct da_ring* ring, void* value)
+{
+    size_t head = ring->head;
+    if (_DA_RING_LOAD(&ring->tail) == head)
+    {
+        return -1;
+    }
+    if (value != NULL)
+    {
+        size_t elsz = ring->elsz;
+        memcpy(value, (char*)ring->darr + (head & ring->mask)*elsz, elsz);
+    }
+    _DA_RING_STORE(&ring->head, head + 1);
+    return 0;
+}
+
+static inline size_t da_ring_write(struct da_ring* ring, const void* src,
+    size_t n)
+{
+    size_t tail = ring->tail;
+    size_t capacity = ring->mask + 1;
+    size_t room = capacity - (tail - _DA_RING_LOAD(&ring->head));
+    n = n < room ? n : room;
+    if (n == 0)
+    {
+        return 0;
+    }
+    size_t elsz = ring->elsz;
+    size_t index = tail & ring->mask;
+    size_t first = n < capacity - index ? n : capacity - index;
+    memcpy((char*)ring->darr + index*elsz, src, first*elsz);
+    memcpy(ring->darr, (const char*)src + first*elsz, (n - first)*elsz);
+    _DA_RING_STORE(&ring->tail, tail + n);
+    return n;
+}
+
+static inline size_t da_ring_read(struct da_ring* ring, void* dst, size_t n)
+{
+    size_t head = ring->head;
+    size_t available = _DA_RING_LOAD(&ring->tail) - head;
+    n = n < available ? n : available;
+    if (n == 0)
+    {
+        return 0;
+    }
+    size_t capacity = ring->mask + 1;
+    size_t elsz = ring->elsz;
+    size_t index = head & ring->mask;
+    size_t first = n < capacity - index ? n : capacity - index;
+    memcpy(dst, (char*)ring->darr + index*elsz, first*elsz);
+    memcpy((char*)dst + first*elsz, ring->darr, (n - first)*elsz);
+    _DA_RING_STORE(&ring->head, head + n);
+    return n;
+}
+
+static inline size_t _da_soa_round(size_t size)
+{
+    return (size + DA_SOA_ALIGNMENT - 1) & ~(size_t)(DA_SOA_ALIGNMENT - 1);
+}
+
+// Move every column of `soa` into a new block with room for `capacity`
+// records. The column table and element sizes are kept at the front of the
+// block, followed by the columns, each starting on a DA_SOA_ALIGNMENT
+// boundary.
+static inline int _da_soa_realloc(struct da_soa* soa, size_t capacity)
+{
+    size_t ncolumns = soa->ncolumns;
+    size_t table = _da_soa_round(ncolumns*(sizeof(void*) + sizeof(size_t)));
+    size_t size = DA_SOA_ALIGNMENT - 1 + table;
+    for (size_t i = 0; i < ncolumns; ++i)
+    {
+        size += _da_soa_round(capacity*soa->sizes[i]);
+    }
+    char* block = (char*)malloc(size);
+    if (block == NULL)
+    {
+        return -1;
+    }
+    char* base = block + ((DA_SOA_ALIGNMENT - ((uintptr_t)block
+        & (DA_SOA_ALIGNMENT - 1))) & (DA_SOA_ALIGNMENT - 1));
+    void** columns = (void**)base;
+    size_t* sizes = (size_t*)(base + ncolumns*sizeof(void*));
+    char* data = base + table;
+    size_t keep = soa->length < capacity ? soa->length : capacity;
+    for (size_t i = 0; i < ncolumns; ++i)
+    {
+        sizes[i] = soa->sizes[i];
+        columns[i] = data;
+        if (soa->block != NULL)
+        {
+            memcpy(data, soa->columns[i], keep*sizes[i]);
+        }
+        data += _da_soa_round(capacity*sizes[i]);
+    }
+    free(soa->block);
+    soa->columns = columns;
+    soa->sizes = sizes;
+    soa->capacity = capacity;
+    soa->block = block;
+    return 0;
+}
+
+static inline int da_soa_init(struct da_soa* soa, size_t ncolumns,
+    const size_t* sizes, size_t nelem)
+{
+    soa->columns = NULL;
+    soa->sizes = (size_t*)sizes;
+    soa->ncolumns = ncolumns;
+    soa->length = nelem;
+    soa->capacity = 0;
+    soa->block = NULL;
+    return _da_soa_realloc(soa, _da_new_capacity(NULL, nelem));
+}
+
+static inline void da_soa_destroy(struct da_soa* soa)
+{
+    free(soa->block);
+    soa->block = NULL;
+}
+
+static inline int da_soa_reserve(struct da_soa* soa, size_t nelem)
+{
+    size_t min_capacity = soa->length + nelem;
+    if (soa->capacity >= min_capacity)
+    {
+        return 0;
+    }
+    return _da_soa_realloc(soa, _da_new_capacity(NULL, min_capacity));
+}
+
+static inline int da_soa_push(struct da_soa* soa, const void* const* values)
+{
+    return da_soa_insert(soa, soa->length, values);
+}
+
+static inline int da_soa_insert(struct da_soa* soa, size_t index,
+    const void* const* values)
+{
+    if (da_soa_reserve(soa, 1) != 0)
+    {
+        return -1;
+    }
+    size_t length = soa->length;
+    for (size_t i = 0; i < soa->ncolumns; ++i)
+    {
+        size_t elsz = soa->sizes[i];
+        char* column = (char*)soa->columns[i];
+        memmove(column + (index+1)*elsz, column + index*elsz,
+            (length-index)*elsz);
+        memcpy(column + index*elsz, values[i], elsz);
+    }
+    soa->length = length + 1;
+    return 0;
+}
+
+static inline void da_soa_remove(struct da_soa* soa, size_t index)
+{
+    size_t length = --soa->length;
+    for (size_t i = 0; i < soa->ncolumns; ++i)
+    {
+        size_t elsz = soa->sizes[i];
+        char* column = (char*)soa->columns[i];
+        memmove(column + index*elsz, column + (index+1)*elsz,
+            (length-index)*elsz);
+    }
+}
+
+static inline void da_soa_swap_remove(struct da_soa* soa, size_t index)
+{
+    size_t length = --soa->length;
+    if (index == length)
+    {
+        return;
+    }
+    for (size_t i = 0; i < soa->ncolumns; ++i)
+    {
+        size_t elsz = soa->sizes[i];
+        char* column = (char*)soa->columns[i];
+        memcpy(column + index*elsz, column + length*elsz, elsz);
+    }
+}
+
+static inline int da_seg_init(struct da_seg* seg, size_t size,
+    size_t segment_size)
+{
+    return da_seg_init_aligned(seg, size, segment_size, DA_ALIGNMENT_DEFAULT);
+}
+
+static inline int da_seg_init_aligned(struct da_seg* seg, size_t size,
+    size_t segment_size, size_t align)
+{
+    if (size == 0 || !_da_is_pow2(align))
+    {
+        seg->segments = NULL;
+        return -1;
+    }
+    if (segment_size == 0)
+    {
+        segment_size = size < DA_SEG_SEGMENT_BYTES
+            ? DA_SEG_SEGMENT_BYTES/size : 1;
+    }
+    size_t shift = 0;
+    while (((size_t)1 << shift) < segment_size)
+    {
+        ++shift;
+    }
+    seg->segments = (void**)da_alloc(0, sizeof(void*));
+    seg->elsz = size;
+    seg->align = align;
+    seg->shift = shift;
+    seg->length = 0;
+    return seg->segments == NULL ? -1 : 0;
+}
+
+static inline void da_seg_destroy(struct da_seg* seg)
+{
+    for (size_t i = 0; i < da_length(seg->segments); ++i)
+    {
+        da_free(seg->segments[i]);
+    }
+    da_free(seg->segments);
+    seg->segments = NULL;
+    seg->length = 0;
+}
+
+static inline void* da_seg_at(const struct da_seg* seg, size_t index)
+{
+    size_t mask = ((size_t)1 << seg->shift) - 1;
+    return (char*)seg->segments[index >> seg->shift]
+        + (index & mask)*seg->elsz;
+}
+
+static inline int da_seg_reserve(struct da_seg* seg, size_t nelem)
+{
+    size_t segment_size = (size_t)1 << seg->shift;
+    size_t needed = (seg->length + nelem + segment_size - 1) >> seg->shift;
+    size_t have = da_length(seg->segments);
+    if (needed <= have)
+    {
+        return 0;
+    }
+    // Only the directory of pointers is ever reallocated.
+    void** segments = (void**)da_reserve(seg->segments, needed - have);
+    if (segments == NULL)
+    {
+        return -1;
+    }
+    seg->segments = segments;
+    for (; have < needed; ++have)
+    {
+        void* segment = da_alloc_aligned(segment_size, seg->elsz, seg->align);
+        if (segment == NULL)
+        {
+            return -1;
+        }
+        segments[have] = segment;
+        *DA_P_LENGTH_FROM_HANDLE(segments) = have + 1;
+    }
+    return 0;
+}
+
+static inline int da_seg_push(struct da_seg* seg, const void* value)
+{
+    if (seg->length >> seg->shift == da_length(seg->segments)
+        && da_seg_reserve(seg, 1) != 0)
+    {
+        return -1;
+    }
+    memcpy(da_seg_at(seg, seg->length), value, seg->elsz);
+    seg->length += 1;
+    return 0;
+}
+
+static inline int da_seg_pop(struct da_seg* seg, void* value)
+{
+    if (seg->length == 0)
+    {
+        return -1;
+    }
+    seg->length -= 1;
+    if (value != NULL)
+    {
+        memcpy(value, da_seg_at(seg, seg->length), seg->elsz);
+    }
+    return 0;
+}
+
+// Iterators step through a segment and jump to the next one at each segment
+// boundary. The outer loops run once and only declare the loop state, so
+// `break` in the body ends the whole foreach.
+#define _da_seg_foreach(/* struct da_seg* */seg, ELEM_TYPE, itername)          \
+for (size_t __da_i_##itername = 0, __da_once_##itername = 1;                   \
+    __da_once_##itername;                                                      \
+    __da_once_##itername = 0)                                                  \
+for (ELEM_TYPE* itername =                                                     \
+        (seg)->length != 0 ? (ELEM_TYPE*)(seg)->segments[0] : NULL;            \
+    __da_i_##itername < (seg)->length;                                         \
+    itername = (++__da_i_##itername & (((size_t)1 << (seg)->shift) - 1))       \
+        ? itername + 1                                                         \
+        : __da_i_##itername < (seg)->length                                    \
+            ? (ELEM_TYPE*)(seg)->segments[__da_i_##itername >> (seg)->shift]   \
+            : NULL)                                                            \
+
+#define _da_seg_foreach_chunk(/* struct da_seg* */seg, ELEM_TYPE, chunkname,   \
+    countname)                                                                 \
+for (size_t __da_left_##chunkname = (seg)->length,                             \
+        __da_k_##chunkname = 0,                                                \
+        countname = __da_left_##chunkname < ((size_t)1 << (seg)->shift)        \
+            ? __da_left_##chunkname : ((size_t)1 << (seg)->shift),             \
+        __da_once_##chunkname = 1;                                             \
+    __da_once_##chunkname;                                                     \
+    __da_once_##chunkname = 0)                                                 \
+for (ELEM_TYPE* chunkname =                                                    \
+        countname != 0 ? (ELEM_TYPE*)(seg)->segments[0] : NULL;                \
+    countname != 0;                                                            \
+    __da_left_##chunkname -= countname,                                        \
+        countname = __da_left_##chunkname < ((size_t)1 << (seg)->shift)        \
+            ? __da_left_##chunkname : ((size_t)1 << (seg)->shift),             \
+        chunkname = countname != 0                                             \
+            ? (ELEM_TYPE*)(seg)->segments[++__da_k_##chunkname] : NULL)        \
+
+static inline uint64_t _da_packed_mask(unsigned bits)
+{
+    return bits >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << bits) - 1;
+}
+
+// Bits needed to hold `delta`.
+static inline unsigned _da_packed_width(uint64_t delta)
+{
+    unsigned bits = 0;
+    while (bits < 64 && (delta >> bits) != 0)
+    {
+        ++bits;
+    }
+    return bits;
+}
+
+// Words needed to hold `nelem` values of `bits` bits.
+static inline size_t _da_packed_nwords(size_t nelem, unsigned bits)
+{
+    return (nelem*bits + 63)/64;
+}
+
+// A value may straddle two words, in which case its low bits sit at the top of
+// the first word and its high bits at the bottom of the next.
+static inline uint64_t _da_packed_load(const uint64_t* words, unsigned bits,
+    size_t index)
+{
+    if (bits == 0)
+    {
+        return 0;
+    }
+    size_t bit = index*bits;
+    const uint64_t* word = words + bit/64;
+    unsigned offset = (unsigned)(bit % 64);
+    uint64_t delta = word[0] >> offset;
+    if (offset + bits > 64)
+    {
+        delta |= word[1] << (64 - offset);
+    }
+    return delta & _da_packed_mask(bits);
+}
+
+static inline void _da_packed_store(uint64_t* words, unsigned bits,
+    size_t index, uint64_t delta)
+{
+    if (bits == 0)
+    {
+        return;
+    }
+    uint64_t mask = _da_packed_mask(bits);
+    size_t bit = index*bits;
+    uint64_t* word = words + bit/64;
+    unsigned offset = (unsigned)(bit % 64);
+    word[0] = (word[0] & ~(mask << offset)) | (delta << offset);
+    if (offset + bits > 64)
+    {
+        unsigned low = 64 - offset;
+        word[1] = (word[1] & ~(mask >> low)) | (delta >> low);
+    }
+}
+
+// Repack every value of `packed` into a new darray of words `bits` wide, with
+// room for `nelem` more values.
+static inline int _da_packed_repack(struct da_packed* packed, unsigned bits,
+    size_t nelem)
+{
+    // The new words are allocated with room for `nelem` more values, so the
+    // values appended after widening never reallocate them.
+    size_t nwords = _da_packed_nwords(packed->length, bits);
+    uint64_t* words = (uint64_t*)_da_alloc_capacity(nwords,
+        _da_packed_nwords(packed->length + nelem, bits), sizeof(uint64_t),
+        NULL);
+    if (words == NULL)
+    {
+        return -1;
+    }
+    memset(words, 0, nwords*sizeof(uint64_t));
+    for (size_t i = 0; i < packed->length; ++i)
+    {
+        _da_packed_store(words, bits, i,
+            _da_packed_load(packed->words, packed->bits, i));
+    }
+    da_free(packed->words);
+    packed->words = words;
+    packed->bits = bits;
+    return 0;
+}
+
+// Append zeroed words until `nelem` values fit.
+static inline int _da_packed_extend(struct da_packed* packed, size_t nelem)
+{
+    size_t have = da_length(packed->words);
+    size_t needed = _da_packed_nwords(nelem, packed->bits);
+    if (needed <= have)
+    {
+        return 0;
+    }
+    uint64_t* words = packed->words;
+    if (needed > da_capacity(words))
+    {
+        words = (uint64_t*)_da_grow(words, needed);
+        if (words == NULL)
+        {
+            return -1;
+        }
+        packed->words = words;
+    }
+    memset(words + have, 0, (needed - have)*sizeof(uint64_t));
+    *DA_P_LENGTH_FROM_HANDLE(words) = needed;
+    return 0;
+}
+
+static inline int da_packed_init(struct da_packed* packed, unsigned bits,
+    uint64_t base)
+{
+    if (bits > 64)
+    {
+        return -1;
+    }
+    packed->words = (uint64_t*)da_alloc(0, sizeof(uint64_t));
+    packed->base = base;
+    packed->bits = bits;
+    packed->length = 0;
+    return packed->words == NULL ? -1 : 0;
+}
+
+static inline void da_packed_destroy(struct da_packed* packed)
+{
+    da_free(packed->words);
+    packed->words = NULL;
+    packed->length = 0;
+}
+
+static inline uint64_t da_packed_get(const struct da_packed* packed,
+    size_t index)
+{
+    return packed->base + _da_packed_load(packed->words, packed->bits, index);
+}
+
+static inline int da_packed_set(struct da_packed* packed, size_t index,
+    uint64_t value)
+{
+    uint64_t delta = value - packed->base;
+    unsigned bits = _da_packed_width(delta);
+    if (bits > packed->bits && _da_packed_repack(packed, bits, 0) != 0)
+    {
+        return -1;
+    }
+    _da_packed_store(packed->words, packed->bits, index, delta);
+    return 0;
+}
+
+static inline int da_packed_reserve(struct da_packed* packed, size_t nelem)
+{
+    size_t needed = _da_packed_nwords(packed->length + nelem, packed->bits);
+    size_t have = da_length(packed->words);
+    if (needed <= da_capacity(packed->words))
+    {
+        return 0;
+    }
+    uint64_t* words = (uint64_t*)da_reserve(packed->words, needed - have);
+    if (words == NULL)
+    {
+        return -1;
+    }
+    packed->words = words;
+    return 0;
+}
+
+static inline int da_packed_push(struct da_packed* packed, uint64_t value)
+{
+    uint64_t delta = value - packed->base;
+    unsigned bits = _da_packed_width(delta);
+    if (bits > packed->bits && _da_packed_repack(packed, bits, 1) != 0)
+    {
+        return -1;
+    }
+    if (_da_packed_extend(packed, packed->length + 1) != 0)
+    {
+        return -1;
+    }
+    _da_packed_store(packed->words, packed->bits, packed->length, delta);
+    packed->length += 1;
+    return 0;
+}
+
+// Element `i` of a darray of unsigned integers of `elsz` bytes.
+static inline uint64_t _da_packed_elem(const void* darr, size_t elsz, size_t i)
+{
+    switch (elsz)
+    {
+    case 1: return ((const uint8_t*)darr)[i];
+    case 2: return ((const uint16_t*)darr)[i];
+    case 4: return ((const uint32_t*)darr)[i];
+    default: return ((const uint64_t*)darr)[i];
+    }
+}
+
+static inline int da_packed_encode(struct da_packed* packed, void* darr)
+{
+    size_t elsz = da_sizeof_elem(darr);
+    size_t length = da_length(darr);
+    if (elsz != 1 && elsz != 2 && elsz != 4 && elsz != 8)
+    {
+        return -1;
+    }
+    uint64_t widest = 0;
+    for (size_t i = 0; i < length; ++i)
+    {
+        widest |= _da_packed_elem(darr, elsz, i) - packed->base;
+    }
+    unsigned bits = _da_packed_width(widest);
+    if (bits > packed->bits)
+    {
+        if (_da_packed_repack(packed, bits, length) != 0)
+        {
+            return -1;
+        }
+    }
+    if (_da_packed_extend(packed, packed->length + length) != 0)
+    {
+        return -1;
+    }
+    for (size_t i = 0; i < length; ++i)
+    {
+        _da_packed_store(packed->words, packed->bits, packed->length + i,
+            _da_packed_elem(darr, elsz, i) - packed->base);
+    }
+    packed->length += length;
+    return 0;
+}
+
+// Unpack into `out` with a cursor that walks the words in order instead of
+// recomputing the position of every value.
+#define _DA_PACKED_UNPACK(ELEM_TYPE)                                           \
+{                                                                              \
+    ELEM_TYPE* dst = (ELEM_TYPE*)out;                                          \
+    if (bits == 0)                                                             \
+    {                                                                          \
+        for (size_t i = 0; i < count; ++i)                                     \
+        {                                                                      \
+            dst[i] = (ELEM_TYPE)base;                                          \
+        }                                                                      \
+        break;                                                                 \
+    }                                                                          \
+    size_t bit = index*bits;                                                   \
+    const uint64_t* word = words + bit/64;                                     \
+    unsigned offset = (unsigned)(bit % 64);                                    \
+    for (size_t i = 0; i < count; ++i)                                         \
+    {                                                                          \
+        uint64_t delta = word[0] >> offset;                                    \
+        if (offset + bits > 64)                                                \
+        {                                                                      \
+            delta |= word[1] << (64 - offset);                                 \
+        }                                                                      \
+        dst[i] = (ELEM_TYPE)(base + (delta & mask));                           \
+        offset += bits;                                                        \
+        word += offset/64;                                                     \
+        offset %= 64;                                                          \
+    }                                                                          \
+    break;                                                                     \
+}
+
+static inline void _da_packed_unpack(const uint64_t* words, unsigned bits,
+    uint64_t base, size_t index, size_t count, void* out, size_t elsz)
+{
+    uint64_t mask = _da_packed_mask(bits);
+    switch (elsz)
+    {
+    case 1: _DA_PACKED_UNPACK(uint8_t)
+    case 2: _DA_PACKED_UNPACK(uint16_t)
+    case 4: _DA_PACKED_UNPACK(uint32_t)
+    default: _DA_PACKED_UNPACK(uint64_t)
+    }
+}
+
+static inline void* da_packed_decode(const struct da_packed* packed,
+    size_t index, size_t count, void* darr)
+{
+    size_t elsz = da_sizeof_elem(darr);
+    if (elsz != 1 && elsz != 2 && elsz != 4 && elsz != 8)
+    {
+        return NULL;
+    }
+    darr = da_reserve(darr, count);
+    if (darr == NULL)
+    {
+        return NULL;
+    }
+    size_t length = da_length(darr);
+    _da_packed_unpack(packed->words, packed->bits, packed->base, index, count,
+        (char*)darr + length*elsz, elsz);
+    *DA_P_LENGTH_FROM_HANDLE(darr) = length + count;
+    return darr;
+}
+
+// Logical index of the first element after the gap of `darr`. The gap of an
+// ordinary darray is its unused capacity at the end.
+static inline size_t _da_gap_start(void* darr)
+{
+    return (da_flags(darr) & DA_FLAG_GAP)
+        ? *DA_P_GAP_FROM_HANDLE(darr) : da_length(darr);
+}
+
+static inline void _da_gap_set(void* darr, size_t start)
+{
+    *DA_P_GAP_FROM_HANDLE(darr) = start;
+    if (start == da_length(darr))
+    {
+        *DA_P_FLAGS_FROM_HANDLE(darr) &= ~DA_FLAG_GAP;
+    }
+    else
+    {
+        *DA_P_FLAGS_FROM_HANDLE(darr) |= DA_FLAG_GAP;
+    }
+}
+
+// Move the gap of `darr` so that it starts at logical index `index`, shifting
+// the elements between the old and the new position across it.
+static inline void _da_gap_move(void* darr, size_t index)
+{
+    size_t start = _da_gap_start(darr);
+    size_t gap = da_capacity(darr) - da_length(darr);
+    size_t elsz = da_sizeof_elem(darr);
+    char* base = (char*)darr;
+    if (index < start)
+    {
+        memmove(base + (index+gap)*elsz, base + index*elsz,
+            (start-index)*elsz);
+        _DA_STATS_MOVED(darr, (start-index)*elsz);
+    }
+    else if (index > start)
+    {
+        memmove(base + start*elsz, base + (start+gap)*elsz,
+            (index-start)*elsz);
+        _DA_STATS_MOVED(darr, (index-start)*elsz);
+    }
+    _da_gap_set(darr, index);
+}
+
+static inline void* da_gap_insert(void* darr, size_t index, const void* value)
+{
+    size_t length = da_length(darr);
+    size_t capacity = da_capacity(darr);
+    size_t elsz = da_sizeof_elem(darr);
+    if (length == capacity)
+    {
+        // A full gap buffer is contiguous, so it grows like any darray. The
+        // new capacity then becomes the gap, which is opened at `index`.
+        darr = _da_grow(darr, length + 1);
+        if (darr == NULL)
+        {
+            return NULL;
+        }
+        size_t gap = da_capacity(darr) - length;
+        memmove((char*)darr + (index+gap)*elsz, (char*)darr + index*elsz,
+            (length-index)*elsz);
+        _DA_STATS_MOVED(darr, (length-index)*elsz);
+        _da_gap_set(darr, index);
+    }
+    else
+    {
+        darr = da_unshare(darr);
+        if (darr == NULL)
+        {
+            return NULL;
+        }
+        _da_gap_move(darr, index);
+    }
+    memcpy((char*)darr + index*elsz, value, elsz);
+    *DA_P_LENGTH_FROM_HANDLE(darr) = length + 1;
+    _da_gap_set(darr, index + 1);
+    _DA_STATS_LENGTH(darr);
+    return darr;
+}
+
+static inline void* da_gap_remove(void* darr, size_t index)
+{
+    darr = da_unshare(darr);
+    if (darr == NULL)
+    {
+        return NULL;
+    }
+    // The gap swallows the removed element from whichever side is closer.
+    if (index < _da_gap_start(darr))
+    {
+        _da_gap_move(darr, index + 1);
+    }
+    else
+    {
+        _da_gap_move(darr, index);
+    }
+    *DA_P_LENGTH_FROM_HANDLE(darr) -= 1;
+    _da_gap_set(darr, index);
+    return darr;
+}
+
+static inline void* da_gap_at(void* darr, size_t index)
+{
+    size_t elsz = da_sizeof_elem(darr);
+    if (index >= _da_gap_start(darr))
+    {
+        index += da_capacity(darr) - da_length(darr);
+    }
+    return (char*)darr + index*elsz;
+}
+
+static inline void da_gap_materialize(void* darr)
+{
+    _da_gap_move(darr, da_length(darr));
+}
+
+struct _da_arena_chunk
+{
+    struct _da_arena_chunk* next;
+    size_t size;
+    size_t used;
+};
+
+// Chunk memory starts after the chunk header, rounded up so that every
+// allocation handed out by the arena is aligned to DA_MALLOC_ALIGNMENT.
+#define DA_ARENA_ROUND(size) \
+    (((size) + DA_MALLOC_ALIGNMENT - 1) & ~(DA_MALLOC_ALIGNMENT - 1))
+#define DA_ARENA_CHUNK_MEM(chunk) \
+    ((char*)(chunk) + DA_ARENA_ROUND(sizeof(struct _da_arena_chunk)))
+
+static inline void* _da_arena_alloc(void* ctx, size_t size)
+{
+    struct da_arena* arena = (struct da_arena*)ctx;
+    size = DA_ARENA_ROUND(size);
+    // Look for room in the current chunk, then in any chunk left over from
+    // before the last reset.
+    while (arena->curr != NULL)
+    {
+        struct _da_arena_chunk* chunk = arena->curr;
+        if (chunk->size - chunk->used >= size)
+        {
+            void* ptr = DA_ARENA_CHUNK_MEM(chunk) + chunk->used;
+            chunk->used += size;
+            return ptr;
+        }
+        if (chunk->next == NULL)
+        {
+            break;
+        }
+        arena->curr = chunk->next;
+    }
+    size_t chunk_size = size > arena->chunk_size ? size : arena->chunk_size;
+    struct _da_arena_chunk* chunk = (struct _da_arena_chunk*)malloc(
+        DA_ARENA_ROUND(sizeof(struct _da_arena_chunk)) + chunk_size);
+    if (chunk == NULL)
+    {
+        return NULL;
+    }
+    chunk->next = NULL;
+    chunk->size = chunk_size;
+    chunk->used = size;
+    if (arena->curr == NULL)
+    {
+        arena->head = chunk;
+    }
+    else
+    {
+        arena->curr->next = chunk;
+    }
+    arena->curr = chunk;
+    return DA_ARENA_CHUNK_MEM(chunk);
+}
+
+// True if `ptr` is the most recent allocation made from the current chunk.
+static inline int _da_arena_is_last(struct da_arena* arena, void* ptr,
+    size_t size)
+{
+    struct _da_arena_chunk* chunk = arena->curr;
+    return chunk != NULL && (char*)ptr + DA_ARENA_ROUND(size)
+        == DA_ARENA_CHUNK_MEM(chunk) + chunk->used;
+}
+
+static inline void* _da_arena_realloc(void* ctx, void* ptr, size_t old_size,
+    size_t new_size)
+{
+    struct da_arena* arena = (struct da_arena*)ctx;
+    // The last allocation can grow or shrink in place.
+    if (_da_arena_is_last(arena, ptr, old_size))
+    {
+        struct _da_arena_chunk* chunk = arena->curr;
+        size_t start = (char*)ptr - DA_ARENA_CHUNK_MEM(chunk);
+        if (chunk->size - start >= DA_ARENA_ROUND(new_size))
+        {
+            chunk->used = start + DA_ARENA_ROUND(new_size);
+            return ptr;
+        }
+    }
+    else if (new_size <= old_size)
+    {
+        return ptr;
+    }
+    void* new_ptr = _da_arena_alloc(ctx, new_size);
+    if (new_ptr != NULL)
+    {
+        memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+    }
+    return new_ptr;
+}
+
+static inline void _da_arena_free(void* ctx, void* ptr, size_t size)
+{
+    struct da_arena* arena = (struct da_arena*)ctx;
+    // Only the last allocation can be given back before a reset.
+    if (_da_arena_is_last(arena, ptr, size))
+    {
+        arena->curr->used -= DA_ARENA_ROUND(size);
+    }
+}
+
+static inline void da_arena_init(struct da_arena* arena, size_t chunk_size)
+{
+    arena->allocator.alloc   = _da_arena_alloc;
+    arena->allocator.realloc = _da_arena_realloc;
+    arena->allocator.free    = _da_arena_free;
+    arena->allocator.ctx     = arena;
+    arena->head = NULL;
+    arena->curr = NULL;
+    arena->chunk_size = DA_ARENA_ROUND(chunk_size);
+}
+
+static inline void da_arena_reset(struct da_arena* arena)
+{
+    for (struct _da_arena_chunk* c = arena->head; c != NULL; c = c->next)
+    {
+        c->used = 0;
+    }
+    arena->curr = arena->head;
+}
+
+static inline void da_arena_destroy(struct da_arena* arena)
+{
+    struct _da_arena_chunk* chunk = arena->head;
+    while (chunk != NULL)
+    {
+        struct _da_arena_chunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->head = NULL;
+    arena->curr = NULL;
+}
+
+// Index of the pool size class holding blocks of `size` bytes, or
+// DA_POOL_NCLASSES if the block is too large to be pooled.
+static inline size_t _da_pool_class(size_t size)
+{
+    size_t cls = 0;
+    while (cls < DA_POOL_NCLASSES
+        && ((size_t)1 << (cls + DA_POOL_MIN_CLASS)) < size)
+    {
+        ++cls;
+    }
+    return cls;
+}
+
+static inline void* _da_pool_alloc(void* ctx, size_t size)
+{
+    struct da_pool* pool = (struct da_pool*)ctx;
+    size_t cls = _da_pool_class(size);
+    if (cls == DA_POOL_NCLASSES)
+    {
+        return malloc(size);
+    }
+    void* ptr = pool->free_lists[cls];
+    if (ptr != NULL)
+    {
+        pool->free_lists[cls] = *(void**)ptr;
+        return ptr;
+    }
+    return malloc((size_t)1 << (cls + DA_POOL_MIN_CLASS));
+}
+
+static inline void _da_pool_free(void* ctx, void* ptr, size_t size)
+{
+    struct da_pool* pool = (struct da_pool*)ctx;
+    size_t cls = _da_pool_class(size);
+    if (cls == DA_POOL_NCLASSES)
+    {
+        free(ptr);
+        return;
+    }
+    *(void**)ptr = pool->free_lists[cls];
+    pool->free_lists[cls] = ptr;
+}
+
+static inline void* _da_pool_realloc(void* ctx, void* ptr, size_t old_size,
+    size_t new_size)
+{
+    size_t old_cls = _da_pool_class(old_size);
+    size_t new_cls = _da_pool_class(new_size);
+    if (old_cls == new_cls)
+    {
+        return old_cls == DA_POOL_NCLASSES ? realloc(ptr, new_size) : ptr;
+    }
+    void* new_ptr = _da_pool_alloc(ctx, new_size);
+    if (new_ptr == NULL)
+    {
+        return NULL;
+    }
+    memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+    _da_pool_free(ctx, ptr, old_size);
+    return new_ptr;
+}
+
+static inline void da_pool_init(struct da_pool* pool)
+{
+    pool->allocator.alloc   = _da_pool_alloc;
+    pool->allocator.realloc = _da_pool_realloc;
+    pool->allocator.free    = _da_pool_free;
+    pool->allocator.ctx     = pool;
+    for (size_t i = 0; i < DA_POOL_NCLASSES; ++i)
+    {
+        pool->free_lists[i] = NULL;
+    }
+}
+
+static inline void da_pool_destroy(struct da_pool* pool)
+{
+    for (size_t i = 0; i < DA_POOL_NCLASSES; ++i)
+    {
+        void* ptr = pool->free_lists[i];
+        while (ptr != NULL)
+        {
+            void* next = *(void**)ptr;
+            free(ptr);
+            ptr = next;
+        }
+        pool->free_lists[i] = NULL;
+    }
+}
+
+#ifdef DA_HAVE_MMAP
+#if !defined(MAP_ANONYMOUS)
+#   define MAP_ANONYMOUS MAP_ANON
+#endif
+#if !defined(MAP_NORESERVE)
+#   define MAP_NORESERVE 0
+#endif
+
+// Every virtual memory block starts with a small header recording the size of
+// the reservation and how much of it is currently committed.
+struct _da_vm_block
+{
+    size_t reserved;
+    size_t committed;
+};
+#define DA_VM_BLOCK_HEADER_SIZE DA_ARENA_ROUND(sizeof(struct _da_vm_block))
+
+static inline size_t _da_vm_round(struct da_vm* vm, size_t size)
+{
+    return (size + vm->page_size - 1) & ~(vm->page_size - 1);
+}
+
+// Reserve `reserved` bytes of address space and commit the first `committed`.
+static inline struct _da_vm_block* _da_vm_map(struct da_vm* vm,
+    size_t reserved, size_t committed)
+{
+    void* map = mmap(NULL, reserved, PROT_NONE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (map == MAP_FAILED)
+    {
+        return NULL;
+    }
+    if (mprotect(map, committed, PROT_READ | PROT_WRITE) != 0)
+    {
+        munmap(map, reserved);
+        return NULL;
+    }
+#ifdef MADV_HUGEPAGE
+    if (vm->flags & DA_VM_HUGEPAGE)
+    {
+        madvise(map, reserved, MADV_HUGEPAGE);
+    }
+#endif
+    struct _da_vm_block* block = (struct _da_vm_block*)map;
+    block->reserved = reserved;
+    block->committed = committed;
+    return block;
+}
+
+static inline void* _da_vm_alloc(void* ctx, size_t size)
+{
+    struct da_vm* vm = (struct da_vm*)ctx;
+    size_t committed = _da_vm_round(vm, DA_VM_BLOCK_HEADER_SIZE + size);
+    size_t reserved = committed > vm->reserve ? committed : vm->reserve;
+    struct _da_vm_block* block = _da_vm_map(vm, reserved, committed);
+    return block == NULL ? NULL : (char*)block + DA_VM_BLOCK_HEADER_SIZE;
+}
+
+static inline void* _da_vm_realloc(void* ctx, void* ptr, size_t old_size,
+    size_t new_size)
+{
+    struct da_vm* vm = (struct da_vm*)ctx;
+    struct _da_vm_block* block =
+        (struct _da_vm_block*)((char*)ptr - DA_VM_BLOCK_HEADER_SIZE);
+    size_t needed = _da_vm_round(vm, DA_VM_BLOCK_HEADER_SIZE + new_size);
+
+    // Shrinking decommits the tail, handing its pages back to the system.
+    if (needed <= block->committed)
+    {
+        char* tail = (char*)block + needed;
+        size_t tail_size = block->committed - needed;
+        if (tail_size != 0)
+        {
+            madvise(tail, tail_size, MADV_DONTNEED);
+            mprotect(tail, tail_size, PROT_NONE);
+            block->committed = needed;
+        }
+        return ptr;
+    }
+    // Growing within the reservation commits more pages in place.
+    if (needed <= block->reserved)
+    {
+        if (mprotect((char*)block + block->committed,
+            needed - block->committed, PROT_READ | PROT_WRITE) != 0)
+        {
+            return NULL;
+        }
+        block->committed = needed;
+        return ptr;
+    }
+    // Growing past the reservation requires a larger one. Doubling keeps the
+    // number of remaps logarithmic in the final size.
+    size_t reserved = block->reserved*2 > needed ? block->reserved*2 : needed;
+#ifdef MREMAP_MAYMOVE
+    // Linux can move the pages of the old reservation into the new one
+    // without copying, as long as the whole range has the same protection.
+    size_t committed = block->committed;
+    size_t old_reserved = block->reserved;
+    if (mprotect(block, old_reserved, PROT_READ | PROT_WRITE) == 0)
+    {
+        void* map = mremap(block, old_reserved, reserved, MREMAP_MAYMOVE);
+        if (map != MAP_FAILED)
+        {
+            mprotect((char*)map + needed, reserved - needed, PROT_NONE);
+            block = (struct _da_vm_block*)map;
+            block->reserved = reserved;
+            block->committed = needed;
+            return (char*)block + DA_VM_BLOCK_HEADER_SIZE;
+        }
+        mprotect((char*)block + committed, old_reserved - committed,
+            PROT_NONE);
+    }
+#endif
+    struct _da_vm_block* new_block = _da_vm_map(vm, reserved, needed);
+    if (new_block == NULL)
+    {
+        return NULL;
+    }
+    memcpy((char*)new_block + DA_VM_BLOCK_HEADER_SIZE, ptr, old_size);
+    munmap(block, block->reserved);
+    return (char*)new_block + DA_VM_BLOCK_HEADER_SIZE;
+}
+
+static inline void _da_vm_free(void* ctx, void* ptr, size_t size)
+{
+    (void)ctx;
+    (void)size;
+    struct _da_vm_block* block =
+        (struct _da_vm_block*)((char*)ptr - DA_VM_BLOCK_HEADER_SIZE);
+    munmap(block, block->reserved);
+}
+
+static inline void da_vm_init(struct da_vm* vm, size_t reserve, size_t flags)
+{
+    vm->allocator.alloc   = _da_vm_alloc;
+    vm->allocator.realloc = _da_vm_realloc;
+    vm->allocator.free    = _da_vm_free;
+    vm->allocator.ctx     = vm;
+    vm->page_size = (size_t)sysconf(_SC_PAGESIZE);
+    vm->reserve = _da_vm_round(vm, reserve);
+    vm->flags = flags;
+}
+#endif // DA_HAVE_MMAP
+
+// Files written by `da_save` are laid out exactly like a darray block: the file
+// header sits in the padding in front of the darray header, which is followed
+// by the elements. A mapped file is therefore a valid darray as-is.
+struct _da_file_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t word_size;
+    // Offset of the first element from the start of the file.
+    uint64_t data_offset;
+    // DA_HANDLE_OFFSET of the writer.
+    uint64_t header_size;
+    // Size of the mapping, filled in by `da_map_file`.
+    uint64_t map_size;
+};
+#define DA_FILE_MAGIC "DARRAY\0\0"
+
+// Offset of the first element in a file holding a darray aligned to `align`.
+static inline size_t _da_file_data_offset(size_t align)
+{
+    size_t offset = sizeof(struct _da_file_header) + DA_HANDLE_OFFSET;
+    return (offset + align - 1) & ~(align - 1);
+}
+
+// Fill the first `_da_file_data_offset` bytes of a file holding `darr`: the
+// file header, zero padding and the darray header.
+static inline void _da_file_prefix(void* darr, char* prefix)
+{
+    size_t length = da_length(darr);
+    size_t align = da_alignment(darr);
+    size_t data_offset = _da_file_data_offset(align);
+
+    struct _da_file_header fheader;
+    memset(&fheader, 0, sizeof(fheader));
+    memcpy(fheader.magic, DA_FILE_MAGIC, sizeof(fheader.magic));
+    fheader.version = DA_FILE_VERSION;
+    fheader.word_size = sizeof(size_t);
+    fheader.data_offset = data_offset;
+    fheader.header_size = DA_HANDLE_OFFSET;
+    size_t header[DA_HANDLE_OFFSET/sizeof(size_t)] = {0};
+    header[DA_SIZEOF_ELEM_OFFSET/sizeof(size_t)] = da_sizeof_elem(darr);
+    header[DA_LENGTH_OFFSET/sizeof(size_t)]      = length;
+    header[DA_CAPACITY_OFFSET/sizeof(size_t)]    = length;
+    header[DA_ALIGNMENT_OFFSET/sizeof(size_t)]   = align;
+    header[DA_PADDING_OFFSET/sizeof(size_t)]     = data_offset - DA_HANDLE_OFFSET;
+    header[DA_FLAGS_OFFSET/sizeof(size_t)]       =
+        da_flags(darr) & ~(DA_FLAG_GAP | DA_FLAG_SHARED);
+    header[DA_GAP_OFFSET/sizeof(size_t)]         = length;
+
+    memset(prefix, 0, data_offset);
+    memcpy(prefix, &fheader, sizeof(fheader));
+    memcpy(prefix + data_offset - DA_HANDLE_OFFSET, header, sizeof(header));
+}
+
+// Size of the stack buffer holding the file prefix. Darrays aligned to more than
+// fits here build their prefix on the heap instead.
+#define _DA_FILE_PREFIX_STACK 512
+
+static inline int da_save(void* darr, const char* path)
+{
+    size_t elsz = da_sizeof_elem(darr);
+    size_t length = da_length(darr);
+    size_t data_offset = _da_file_data_offset(da_alignment(darr));
+    char stack[_DA_FILE_PREFIX_STACK];
+    char* prefix = data_offset <= sizeof(stack)
+        ? stack : (char*)malloc(data_offset);
+    if (prefix == NULL)
+    {
+        return -1;
+    }
+    _da_file_prefix(darr, prefix);
+
+    FILE* file = fopen(path, "wb");
+    int ok = file != NULL && fwrite(prefix, 1, data_offset, file) == data_offset;
+    if (prefix != stack)
+    {
+        free(prefix);
+    }
+    if (file == NULL)
+    {
+        return -1;
+    }
+    // The elements of a gap buffer are written in logical order on either
+    // side of the gap.
+    size_t start = _da_gap_start(darr);
+    size_t tail = length - start;
+    ok = ok && fwrite(darr, elsz, start, file) == start;
+    ok = ok && fwrite(da_gap_at(darr, start), elsz, tail, file) == tail;
+    ok = fclose(file) == 0 && ok;
+    return ok ? 0 : -1;
+}
+
+#ifdef DA_HAVE_FD_IO
+// Whether the last failed call on a file descriptor failed because the call
+// would have blocked.
+static inline int _da_would_block(void)
+{
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+static inline int da_write_fd_resume(void* darr, int fd, size_t* offset)
+{
+    size_t elsz = da_sizeof_elem(darr);
+    size_t length = da_length(darr);
+    size_t data_offset = _da_file_data_offset(da_alignment(darr));
+    char stack[_DA_FILE_PREFIX_STACK];
+    char* prefix = data_offset <= sizeof(stack)
+        ? stack : (char*)malloc(data_offset);
+    if (prefix == NULL)
+    {
+        return -1;
+    }
+    _da_file_prefix(darr, prefix);
+
+    size_t start = _da_gap_start(darr);
+    struct iovec iov[3];
+    iov[0].iov_base = prefix;
+    iov[0].iov_len = data_offset;
+    iov[1].iov_base = darr;
+    iov[1].iov_len = start*elsz;
+    iov[2].iov_base = da_gap_at(darr, start);
+    iov[2].iov_len = (length - start)*elsz;
+
+    // Skip what earlier calls wrote, then resume after short writes and
+    // interrupts until everything is written or `fd` would block.
+    struct iovec* next = iov;
+    int iovcnt = 3;
+    size_t left = *offset;
+    int status = 0;
+    for (;;)
+    {
+        while (iovcnt > 0 && left >= next->iov_len)
+        {
+            left -= next->iov_len;
+            ++next;
+            --iovcnt;
+        }
+        if (iovcnt == 0)
+        {
+            break;
+        }
+        next->iov_base = (char*)next->iov_base + left;
+        next->iov_len -= left;
+        ssize_t n = writev(fd, next, iovcnt);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                left = 0;
+                continue;
+            }
+            status = _da_would_block() ? 1 : -1;
+            break;
+        }
+        *offset += (size_t)n;
+        left = (size_t)n;
+    }
+    if (prefix != stack)
+    {
+        free(prefix);
+    }
+    return status;
+}
+
+static inline int da_write_fd(void* darr, int fd)
+{
+    size_t offset = 0;
+    return da_write_fd_resume(darr, fd, &offset) == 0 ? 0 : -1;
+}
+
+static inline void da_reader_init(struct da_reader* reader, size_t size,
+    size_t max_length, const struct da_attr* attr)
+{
+    reader->size = size;
+    reader->max_length = max_length;
+    reader->attr = attr;
+    reader->offset = 0;
+    reader->data_offset = 0;
+    reader->darr = NULL;
+}
+
+static inline void da_reader_destroy(struct da_reader* reader)
+{
+    if (reader->darr != NULL)
+    {
+        da_free(reader->darr);
+        reader->darr = NULL;
+    }
+}
+
+// Read the bytes of `buf` from byte `*done` to `size` from `fd`, resuming
+// after short reads and interrupts. Returns 0 once `*done` reaches `size`, 1
+// if `fd` would block first and -1 on failure or at the end of the file.
+static inline int _da_read_some(int fd, void* buf, size_t size, size_t* done)
+{
+    while (*done != size)
+    {
+        ssize_t n = read(fd, (char*)buf + *done, size - *done);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n < 0 && _da_would_block())
+        {
+            return 1;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        *done += (size_t)n;
+    }
+    return 0;
+}
+
+// Check the file header held by `reader` and record where the elements start.
+static inline int _da_reader_file_header(struct da_reader* reader)
+{
+    struct _da_file_header fheader;
+    memcpy(&fheader, reader->header, sizeof(fheader));
+    size_t data_offset = (size_t)fheader.data_offset;
+    if (memcmp(fheader.magic, DA_FILE_MAGIC, sizeof(fheader.magic)) != 0
+        || fheader.version != DA_FILE_VERSION
+        || fheader.word_size != sizeof(size_t)
+        || fheader.header_size != DA_HANDLE_OFFSET
+        || data_offset < sizeof(fheader) + DA_HANDLE_OFFSET)
+    {
+        return -1;
+    }
+    reader->data_offset = data_offset;
+    return 0;
+}
+
+// Check the darray header held by `reader` and allocate the darray it
+// describes.
+static inline int _da_reader_header(struct da_reader* reader)
+{
+    const size_t* header = reader->header;
+    size_t size = reader->size;
+    size_t data_offset = reader->data_offset;
+    size_t length = header[DA_LENGTH_OFFSET/sizeof(size_t)];
+    size_t align = header[DA_ALIGNMENT_OFFSET/sizeof(size_t)];
+    size_t flags = header[DA_FLAGS_OFFSET/sizeof(size_t)];
+    if (header[DA_SIZEOF_ELEM_OFFSET/sizeof(size_t)] != size
+        || !_da_is_pow2(align)
+        || data_offset != _da_file_data_offset(align)
+        || length > header[DA_CAPACITY_OFFSET/sizeof(size_t)]
+        || length > reader->max_length
+        || (flags & DA_FLAG_GAP)
+        || (size != 0 && length > (SIZE_MAX - data_offset)/size))
+    {
+        return -1;
+    }
+    struct da_attr saved = {align, NULL, NULL, flags};
+    reader->darr = _da_alloc_capacity(length, length, size,
+        reader->attr == NULL ? &saved : reader->attr);
+    return reader->darr == NULL ? -1 : 0;
+}
+
+static inline int da_reader_read(struct da_reader* reader, int fd,
+    void** darr)
+{
+    // The stream is the file header, padding, the darray header and the
+    // elements. `reader->offset` tells which of them is being read.
+    size_t fheader_size = sizeof(struct _da_file_header);
+    int status = 0;
+    if (reader->offset < fheader_size)
+    {
+        status = _da_read_some(fd, reader->header, fheader_size,
+            &reader->offset);
+        if (status != 0 || _da_reader_file_header(reader) != 0)
+        {
+            return status != 0 ? status : -1;
+        }
+    }
+    size_t header_start = reader->data_offset - DA_HANDLE_OFFSET;
+    char zeros[64];
+    while (reader->offset < header_start)
+    {
+        size_t n = header_start - reader->offset;
+        size_t done = 0;
+        n = n < sizeof(zeros) ? n : sizeof(zeros);
+        status = _da_read_some(fd, zeros, n, &done);
+        reader->offset += done;
+        if (status != 0)
+        {
+            return status;
+        }
+    }
+    if (reader->darr == NULL)
+    {
+        size_t done = reader->offset - header_start;
+        status = _da_read_some(fd, reader->header, DA_HANDLE_OFFSET, &done);
+        reader->offset = header_start + done;
+        if (status != 0 || _da_reader_header(reader) != 0)
+        {
+            return status != 0 ? status : -1;
+        }
+    }
+    size_t done = reader->offset - reader->data_offset;
+    status = _da_read_some(fd, reader->darr,
+        da_length(reader->darr)*reader->size, &done);
+    reader->offset = reader->data_offset + done;
+    if (status != 0)
+    {
+        return status;
+    }
+    *darr = reader->darr;
+    reader->darr = NULL;
+    reader->offset = 0;
+    return 0;
+}
+
+static inline void* da_read_fd(int fd, size_t size, const struct da_attr* attr)
+{
+    struct da_reader reader;
+    void* darr = NULL;
+    da_reader_init(&reader, size, SIZE_MAX, attr);
+    if (da_reader_read(&reader, fd, &darr) != 0)
+    {
+        da_reader_destroy(&reader);
+        return NULL;
+    }
+    return darr;
+}
+#endif // DA_HAVE_FD_IO
+
+#ifdef DA_HAVE_MMAP
+// Mapped files cannot grow, so reallocation moves the darray onto the heap.
+// The new block has room in front to hold the darray header at the padding of
+// the file, which `_da_realloc` then corrects. From then on the darray belongs
+// to the default allocator.
+static inline void* _da_file_realloc(void* ctx, void* ptr, size_t old_size,
+    size_t new_size)
+{
+    (void)ctx;
+    (void)old_size;
+    struct _da_file_header* fheader = (struct _da_file_header*)ptr;
+    size_t padding = fheader->data_offset - DA_HANDLE_OFFSET;
+    size_t map_size = fheader->map_size;
+    size_t size = padding + new_size;
+    char* block = (char*)malloc(size);
+    if (block == NULL)
+    {
+        return NULL;
+    }
+    memcpy(block, ptr, size < map_size ? size : map_size);
+    void* darr = block + padding + DA_HANDLE_OFFSET;
+    *DA_P_ALLOCATOR_FROM_HANDLE(darr) = NULL;
+    munmap(ptr, map_size);
+    return block;
+}
+
+static inline void _da_file_free(void* ctx, void* ptr, size_t size)
+{
+    (void)ctx;
+    (void)size;
+    munmap(ptr, ((struct _da_file_header*)ptr)->map_size);
+}
+
+static inline const struct da_allocator* _da_file_allocator(void)
+{
+    static const struct da_allocator allocator =
+        {NULL, _da_file_realloc, _da_file_free, NULL};
+    return &allocator;
+}
+
+static inline void* da_map_file(const char* path, size_t size, size_t flags)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0
+        || (size_t)st.st_size < sizeof(struct _da_file_header) + DA_HANDLE_OFFSET)
+    {
+        close(fd);
+        return NULL;
+    }
+    size_t map_size = (size_t)st.st_size;
+    char* block = (char*)mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (block == (char*)MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    struct _da_file_header* fheader = (struct _da_file_header*)block;
+    size_t data_offset = (size_t)fheader->data_offset;
+    int valid = memcmp(fheader->magic, DA_FILE_MAGIC, sizeof(fheader->magic)) == 0
+        && fheader->version == DA_FILE_VERSION
+        && fheader->word_size == sizeof(size_t)
+        && fheader->header_size == DA_HANDLE_OFFSET
+        && data_offset >= sizeof(*fheader) + DA_HANDLE_OFFSET
+        && data_offset <= map_size;
+    void* darr = block + data_offset;
+    if (valid)
+    {
+        size_t align = da_alignment(darr);
+        size_t capacity = da_capacity(darr);
+        valid = da_sizeof_elem(darr) == size
+            && _da_is_pow2(align)
+            && align <= (size_t)sysconf(_SC_PAGESIZE)
+            && data_offset == _da_file_data_offset(align)
+            && *DA_P_PADDING_FROM_HANDLE(darr) == data_offset - DA_HANDLE_OFFSET
+            && da_length(darr) <= capacity
+            && !(da_flags(darr) & DA_FLAG_GAP)
+            && *DA_P_FRONT_FROM_HANDLE(darr) == 0
+            && (size == 0 || capacity <= (map_size - data_offset)/size);
+    }
+    if (!valid)
+    {
+        munmap(block, map_size);
+        return NULL;
+    }
+
+    fheader->map_size = map_size;
+    *DA_P_GROWTH_FROM_HANDLE(darr) = NULL;
+    *DA_P_ALLOCATOR_FROM_HANDLE(darr) = _da_file_allocator();
+    *DA_P_REFCOUNT_FROM_HANDLE(darr) = 1;
+    _DA_STATS_INIT(darr);
+    if (flags & DA_MAP_READONLY)
+    {
+        mprotect(block, map_size, PROT_READ);
+    }
+    return darr;
+}
+#endif // DA_HAVE_MMAP
+
+// Inline darrays are copied to the heap the first time they are reallocated,
+// and belong to the default allocator from then on. Like mapped files, the
+// copy keeps the header at its padding in `buf`, which `_da_realloc` then
+// corrects. That padding is not necessarily a multiple of sizeof(size_t), so
+// the allocator slot is written bytewise.
+static inline void* _da_inline_realloc(void* ctx, void* ptr, size_t old_size,
+    size_t new_size)
+{
+    (void)ctx;
+    size_t padding = _da_padding(ptr, DA_ALIGNMENT_DEFAULT);
+    char* block = (char*)malloc(padding + new_size);
+    if (block == NULL)
+    {
+        return NULL;
+    }
+    memcpy(block, ptr,
+        padding + (old_size < new_size ? old_size : new_size));
+    const struct da_allocator* allocator = NULL;
+    memcpy(block + padding + DA_ALLOCATOR_OFFSET, &allocator,
+        sizeof(allocator));
+    return block;
+}
+
+static inline void _da_inline_free(void* ctx, void* ptr, size_t size)
+{
+    (void)ctx;
+    (void)ptr;
+    (void)size;
+}
+
+static inline const struct da_allocator* _da_inline_allocator(void)
+{
+    static const struct da_allocator allocator =
+        {NULL, _da_inline_realloc, _da_inline_free, NULL};
+    return &allocator;
+}
+
+static inline void* da_init_inline(void* buf, size_t bufsize, size_t size)
+{
+    size_t padding = _da_padding(buf, DA_ALIGNMENT_DEFAULT);
+    if (size == 0 || bufsize < padding + DA_HANDLE_OFFSET)
+    {
+        return NULL;
+    }
+    void* darr = (char*)buf + padding + DA_HANDLE_OFFSET;
+    memset(DA_HEAD_FROM_HANDLE(darr), 0, DA_HANDLE_OFFSET);
+    *DA_P_SIZEOF_ELEM_FROM_HANDLE(darr) = size;
+    *DA_P_CAPACITY_FROM_HANDLE(darr)    =
+        (bufsize - padding - DA_HANDLE_OFFSET)/size;
+    *DA_P_ALIGNMENT_FROM_HANDLE(darr)   = DA_ALIGNMENT_DEFAULT;
+    *DA_P_PADDING_FROM_HANDLE(darr)     = padding;
+    *DA_P_ALLOCATOR_FROM_HANDLE(darr)   = _da_inline_allocator();
+    *DA_P_REFCOUNT_FROM_HANDLE(darr)    = 1;
+    _DA_STATS_INIT(darr);
+    return darr;
+}
+
+#define /* void* */_da_push(/* void* */darr, /* ELEM_TYPE */value)             \
+do                                                                             \
+{                                                                              \
+    _DA_STATS_CLOCK(__start);                                                  \
+    register size_t* __p_len = DA_P_LENGTH_FROM_HANDLE(darr);                  \
+    if (*__p_len == *DA_P_CAPACITY_FROM_HANDLE(darr) || _da_is_shared(darr))   \
+    {                                                                          \
+        (darr) = DA_HANDLE_CAST(darr, _da_grow((darr), *__p_len + 1));         \
+        __p_len  = DA_P_LENGTH_FROM_HANDLE(darr);                              \
+    }                                                                          \
+    (darr)[(*__p_len)++] = (value);                                            \
+    _DA_STATS_PUSH(darr, __start);                                             \
+}while(0)
+
+#define /* void* */_da_safe_push(/* void* */darr, /* ELEM_TYPE */value,        \
+    /* void* */backup)                                                         \
+do                                                                             \
+{                                                                              \
+    register size_t* __p_len = DA_P_LENGTH_FROM_HANDLE(darr);                  \
+    if (*__p_len == *DA_P_CAPACITY_FROM_HANDLE(darr) || _da_is_shared(darr))   \
+    {                                                                          \
+        (backup) = (darr);                                                     \
+        (darr) = DA_HANDLE_CAST(darr, _da_grow((darr), *__p_len + 1));         \
+        __p_len  = DA_P_LENGTH_FROM_HANDLE(darr);                              \
+        if ((darr) == NULL)                                                    \
+        {                                                                      \
+            /* Allocation failed, but we still have the original darray */     \
+            /* stored in the back backup variable. */                          \
+            break;                                                             \
+        }                                                                      \
+        /* Allocation succeeded continue on as normal. */                      \
+    }                                                                          \
+    (darr)[(*__p_len)++] = (value);                                            \
+}while(0)
+
+// A darray still shared after `_da_auto_shrink` could not be copied, and the
+// element is then read without being removed.
+#define /* ELEM_TYPE */_da_pop(/* void* */darr)                                \
+(                                                                              \
+    (darr) = DA_HANDLE_CAST(darr, _da_auto_shrink(darr)),                      \
+    _da_is_shared(darr)                                                        \
+        ? (darr)[*DA_P_LENGTH_FROM_HANDLE(darr) - 1]                           \
+        : (darr)[--(*DA_P_LENGTH_FROM_HANDLE(darr))]                           \
+)
+
+#define /* void */_da_insert(/* void* */darr, /* size_t */index,               \
+    /* ELEM_TYPE */value)                                                      \
+do                                                                             \
+{                                                                              \
+    register size_t* __p_len  = DA_P_LENGTH_FROM_HANDLE(darr);                 \
+    register size_t __index = (index);                                         \
+    if ((*__p_len) == (*DA_P_CAPACITY_FROM_HANDLE(darr))                       \
+        || _da_is_shared(darr))                                                \
+    {                                                                          \
+        (darr) = DA_HANDLE_CAST(darr, _da_grow((darr), *__p_len + 1));         \
+        __p_len = DA_P_LENGTH_FROM_HANDLE(darr);                               \
+    }                                                                          \
+    memmove(                                                                   \
+        (darr)+(__index)+1,                                                    \
+        (darr)+(__index),                                                      \
+        (*DA_P_SIZEOF_ELEM_FROM_HANDLE(darr))*((*__p_len)-(__index))           \
+    );                                                                         \
+    _DA_STATS_MOVED(darr,                                                      \
+        (*DA_P_SIZEOF_ELEM_FROM_HANDLE(darr))*((*__p_len)-(__index)));         \
+    (darr)[__index] = (value);                                                 \
+    (*__p_len)++;                                                              \
+    _DA_STATS_LENGTH(darr);                                                    \
+}while(0)
+
+#define _da_safe_insert(/* void* */darr, /* size_t */index,                    \
+    /* ELEM_TYPE*/value, /* void* */backup)                                    \
+do                                                                             \
+{                                                                              \
+    register size_t* __p_len  = DA_P_LENGTH_FROM_HANDLE(darr);                 \
+    register size_t __index = (index);                                         \
+    if ((*__p_len) == (*DA_P_CAPACITY_FROM_HANDLE(darr))                       \
+        || _da_is_shared(darr))                                                \
+    {                                                                          \
+        (backup) = (darr);                                                     \
+        (darr) = DA_HANDLE_CAST(darr, _da_grow((darr), *__p_len + 1));         \
+        if ((darr) == NULL)                                                    \
+        {                                                                      \
+            /* Allocation failed, but we still have the original darray */     \
+            /* stored in the back backup variable. */                          \
+            break;                                                             \
+        }                                                                      \
+        /* Allocation succeeded continue on as normal. */                      \
+        __p_len = DA_P_LENGTH_FROM_HANDLE(darr);                               \
+    }                                                                          \
+    memmove(                                                                   \
+        (darr)+(__index)+1,                                                    \
+        (darr)+(__index),                                                      \
+        (*DA_P_SIZEOF_ELEM_FROM_HANDLE(darr))*((*__p_len)-(__index))           \
+    );                                                                         \
+    _DA_STATS_MOVED(darr,                                                      \
+        (*DA_P_SIZEOF_ELEM_FROM_HANDLE(darr))*((*__p_len)-(__index)));         \
+    (darr)[__index] = (value);                                                 \
+    (*__p_len)++;                                                              \
+    _DA_STATS_LENGTH(darr);                                                    \
+}while(0)
+
+// The darray is shrunk (or copied if shared) before any element is moved. As
+// with `_da_pop`, a darray that is still shared is only read.
+#define /* ELEM_TYPE */_da_remove(/* void* */darr, /* size_t */index)          \
+(                                                                              \
+    (darr) = DA_HANDLE_CAST(darr, _da_auto_shrink(darr)),                      \
+    _da_is_shared(darr) ? (darr)[index] : (                                    \
+    (/* "then" paren(s) */                                                     \
+    /* move element to be removed to the back of the array */                  \
+    _da_remove_mem_mov(darr, index)                                            \
+    ), /* then */                                                              \
+    /* return darr[--length] (i.e the removed element) */                      \
+    (darr)[--(*DA_P_LENGTH_FROM_HANDLE(darr))]                                 \
+    )                                                                          \
+)
+
+#define /* ELEM_TYPE */_da_swap_remove(/* void* */darr, /* size_t */index)     \
+(                                                                              \
+    (darr) = DA_HANDLE_CAST(darr, _da_auto_shrink(darr)),                      \
+    _da_is_shared(darr) ? (darr)[index] : (                                    \
+    (/* "then" paren(s) */                                                     \
+    /* swap element to be removed with the last element */                     \
+    da_swap(darr, index, *DA_P_LENGTH_FROM_HANDLE(darr) - 1)                   \
+    ), /* then */                                                              \
+    /* return darr[--length] (i.e the removed element) */                      \
+    (darr)[--(*DA_P_LENGTH_FROM_HANDLE(darr))]                                 \
+    )                                                                          \
+)
+
+#define /* void */_da_fill(/* void* */darr, VALUE_TYPE, /* VALUE_TYPE */value) \
+    _da_fill_range(darr, VALUE_TYPE, value, 0, *DA_P_LENGTH_FROM_HANDLE(darr))
+
+// The first element of the range is assigned normally so that `value` is
+// converted to the element type, and is then used as the pattern for the rest.
+#define /* void */_da_fill_range(/* void* */darr, VALUE_TYPE,                  \
+    /* VALUE_TYPE */value, /* size_t */first, /* size_t */count)               \
+do                                                                             \
+{                                                                              \
+    size_t __first = (first);                                                  \
+    size_t __count = (count);                                                  \
+    VALUE_TYPE __value = (value);                                              \
+    if (__count == 0)                                                          \
+    {                                                                          \
+        break;                                                                 \
+    }                                                                          \
+    (darr)[__first] = (__value);                                               \
+    _da_fill_bytes((darr) + __first + 1, (darr) + __first,                     \
+        *DA_P_SIZEOF_ELEM_FROM_HANDLE(darr), __count - 1);                     \
+}while(0)
+
+#define _da_foreach(/* void* */darr, ELEM_TYPE, itername)                      \
+for (ELEM_TYPE* itername = darr;                                               \
+    itername < (darr) + da_length(darr);                                       \
+    itername++)                                                                \
+
+#define _da_foreachr(/* void* */darr, ELEM_TYPE, itername)                     \
+for (ELEM_TYPE* itername = &(darr)[da_length(darr)-1];                         \
+    itername >= (darr);                                                        \
+    itername--)                                                                \
+
+// The outer loops of the foreach variants below run once and only exist to
+// declare the hoisted bounds, so `break` in the body still ends the whole
+// foreach.
+#define _da_foreach_fast(/* void* */darr, ELEM_TYPE, itername)                 \
+for (ELEM_TYPE* __da_end_##itername = (darr) + da_length(darr);                \
+    __da_end_##itername != NULL;                                               \
+    __da_end_##itername = NULL)                                                \
+for (ELEM_TYPE* itername = (darr);                                             \
+    itername < __da_end_##itername;                                            \
+    itername++)                                                                \
+
+#define _da_foreach_prefetch(/* void* */darr, ELEM_TYPE, itername,             \
+    /* size_t */distance)                                                      \
+for (ELEM_TYPE* __da_end_##itername = (darr) + da_length(darr);                \
+    __da_end_##itername != NULL;                                               \
+    __da_end_##itername = NULL)                                                \
+for (ELEM_TYPE* itername = (darr);                                             \
+    itername < __da_end_##itername && (DA_PREFETCH(                            \
+        (size_t)(__da_end_##itername - itername) > (size_t)(distance)          \
+            ? itername + (distance) : itername), 1);                           \
+    itername++)                                                                \
+
+#define _da_foreach_chunk(/* void* */darr, ELEM_TYPE, chunkname, countname,    \
+    /* size_t */chunk_size)                                                    \
+for (size_t __da_left_##chunkname = da_length(darr),                           \
+        countname = __da_left_##chunkname < (chunk_size)                       \
+            ? __da_left_##chunkname : (chunk_size),                            \
+        __da_once_##chunkname = 1;                                             \
+    __da_once_##chunkname;                                                     \
+    __da_once_##chunkname = 0)                                                 \
+for (ELEM_TYPE* chunkname = (darr);                                            \
+    countname != 0;                                                            \
+    chunkname += countname,                                                    \
+        __da_left_##chunkname -= countname,                                    \
+        countname = __da_left_##chunkname < (chunk_size)                       \
+            ? __da_left_##chunkname : (chunk_size))                            \
+
+static inline void da_swap(void* darr, size_t index_a, size_t index_b)
+{
+    size_t size = da_sizeof_elem(darr);
+    _da_memswap(
+        ((char*)darr) + (index_a * size),
+        ((char*)darr) + (index_b * size),
+        size
+    );
+}
+
+static inline void da_swap_range(void* darr, size_t index_a, size_t index_b,
+    size_t count)
+{
+    size_t size = da_sizeof_elem(darr);
+    _da_memswap(
+        ((char*)darr) + (index_a * size),
+        ((char*)darr) + (index_b * size),
+        count * size
+    );
+}
+
+#ifdef DA_HAVE_ATOMICS
+// Segment `k` holds the `DA_CONCURRENT_FIRST_SEGMENT << k` slots starting at
+// `DA_CONCURRENT_FIRST_SEGMENT*((1 << k) - 1)`.
+static inline size_t _da_concurrent_segment_of(size_t index, size_t* offset)
+{
+    unsigned long long j = index/DA_CONCURRENT_FIRST_SEGMENT + 1;
+    size_t k = (size_t)(63 - __builtin_clzll(j));
+    *offset = index + DA_CONCURRENT_FIRST_SEGMENT
+        - ((size_t)DA_CONCURRENT_FIRST_SEGMENT << k);
+    return k;
+}
+
+static inline void _da_concurrent_segment_free(
+    struct _da_concurrent_segment* segment)
+{
+    da_free(segment->darr);
+    free(segment);
+}
+
+// Segment `k` of `cda`, allocated and installed if no other thread has done so
+// yet. Racing threads each allocate a segment, and all but the one whose
+// compare-and-swap succeeds free theirs again.
+static inline struct _da_concurrent_segment* _da_concurrent_segment(
+    struct da_concurrent* cda, size_t k)
+{
+    if (k >= DA_CONCURRENT_NSEGMENTS)
+    {
+        return NULL;
+    }
+    struct _da_concurrent_segment* segment =
+        __atomic_load_n(&cda->segments[k], __ATOMIC_ACQUIRE);
+    if (segment != NULL)
+    {
+        return segment;
+    }
+    if (__atomic_load_n(&cda->failed, __ATOMIC_RELAXED))
+    {
+        return NULL;
+    }
+    size_t nslots = (size_t)DA_CONCURRENT_FIRST_SEGMENT << k;
+    segment = (struct _da_concurrent_segment*)malloc(sizeof(*segment) + nslots);
+    void* darr = segment == NULL
+        ? NULL : _da_alloc_capacity(0, nslots, cda->elsz, &cda->attr);
+    if (darr == NULL)
+    {
+        free(segment);
+        __atomic_store_n(&cda->failed, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    segment->darr = darr;
+    segment->ready = (unsigned char*)(segment + 1);
+    memset(segment->ready, 0, nslots);
+    struct _da_concurrent_segment* expected = NULL;
+    if (!__atomic_compare_exchange_n(&cda->segments[k], &expected, segment, 0,
+        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+        _da_concurrent_segment_free(segment);
+        return expected;
+    }
+    return segment;
+}
+
+static inline int da_concurrent_init(struct da_concurrent* cda, size_t size,
+    const struct da_attr* attr)
+{
+    memset(cda, 0, sizeof(*cda));
+    if (attr != NULL)
+    {
+        cda->attr = *attr;
+    }
+    cda->elsz = size;
+    return _da_concurrent_segment(cda, 0) == NULL ? -1 : 0;
+}
+
+static inline void da_concurrent_destroy(struct da_concurrent* cda)
+{
+    for (size_t k = 0; k < DA_CONCURRENT_NSEGMENTS; ++k)
+    {
+        if (cda->segments[k] != NULL)
+        {
+            _da_concurrent_segment_free(cda->segments[k]);
+            cda->segments[k] = NULL;
+        }
+    }
+}
+
+static inline int da_concurrent_push(struct da_concurrent* cda,
+    const void* value)
+{
+    size_t index = __atomic_fetch_add(&cda->reserved, 1, __ATOMIC_RELAXED);
+    size_t offset;
+    struct _da_concurrent_segment* segment =
+        _da_concurrent_segment(cda, _da_concurrent_segment_of(index, &offset));
+    if (segment == NULL)
+    {
+        return -1;
+    }
+    memcpy((char*)segment->darr + offset*cda->elsz, value, cda->elsz);
+    __atomic_store_n(&segment->ready[offset], 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// The committed prefix only ever grows, so a reader that saw fewer ready slots
+// than another leaves the larger value in place.
+static inline size_t da_concurrent_snapshot(struct da_concurrent* cda)
+{
+    size_t committed = __atomic_load_n(&cda->committed, __ATOMIC_ACQUIRE);
+    size_t length = committed;
+    for (;;)
+    {
+        size_t offset;
+        size_t k = _da_concurrent_segment_of(length, &offset);
+        struct _da_concurrent_segment* segment = k < DA_CONCURRENT_NSEGMENTS
+            ? __atomic_load_n(&cda->segments[k], __ATOMIC_ACQUIRE) : NULL;
+        if (segment == NULL
+            || !__atomic_load_n(&segment->ready[offset], __ATOMIC_ACQUIRE))
+        {
+            break;
+        }
+        ++length;
+    }
+    while (length > committed
+        && !__atomic_compare_exchange_n(&cda->committed, &committed, length, 1,
+            __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+    {
+    }
+    return length;
+}
+
+static inline void* da_concurrent_at(struct da_concurrent* cda, size_t index)
+{
+    size_t offset;
+    size_t k = _da_concurrent_segment_of(index, &offset);
+    struct _da_concurrent_segment* segment =
+        __atomic_load_n(&cda->segments[k], __ATOMIC_ACQUIRE);
+    return (char*)segment->darr + offset*cda->elsz;
+}
+
+static inline void* da_concurrent_release(struct da_concurrent* cda)
+{
+    size_t length = da_concurrent_snapshot(cda);
+    void* darr;
+    if (length <= DA_CONCURRENT_FIRST_SEGMENT)
+    {
+        // The first segment is handed over as is.
+        darr = cda->segments[0]->darr;
+        *DA_P_LENGTH_FROM_HANDLE(darr) = length;
+        free(cda->segments[0]);
+        cda->segments[0] = NULL;
+    }
+    else
+    {
+        darr = _da_alloc_capacity(length, length, cda->elsz, &cda->attr);
+        for (size_t k = 0, start = 0; darr != NULL && start < length; ++k)
+        {
+            size_t nslots = (size_t)DA_CONCURRENT_FIRST_SEGMENT << k;
+            size_t count = length - start < nslots ? length - start : nslots;
+            memcpy((char*)darr + start*cda->elsz, cda->segments[k]->darr,
+                count*cda->elsz);
+            start += count;
+        }
+    }
+    da_concurrent_destroy(cda);
+    return darr;
+}
+
+static inline void da_shared_lock(struct da_shared* shared)
+{
+    unsigned spins = 0;
+    while (__atomic_exchange_n(&shared->lock, 1, __ATOMIC_ACQUIRE))
+    {
+        while (__atomic_load_n(&shared->lock, __ATOMIC_RELAXED))
+        {
+            _da_spin(&spins);
+        }
+    }
+}
+
+static inline void da_shared_unlock(struct da_shared* shared)
+{
+    __atomic_store_n(&shared->lock, 0, __ATOMIC_RELEASE);
+}
+
+static inline int da_batch_init(struct da_batch* batch,
+    struct da_shared* shared, size_t size, size_t nelem)
+{
+    batch->shared = shared;
+    batch->buffer = _da_alloc_capacity(0, nelem == 0 ? 1 : nelem, size, NULL);
+    return batch->buffer == NULL ? -1 : 0;
+}
+
+static inline int da_batch_destroy(struct da_batch* batch)
+{
+    int status = da_batch_flush(batch);
+    da_free(batch->buffer);
+    batch->buffer = NULL;
+    return status;
+}
+
+static inline int da_batch_push(struct da_batch* batch, const void* value)
+{
+    void* buffer = batch->buffer;
+    size_t* p_len = DA_P_LENGTH_FROM_HANDLE(buffer);
+    if (*p_len == da_capacity(buffer))
+    {
+        if (da_batch_flush(batch) != 0)
+        {
+            return -1;
+        }
+    }
+    size_t elsz = da_sizeof_elem(buffer);
+    memcpy((char*)buffer + (*p_len)++*elsz, value, elsz);
+    return 0;
+}
+
+static inline int da_batch_flush(struct da_batch* batch)
+{
+    size_t* p_count = DA_P_LENGTH_FROM_HANDLE(batch->buffer);
+    size_t count = *p_count;
+    if (count == 0)
+    {
+        return 0;
+    }
+    struct da_shared* shared = batch->shared;
+    da_shared_lock(shared);
+    void* darr = da_append(shared->darr, batch->buffer, count);
+    if (darr == NULL)
+    {
+        da_shared_unlock(shared);
+        return -1;
+    }
+    shared->darr = darr;
+    da_shared_unlock(shared);
+    *p_count = 0;
+    return 0;
+}
+#endif // DA_HAVE_ATOMICS
+
+#ifdef DA_HAVE_THREADS
+// Aim for this many chunks per thread, so that threads finishing early have
+// work left to pick up.
+#define DA_PARALLEL_CHUNKS_PER_THREAD 8
+// Minimum number of bytes in a chunk, amortizing the cost of claiming it.
+#define DA_PARALLEL_CHUNK_MIN 4096
+
+struct _da_parallel_job
+{
+    void* darr;
+    size_t length;
+    // Chunk 0 is [0, first), chunk k is [first + (k-1)*chunk, first + k*chunk).
+    size_t first;
+    size_t chunk;
+    size_t nchunks;
+    size_t next;
+    da_range_fn fn;
+    da_reduce_fn reduce;
+    void* ctx;
+};
+
+struct _da_parallel_worker
+{
+    struct _da_parallel_job* job;
+    void* acc;
+};
+
+static inline void* _da_parallel_run(void* arg)
+{
+    struct _da_parallel_worker* worker = (struct _da_parallel_worker*)arg;
+    struct _da_parallel_job* job = worker->job;
+    size_t k;
+    while ((k = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED))
+        < job->nchunks)
+    {
+        size_t begin = k == 0 ? 0 : job->first + (k - 1)*job->chunk;
+        size_t end = k == 0 ? job->first : begin + job->chunk;
+        end = end > job->length ? job->length : end;
+        if (begin >= end)
+        {
+            continue;
+        }
+        if (job->reduce != NULL)
+        {
+            job->reduce(worker->acc, job->darr, begin, end, job->ctx);
+        }
+        else
+        {
+            job->fn(job->darr, begin, end, job->ctx);
+        }
+    }
+    return NULL;
+}
+
+// Run `task` once for each of the `ntasks` argument structs of size `argsz` in
+// `args`, one thread per task. The calling thread runs the first task. Tasks
+// whose thread could not be created run on the calling thread.
+static inline void _da_run_tasks(void* (*task)(void*), void* args,
+    size_t argsz, size_t ntasks)
+{
+    pthread_t* threads = ntasks > 1
+        ? (pthread_t*)malloc((ntasks - 1)*sizeof(pthread_t)) : NULL;
+    int* started = ntasks > 1 ? (int*)calloc(ntasks, sizeof(int)) : NULL;
+    for (size_t i = 1; i < ntasks; ++i)
+    {
+        if (threads != NULL && started != NULL)
+        {
+            started[i] = pthread_create(&threads[i - 1], NULL, task,
+                (char*)args + i*argsz) == 0;
+        }
+    }
+    if (ntasks != 0)
+    {
+        task(args);
+    }
+    for (size_t i = 1; i < ntasks; ++i)
+    {
+        if (started != NULL && started[i])
+        {
+            pthread_join(threads[i - 1], NULL);
+        }
+        else
+        {
+            task((char*)args + i*argsz);
+        }
+    }
+    free(threads);
+    free(started);
+}
+
+static inline size_t _da_gcd(size_t a, size_t b)
+{
+    while (b != 0)
+    {
+        size_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Split `darr` into chunks for `nthreads` threads and return the number of
+// threads actually worth running.
+static inline size_t _da_parallel_plan(struct _da_parallel_job* job,
+    void* darr, size_t nthreads)
+{
+    size_t elsz = da_sizeof_elem(darr);
+    size_t length = da_length(darr);
+    if (nthreads == 0)
+    {
+        long nproc = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = nproc < 1 ? 1 : (size_t)nproc;
+    }
+
+    // Element addresses repeat their offset within a cache line every `step`
+    // elements. Chunks are a multiple of `step` long, starting at the first
+    // element that begins a cache line.
+    size_t step = elsz == 0
+        ? 1 : DA_CACHE_LINE_SIZE/_da_gcd(elsz, DA_CACHE_LINE_SIZE);
+    size_t first = 0;
+    for (size_t i = 0; i < step && i < length; ++i)
+    {
+        if (((uintptr_t)darr + i*elsz) % DA_CACHE_LINE_SIZE == 0)
+        {
+            first = i;
+            break;
+        }
+    }
+    size_t chunk = length/(nthreads*DA_PARALLEL_CHUNKS_PER_THREAD);
+    size_t chunk_min = elsz == 0 ? 1 : DA_PARALLEL_CHUNK_MIN/elsz;
+    chunk = chunk < chunk_min ? chunk_min : chunk;
+    chunk = (chunk + step - 1)/step*step;
+
+    job->darr = darr;
+    job->length = length;
+    job->first = first;
+    job->chunk = chunk;
+    job->nchunks = 1 + (length - first + chunk - 1)/chunk;
+    job->next = 0;
+    return nthreads < job->nchunks ? nthreads : job->nchunks;
+}
+
+// Run `job` on `nthreads` threads, the calling thread being worker 0.
+static inline void _da_parallel_exec(struct _da_parallel_worker* workers,
+    size_t nthreads)
+{
+    pthread_t* threads = nthreads > 1
+        ? (pthread_t*)malloc((nthreads - 1)*sizeof(pthread_t)) : NULL;
+    size_t started = 0;
+    if (threads != NULL)
+    {
+        while (started < nthreads - 1 && pthread_create(&threads[started],
+            NULL, _da_parallel_run, &workers[started + 1]) == 0)
+        {
+            ++started;
+        }
+    }
+    _da_parallel_run(&workers[0]);
+    for (size_t i = 0; i < started; ++i)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+}
+
+static inline void da_parallel_for(void* darr, size_t nthreads, da_range_fn fn,
+    void* ctx)
+{
+    struct _da_parallel_job job;
+    nthreads = _da_parallel_plan(&job, darr, nthreads);
+    job.fn = fn;
+    job.reduce = NULL;
+    job.ctx = ctx;
+    struct _da_parallel_worker single = {&job, NULL};
+    struct _da_parallel_worker* workers = nthreads > 1
+        ? (struct _da_parallel_worker*)malloc(
+            nthreads*sizeof(struct _da_parallel_worker))
+        : NULL;
+    if (workers == NULL)
+    {
+        _da_parallel_run(&single);
+        return;
+    }
+    for (size_t i = 0; i < nthreads; ++i)
+    {
+        workers[i].job = &job;
+        workers[i].acc = NULL;
+    }
+    _da_parallel_exec(workers, nthreads);
+    free(workers);
+}
+
+static inline int da_parallel_reduce(void* darr, size_t nthreads,
+    da_reduce_fn reduce, da_combine_fn combine, const void* identity,
+    void* result, size_t acc_size, void* ctx)
+{
+    struct _da_parallel_job job;
+    nthreads = _da_parallel_plan(&job, darr, nthreads);
+    job.fn = NULL;
+    job.reduce = reduce;
+    job.ctx = ctx;
+
+    // Every accumulator gets cache lines of its own.
+    size_t stride = (acc_size + DA_CACHE_LINE_SIZE - 1)
+        / DA_CACHE_LINE_SIZE*DA_CACHE_LINE_SIZE;
+    struct _da_parallel_worker* workers = (struct _da_parallel_worker*)malloc(
+        nthreads*sizeof(struct _da_parallel_worker));
+    char* accs = (char*)malloc(nthreads*stride + DA_CACHE_LINE_SIZE);
+    if (workers == NULL || accs == NULL)
+    {
+        free(workers);
+        free(accs);
+        return -1;
+    }
+    char* acc = accs + (DA_CACHE_LINE_SIZE
+        - ((uintptr_t)accs & (DA_CACHE_LINE_SIZE - 1)));
+    for (size_t i = 0; i < nthreads; ++i)
+    {
+        workers[i].job = &job;
+        workers[i].acc = acc + i*stride;
+        memcpy(workers[i].acc, identity, acc_size);
+    }
+    _da_parallel_exec(workers, nthreads);
+    for (size_t i = 1; i < nthreads; ++i)
+    {
+        combine(workers[0].acc, workers[i].acc, ctx);
+    }
+    memcpy(result, workers[0].acc, acc_size);
+    free(workers);
+    free(accs);
+    return 0;
+}
+#endif // DA_HAVE_THREADS
+
+// Ranges at most this long are finished off with insertion sort.
+#define DA_SORT_INSERTION_THRESHOLD 16
+
+// Recursion depth after which introsort switches to heapsort.
+static inline size_t _da_sort_depth(size_t n)
+{
+    size_t depth = 0;
+    while (n > 1)
+    {
+        n >>= 1;
+        depth += 2;
+    }
+    return depth;
+}
+
+static inline void _da_sift_down(char* base, size_t root, size_t n,
+    size_t elsz, int (*cmp)(const void*, const void*))
+{
+    size_t child;
+    while ((child = 2*root + 1) < n)
+    {
+        if (child + 1 < n && cmp(base + child*elsz, base + (child + 1)*elsz) < 0)
+        {
+            ++child;
+        }
+        if (cmp(base + root*elsz, base + child*elsz) >= 0)
+        {
+            return;
+        }
+        _da_memswap(base + root*elsz, base + child*elsz, elsz);
+        root = child;
+    }
+}
 
-#define DA_HEAD_FROM_HANDLE(darr_h) \
-    (((char*)(darr_h)) - DA_HANDLE_OFFSET)
-#define DA_P_SIZEOF_ELEM_FROM_HANDLE(darr_h) \
-    ((size_t*)(DA_HEAD_FROM_HANDLE(darr_h) + DA_SIZEOF_ELEM_OFFSET))
-#define DA_P_LENGTH_FROM_HANDLE(darr_h) \
-    ((size_t*)(DA_HEAD_FROM_HANDLE(darr_h) + DA_LENGTH_OFFSET))
-#define DA_P_CAPACITY_FROM_HANDLE(darr_h) \
-    ((size_t*)(DA_HEAD_FROM_HANDLE(darr_h) + DA_CAPACITY_OFFSET))
+static inline void _da_introsort(char* base, size_t n, size_t elsz,
+    int (*cmp)(const void*, const void*), size_t depth)
+{
+    while (n > DA_SORT_INSERTION_THRESHOLD)
+    {
+        if (depth-- == 0)
+        {
+            for (size_t i = n/2; i-- > 0;)
+            {
+                _da_sift_down(base, i, n, elsz, cmp);
+            }
+            for (size_t i = n - 1; i > 0; --i)
+            {
+                _da_memswap(base, base + i*elsz, elsz);
+                _da_sift_down(base, 0, i, elsz, cmp);
+            }
+            return;
+        }
 
-#define DA_CAPACITY_FACTOR 1.3
-#define DA_CAPACITY_MIN 10
-#define DA_NEW_CAPACITY_FROM_LENGTH(length) \
-    (length < DA_CAPACITY_MIN ? DA_CAPACITY_MIN : (length*DA_CAPACITY_FACTOR))
+        // Move the median of the first, middle and last elements to the front
+        // to serve as the pivot. It stays there until partitioning is done.
+        char* mid = base + (n/2)*elsz;
+        char* last = base + (n - 1)*elsz;
+        if (cmp(mid, base) < 0)
+        {
+            _da_memswap(mid, base, elsz);
+        }
+        if (cmp(last, mid) < 0)
+        {
+            _da_memswap(last, mid, elsz);
+            if (cmp(mid, base) < 0)
+            {
+                _da_memswap(mid, base, elsz);
+            }
+        }
+        _da_memswap(base, mid, elsz);
 
-static inline void _da_memswap(void* p1, void* p2, size_t sz)
+        size_t i = 0;
+        size_t j = n;
+        for (;;)
+        {
+            do { ++i; } while (i < n && cmp(base + i*elsz, base) < 0);
+            do { --j; } while (cmp(base, base + j*elsz) < 0);
+            if (i >= j)
+            {
+                break;
+            }
+            _da_memswap(base + i*elsz, base + j*elsz, elsz);
+        }
+        _da_memswap(base, base + j*elsz, elsz);
+
+        // Recurse into the smaller side to bound the stack depth.
+        if (j < n - j - 1)
+        {
+            _da_introsort(base, j, elsz, cmp, depth);
+            base += (j + 1)*elsz;
+            n -= j + 1;
+        }
+        else
+        {
+            _da_introsort(base + (j + 1)*elsz, n - j - 1, elsz, cmp, depth);
+            n = j;
+        }
+    }
+    for (size_t i = 1; i < n; ++i)
+    {
+        for (size_t j = i; j > 0
+            && cmp(base + j*elsz, base + (j - 1)*elsz) < 0; --j)
+        {
+            _da_memswap(base + j*elsz, base + (j - 1)*elsz, elsz);
+        }
+    }
+}
+
+static inline void da_sort(void* darr, int (*cmp)(const void*, const void*))
 {
-    char tmp, *a = p1, *b = p2;
-    for (size_t i = 0; i < sz; ++i)
+    size_t n = da_length(darr);
+    _da_introsort((char*)darr, n, da_sizeof_elem(darr), cmp, _da_sort_depth(n));
+}
+
+static inline size_t da_lower_bound(void* darr, const void* key,
+    int (*cmp)(const void*, const void*))
+{
+    size_t n = da_length(darr);
+    size_t elsz = da_sizeof_elem(darr);
+    const char* base = (const char*)darr;
+    if (n == 0)
     {
-        tmp = a[i];
-        a[i] = b[i];
-        b[i] = tmp;
+        return 0;
+    }
+    // The answer lies within [base, base + n]. Each step halves n without a
+    // branch on the result of the comparison.
+    while (n > 1)
+    {
+        size_t half = n/2;
+        DA_PREFETCH(base + (half/2)*elsz);
+        DA_PREFETCH(base + (half + half/2)*elsz);
+        base = cmp(base + half*elsz, key) < 0 ? base + half*elsz : base;
+        n -= half;
     }
+    return (size_t)(base - (const char*)darr)/elsz + (cmp(base, key) < 0);
 }
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wreturn-type"
-// Performes the following transform:
-// [0][1][2][3][rest...] => [0][2][3][1][rest...]
-//     ^                              ^
-//     target index                   target moved to back
-static inline int _da_remove_mem_mov(void* darr, size_t target_index)
-{
-    register size_t length = da_length(darr);
-    register size_t elsz = da_sizeof_elem(darr);
-
-    // Try and use a temporary bit of memory for storage.
-    register void* tmp = malloc(elsz);
-    // If the memory is avaliable then run the fast version of the algorithm
-    // using memcpy and memmove.
-    if (tmp != NULL)
-    {
-        memcpy(tmp, (char*)darr + target_index*elsz, elsz); // tmp = arr[target]
-        memmove(
-            (char*)darr + target_index*elsz,
-            (char*)darr + (target_index+1)*elsz,
-            elsz*(length-target_index-1)
-        );
-        memcpy((char*)darr + (length-1)*elsz, tmp, elsz); // arr[length-1] = tmp
-        free(tmp);
-    }
-    // If the memory is NOT avaliable then run the slow, but alloc-free version
-    // of the algorithm using memory swapping.
-    else
+static inline size_t da_upper_bound(void* darr, const void* key,
+    int (*cmp)(const void*, const void*))
+{
+    size_t n = da_length(darr);
+    size_t elsz = da_sizeof_elem(darr);
+    const char* base = (const char*)darr;
+    if (n == 0)
     {
-        register char* p_curr = (char*)darr + (target_index * elsz);
-        register char* p_last = (char*)darr + ((length-1) * elsz);
-        // Swap target and last elements.
-        // [0][1][2][3][4][rest...] => [0][4][2][3][1][rest...]
-        _da_memswap(p_curr, p_last, elsz);
-        // Bubble the "new" target element (previously last element) to the back
-        // [0][4][2][3][1][rest...] => [0][3][2][4][1][rest...]
-        // [0][3][2][4][1][rest...] => [0][2][3][4][1][rest...]
-        while ((p_curr += elsz) < p_last)
-        {
-            _da_memswap(
-                p_curr,
-                p_curr - elsz, // element before curr
-                elsz
-            );
-        }
+        return 0;
+    }
+    while (n > 1)
+    {
+        size_t half = n/2;
+        DA_PREFETCH(base + (half/2)*elsz);
+        DA_PREFETCH(base + (half + half/2)*elsz);
+        base = cmp(key, base + half*elsz) >= 0 ? base + half*elsz : base;
+        n -= half;
     }
+    return (size_t)(base - (const char*)darr)/elsz + (cmp(key, base) >= 0);
 }
-#pragma GCC diagnostic pop
 
-static inline void* da_alloc(size_t nelem, size_t size)
+static inline void* da_insert_sorted(void* darr, const void* value,
+    int (*cmp)(const void*, const void*))
 {
-    size_t capacity = DA_NEW_CAPACITY_FROM_LENGTH(nelem);
-    void* mem = malloc(capacity*size + DA_HANDLE_OFFSET);
-    if (mem == NULL)
+    return da_insert_n(darr, da_upper_bound(darr, value, cmp), value, 1);
+}
+
+static inline int da_remove_sorted(void* darr, const void* key,
+    int (*cmp)(const void*, const void*))
+{
+    if (_da_is_shared(darr))
+    {
+        return -1;
+    }
+    size_t index = da_lower_bound(darr, key, cmp);
+    if (index == da_length(darr)
+        || cmp((char*)darr + index*da_sizeof_elem(darr), key) != 0)
     {
-        return mem;
+        return 0;
     }
-    (*(size_t*)((char*)mem + DA_SIZEOF_ELEM_OFFSET)) = size;
-    (*(size_t*)((char*)mem + DA_LENGTH_OFFSET))      = nelem;
-    (*(size_t*)((char*)mem + DA_CAPACITY_OFFSET))    = capacity;
-    return (char*)mem + DA_HANDLE_OFFSET;
+    da_remove_range(darr, index, 1);
+    return 1;
 }
 
-static inline void da_free(void* darr)
+static inline void* da_merge_sorted(void* darr, const void* src, size_t n,
+    int (*cmp)(const void*, const void*))
 {
-    free(DA_HEAD_FROM_HANDLE(darr));
+    darr = da_reserve(darr, n);
+    if (darr == NULL)
+    {
+        return NULL;
+    }
+    size_t* p_len = DA_P_LENGTH_FROM_HANDLE(darr);
+    size_t elsz = da_sizeof_elem(darr);
+    char* dst = (char*)darr;
+    const char* from = (const char*)src;
+    // Fill the merged darray from its end. Elements of `darr` before the
+    // insertion point of src[0] are never touched.
+    size_t i = *p_len;
+    size_t j = n;
+    size_t out = *p_len + n;
+    while (j > 0)
+    {
+        --out;
+        if (i > 0 && cmp(dst + (i - 1)*elsz, from + (j - 1)*elsz) > 0)
+        {
+            memcpy(dst + out*elsz, dst + (--i)*elsz, elsz);
+        }
+        else
+        {
+            memcpy(dst + out*elsz, from + (--j)*elsz, elsz);
+        }
+    }
+    *p_len += n;
+    return darr;
 }
 
-static inline size_t da_length(void* darr)
+// Radix key of the element at `p`: the element's bits rearranged so that
+// comparing keys as unsigned integers orders the elements.
+static inline uint64_t _da_radix_key(const void* p, size_t elsz,
+    enum da_sort_key key)
 {
-    return *DA_P_LENGTH_FROM_HANDLE(darr);
+    uint64_t bits = 0;
+    switch (elsz)
+    {
+    case 1: bits = *(const uint8_t*)p; break;
+    case 2: { uint16_t v; memcpy(&v, p, 2); bits = v; } break;
+    case 4: { uint32_t v; memcpy(&v, p, 4); bits = v; } break;
+    case 8: memcpy(&bits, p, 8); break;
+    }
+    uint64_t sign = (uint64_t)1 << (elsz*8 - 1);
+    uint64_t mask = sign | (sign - 1);
+    if (key == DA_SORT_SIGNED)
+    {
+        bits ^= sign;
+    }
+    else if (key == DA_SORT_FLOAT)
+    {
+        bits ^= (bits & sign) ? mask : sign;
+    }
+    return bits;
 }
 
-static inline size_t da_capacity(void* darr)
+static inline int da_sort_radix(void* darr, enum da_sort_key key)
 {
-    return *DA_P_CAPACITY_FROM_HANDLE(darr);
+    size_t elsz = da_sizeof_elem(darr);
+    size_t n = da_length(darr);
+    int supported = key == DA_SORT_FLOAT
+        ? (elsz == sizeof(float) || elsz == sizeof(double))
+        : (elsz == 1 || elsz == 2 || elsz == 4 || elsz == 8);
+    if (!supported)
+    {
+        return -1;
+    }
+    if (n < 2)
+    {
+        return 0;
+    }
+    // The scratch buffer is followed by the digit of every element in the
+    // current pass, so each key is computed once per pass.
+    char* scratch = (char*)malloc(n*elsz + n);
+    if (scratch == NULL)
+    {
+        return -1;
+    }
+    uint8_t* digits = (uint8_t*)(scratch + n*elsz);
+    char* src = (char*)darr;
+    char* dst = scratch;
+    for (size_t byte = 0; byte < elsz; ++byte)
+    {
+        size_t counts[256] = {0};
+        size_t shift = byte*8;
+        for (size_t i = 0; i < n; ++i)
+        {
+            uint8_t digit = (uint8_t)(_da_radix_key(src + i*elsz, elsz, key)
+                >> shift);
+            digits[i] = digit;
+            ++counts[digit];
+        }
+        // Every element agrees on this byte, so the pass would be a copy.
+        if (counts[digits[0]] == n)
+        {
+            continue;
+        }
+        size_t offset = 0;
+        for (size_t b = 0; b < 256; ++b)
+        {
+            size_t count = counts[b];
+            counts[b] = offset;
+            offset += count;
+        }
+        for (size_t i = 0; i < n; ++i)
+        {
+            memcpy(dst + (counts[digits[i]]++)*elsz, src + i*elsz, elsz);
+        }
+        char* tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+    if (src != (char*)darr)
+    {
+        memcpy(darr, src, n*elsz);
+    }
+    free(scratch);
+    return 0;
 }
 
-static inline size_t da_sizeof_elem(void* darr)
+#ifdef DA_HAVE_THREADS
+struct _da_sort_task
 {
-    return *DA_P_SIZEOF_ELEM_FROM_HANDLE(darr);
+    char* src;
+    char* dst;
+    // Runs [begin, mid) and [mid, end) of `src` are merged into `dst`. When
+    // sorting a slice, `mid` is unused and `dst` is scratch space.
+    size_t begin;
+    size_t mid;
+    size_t end;
+    size_t elsz;
+    int (*cmp)(const void*, const void*);
+};
+
+// Merge two sorted runs of `src` into `dst`, taking from the left run on
+// ties to keep the merge stable.
+static inline void* _da_sort_merge(void* arg)
+{
+    struct _da_sort_task* t = (struct _da_sort_task*)arg;
+    size_t elsz = t->elsz;
+    char* a = t->src + t->begin*elsz;
+    char* a_end = t->src + t->mid*elsz;
+    char* b = a_end;
+    char* b_end = t->src + t->end*elsz;
+    char* out = t->dst + t->begin*elsz;
+    while (a < a_end && b < b_end)
+    {
+        if (t->cmp(b, a) < 0)
+        {
+            memcpy(out, b, elsz);
+            b += elsz;
+        }
+        else
+        {
+            memcpy(out, a, elsz);
+            a += elsz;
+        }
+        out += elsz;
+    }
+    memcpy(out, a, a_end - a);
+    memcpy(out + (a_end - a), b, b_end - b);
+    return NULL;
 }
 
-static inline void* da_resize(void* darr, size_t nelem)
+// Stable merge sort of the slice [begin, end) of `src`, using the same slice
+// of `dst` as scratch space. The sorted slice ends up back in `src`.
+static inline void* _da_sort_slice(void* arg)
 {
-    size_t new_capacity = DA_NEW_CAPACITY_FROM_LENGTH(nelem);
-    void* ptr = realloc(DA_HEAD_FROM_HANDLE(darr),
-        new_capacity*da_sizeof_elem(darr) + DA_HANDLE_OFFSET);
-    if (ptr == NULL)
+    struct _da_sort_task* t = (struct _da_sort_task*)arg;
+    size_t elsz = t->elsz;
+    char* base = t->src + t->begin*elsz;
+    size_t n = t->end - t->begin;
+    for (size_t run = 0; run < n; run += DA_SORT_INSERTION_THRESHOLD)
     {
-        return NULL;
+        size_t run_end = run + DA_SORT_INSERTION_THRESHOLD < n
+            ? run + DA_SORT_INSERTION_THRESHOLD : n;
+        for (size_t i = run + 1; i < run_end; ++i)
+        {
+            for (size_t j = i; j > run
+                && t->cmp(base + j*elsz, base + (j - 1)*elsz) < 0; --j)
+            {
+                _da_memswap(base + j*elsz, base + (j - 1)*elsz, elsz);
+            }
+        }
+    }
+    struct _da_sort_task merge = *t;
+    for (size_t width = DA_SORT_INSERTION_THRESHOLD; width < n; width *= 2)
+    {
+        for (size_t i = 0; i < n; i += 2*width)
+        {
+            merge.begin = t->begin + i;
+            merge.mid = t->begin + (i + width < n ? i + width : n);
+            merge.end = t->begin + (i + 2*width < n ? i + 2*width : n);
+            _da_sort_merge(&merge);
+        }
+        char* tmp = merge.src;
+        merge.src = merge.dst;
+        merge.dst = tmp;
+    }
+    if (merge.src != t->src)
+    {
+        memcpy(base, merge.src + t->begin*elsz, n*elsz);
     }
-    darr = ptr;
-    *((size_t*)((char*)ptr + DA_CAPACITY_OFFSET)) = new_capacity;
-    *((size_t*)((char*)ptr + DA_LENGTH_OFFSET))   = nelem;
-    return (char*)ptr + DA_HANDLE_OFFSET;
+    return NULL;
 }
 
-static inline void* da_reserve(void* darr, size_t nelem)
+static inline int da_sort_parallel(void* darr, size_t nthreads,
+    int (*cmp)(const void*, const void*))
 {
-    size_t curr_capacity = da_capacity(darr);
-    size_t curr_length = da_length(darr);
-    size_t min_capacity = curr_length + nelem;
-    if (curr_capacity >= min_capacity)
+    size_t elsz = da_sizeof_elem(darr);
+    size_t n = da_length(darr);
+    if (nthreads == 0)
     {
-        return darr;
+        long nproc = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = nproc < 1 ? 1 : (size_t)nproc;
     }
-    size_t new_capacity = DA_NEW_CAPACITY_FROM_LENGTH(min_capacity);
-    void* ptr = realloc(DA_HEAD_FROM_HANDLE(darr),
-        new_capacity*da_sizeof_elem(darr) + DA_HANDLE_OFFSET);
-    if (ptr == NULL)
+    // Slices shorter than a few pages aren't worth a thread.
+    size_t max_slices = elsz == 0 ? 1 : n*elsz/DA_PARALLEL_CHUNK_MIN;
+    nthreads = nthreads > max_slices ? max_slices : nthreads;
+    nthreads = nthreads == 0 ? 1 : nthreads;
+
+    char* scratch = (char*)malloc(n*elsz);
+    struct _da_sort_task* tasks = (struct _da_sort_task*)malloc(
+        nthreads*sizeof(struct _da_sort_task));
+    size_t* bounds = (size_t*)malloc((nthreads + 1)*sizeof(size_t));
+    if ((scratch == NULL && n*elsz != 0) || tasks == NULL || bounds == NULL)
     {
-        return NULL;
+        free(scratch);
+        free(tasks);
+        free(bounds);
+        return -1;
+    }
+
+    for (size_t i = 0; i <= nthreads; ++i)
+    {
+        bounds[i] = n/nthreads*i + (i < n%nthreads ? i : n%nthreads);
+    }
+    for (size_t i = 0; i < nthreads; ++i)
+    {
+        struct _da_sort_task task = {(char*)darr, scratch, bounds[i],
+            bounds[i + 1], bounds[i + 1], elsz, cmp};
+        tasks[i] = task;
+    }
+    _da_run_tasks(_da_sort_slice, tasks, sizeof(struct _da_sort_task), nthreads);
+
+    // Merge neighbouring runs in rounds, halving the number of runs each time.
+    char* src = (char*)darr;
+    char* dst = scratch;
+    for (size_t width = 1; width < nthreads; width *= 2)
+    {
+        size_t ntasks = 0;
+        for (size_t i = 0; i < nthreads; i += 2*width)
+        {
+            size_t mid = i + width < nthreads ? i + width : nthreads;
+            size_t end = i + 2*width < nthreads ? i + 2*width : nthreads;
+            struct _da_sort_task task = {src, dst, bounds[i], bounds[mid],
+                bounds[end], elsz, cmp};
+            tasks[ntasks++] = task;
+        }
+        _da_run_tasks(_da_sort_merge, tasks, sizeof(struct _da_sort_task),
+            ntasks);
+        char* tmp = src;
+        src = dst;
+        dst = tmp;
     }
-    *((size_t*)((char*)ptr + DA_CAPACITY_OFFSET)) = new_capacity;
-    return (char*)ptr + DA_HANDLE_OFFSET;
+    if (src != (char*)darr)
+    {
+        memcpy(darr, src, n*elsz);
+    }
+    free(scratch);
+    free(tasks);
+    free(bounds);
+    return 0;
 }
+#endif // DA_HAVE_THREADS
 
-#define /* void* */_da_push(/* void* */darr, /* ELEM_TYPE */value)             \
-do                                                                             \
+#define _DA_DECLARE_SORT(ELEM_TYPE, NAME, LESS)                                \
+static inline void NAME##_sift_down(ELEM_TYPE* a, size_t root, size_t n)       \
 {                                                                              \
-    register size_t* __p_len = DA_P_LENGTH_FROM_HANDLE(darr);                  \
-    if (*__p_len == *DA_P_CAPACITY_FROM_HANDLE(darr))                          \
+    ELEM_TYPE tmp = a[root];                                                   \
+    size_t child;                                                              \
+    while ((child = 2*root + 1) < n)                                           \
     {                                                                          \
-        (darr) = da_resize((darr), *__p_len);                                  \
-        __p_len  = DA_P_LENGTH_FROM_HANDLE(darr);                              \
+        if (child + 1 < n && LESS(a[child], a[child + 1]))                     \
+        {                                                                      \
+            ++child;                                                           \
+        }                                                                      \
+        if (!LESS(tmp, a[child]))                                              \
+        {                                                                      \
+            break;                                                             \
+        }                                                                      \
+        a[root] = a[child];                                                    \
+        root = child;                                                          \
     }                                                                          \
-    (darr)[(*__p_len)++] = (value);                                            \
-}while(0)
-
-#define /* void* */_da_safe_push(/* void* */darr, /* ELEM_TYPE */value,        \
-    /* void* */backup)                                                         \
-do                                                                             \
+    a[root] = tmp;                                                             \
+}                                                                              \
+                                                                               \
+static inline void NAME##_introsort(ELEM_TYPE* a, size_t n, size_t depth)      \
 {                                                                              \
-    register size_t* __p_len = DA_P_LENGTH_FROM_HANDLE(darr);                  \
-    if (*__p_len == *DA_P_CAPACITY_FROM_HANDLE(darr))                          \
+    ELEM_TYPE tmp;                                                             \
+    while (n > DA_SORT_INSERTION_THRESHOLD)                                    \
     {                                                                          \
-        (backup) = (darr);                                                     \
-        (darr) = da_resize((darr), *__p_len);                                  \
-        __p_len  = DA_P_LENGTH_FROM_HANDLE(darr);                              \
-        if ((darr) == NULL)                                                    \
+        if (depth-- == 0)                                                      \
         {                                                                      \
-            /* Allocation failed, but we still have the original darray */     \
-            /* stored in the back backup variable. */                          \
-            break;                                                             \
+            for (size_t i = n/2; i-- > 0;)                                     \
+            {                                                                  \
+                NAME##_sift_down(a, i, n);                                     \
+            }                                                                  \
+            for (size_t i = n - 1; i > 0; --i)                                 \
+            {                                                                  \
+                tmp = a[0]; a[0] = a[i]; a[i] = tmp;                           \
+                NAME##_sift_down(a, 0, i);                                     \
+            }                                                                  \
+            return;                                                            \
+        }                                                                      \
+        size_t mid = n/2;                                                      \
+        if (LESS(a[mid], a[0])) { tmp = a[mid]; a[mid] = a[0]; a[0] = tmp; }   \
+        if (LESS(a[n - 1], a[mid]))                                            \
+        {                                                                      \
+            tmp = a[n - 1]; a[n - 1] = a[mid]; a[mid] = tmp;                   \
+            if (LESS(a[mid], a[0])) { tmp = a[mid]; a[mid] = a[0]; a[0] = tmp; }\
+        }                                                                      \
+        ELEM_TYPE pivot = a[mid];                                              \
+        a[mid] = a[0];                                                         \
+        a[0] = pivot;                                                          \
+        size_t i = 0;                                                          \
+        size_t j = n;                                                          \
+        for (;;)                                                               \
+        {                                                                      \
+            do { ++i; } while (i < n && LESS(a[i], pivot));                    \
+            do { --j; } while (LESS(pivot, a[j]));                             \
+            if (i >= j)                                                        \
+            {                                                                  \
+                break;                                                         \
+            }                                                                  \
+            tmp = a[i]; a[i] = a[j]; a[j] = tmp;                               \
+        }                                                                      \
+        a[0] = a[j];                                                           \
+        a[j] = pivot;                                                          \
+        if (j < n - j - 1)                                                     \
+        {                                                                      \
+            NAME##_introsort(a, j, depth);                                     \
+            a += j + 1;                                                        \
+            n -= j + 1;                                                        \
+        }                                                                      \
+        else                                                                   \
+        {                                                                      \
+            NAME##_introsort(a + j + 1, n - j - 1, depth);                     \
+            n = j;                                                             \
         }                                                                      \
-        /* Allocation succeeded continue on as normal. */                      \
     }                                                                          \
-    (darr)[(*__p_len)++] = (value);                                            \
-}while(0)
-
-#define /* ELEM_TYPE */_da_pop(/* void* */darr)                                \
-(                                                                              \
-    (darr)[--(*DA_P_LENGTH_FROM_HANDLE(darr))]                                 \
-)
+    for (size_t i = 1; i < n; ++i)                                             \
+    {                                                                          \
+        tmp = a[i];                                                            \
+        size_t j = i;                                                          \
+        for (; j > 0 && LESS(tmp, a[j - 1]); --j)                              \
+        {                                                                      \
+            a[j] = a[j - 1];                                                   \
+        }                                                                      \
+        a[j] = tmp;                                                            \
+    }                                                                          \
+}                                                                              \
+                                                                               \
+static inline void NAME##_sort(ELEM_TYPE* darr)                                \
+{                                                                              \
+    size_t n = da_length(darr);                                                \
+    NAME##_introsort(darr, n, _da_sort_depth(n));                              \
+}
 
-#define /* void */_da_insert(/* void* */darr, /* size_t */index,               \
-    /* ELEM_TYPE */value)                                                      \
-do                                                                             \
+#define _DA_DECLARE_TYPED(ELEM_TYPE, NAME)                                     \
+static inline ELEM_TYPE* NAME##_alloc(size_t nelem)                            \
 {                                                                              \
-    register size_t* __p_len  = DA_P_LENGTH_FROM_HANDLE(darr);                 \
-    register size_t __index = (index);                                         \
-    if ((*__p_len) == (*DA_P_CAPACITY_FROM_HANDLE(darr)))                      \
+    return (ELEM_TYPE*)da_alloc(nelem, sizeof(ELEM_TYPE));                     \
+}                                                                              \
+                                                                               \
+static inline ELEM_TYPE* NAME##_push(ELEM_TYPE* darr, ELEM_TYPE value)         \
+{                                                                              \
+    size_t length = *DA_P_LENGTH_FROM_HANDLE(darr);                            \
+    if (length == *DA_P_CAPACITY_FROM_HANDLE(darr) || _da_is_shared(darr))     \
     {                                                                          \
-        (darr) = da_resize((darr), *__p_len);                                  \
-        __p_len = DA_P_LENGTH_FROM_HANDLE(darr);                               \
+        darr = (ELEM_TYPE*)_da_grow(darr, length + 1);                         \
+        if (darr == NULL)                                                      \
+        {                                                                      \
+            return NULL;                                                       \
+        }                                                                      \
     }                                                                          \
-    memmove(                                                                   \
-        (darr)+(__index)+1,                                                    \
-        (darr)+(__index),                                                      \
-        (*DA_P_SIZEOF_ELEM_FROM_HANDLE(darr))*((*__p_len)-(__index))           \
-    );                                                                         \
-    (darr)[__index] = (value);                                                 \
-    (*__p_len)++;                                                              \
-}while(0)
-
-#define _da_safe_insert(/* void* */darr, /* size_t */index,                    \
-    /* ELEM_TYPE*/value, /* void* */backup)                                    \
-do                                                                             \
+    darr[length] = value;                                                      \
+    *DA_P_LENGTH_FROM_HANDLE(darr) = length + 1;                               \
+    return darr;                                                               \
+}                                                                              \
+                                                                               \
+static inline ELEM_TYPE* NAME##_insert(ELEM_TYPE* darr, size_t index,          \
+    ELEM_TYPE value)                                                           \
 {                                                                              \
-    register size_t* __p_len  = DA_P_LENGTH_FROM_HANDLE(darr);                 \
-    register size_t __index = (index);                                         \
-    if ((*__p_len) == (*DA_P_CAPACITY_FROM_HANDLE(darr)))                      \
+    size_t length = *DA_P_LENGTH_FROM_HANDLE(darr);                            \
+    if (length == *DA_P_CAPACITY_FROM_HANDLE(darr) || _da_is_shared(darr))     \
     {                                                                          \
-        (backup) = (darr);                                                     \
-        (darr) = da_resize((darr), *__p_len);                                  \
-        if ((darr) == NULL)                                                    \
+        darr = (ELEM_TYPE*)_da_grow(darr, length + 1);                         \
+        if (darr == NULL)                                                      \
         {                                                                      \
-            /* Allocation failed, but we still have the original darray */     \
-            /* stored in the back backup variable. */                          \
-            break;                                                             \
+            return NULL;                                                       \
         }                                                                      \
-        /* Allocation succeeded continue on as normal. */                      \
-        __p_len = DA_P_LENGTH_FROM_HANDLE(darr);                               \
     }                                                                          \
-    memmove(                                                                   \
-        (darr)+(__index)+1,                                                    \
-        (darr)+(__index),                                                      \
-        (*DA_P_SIZEOF_ELEM_FROM_HANDLE(darr))*((*__p_len)-(__index))           \
-    );                                                                         \
-    (darr)[__index] = (value);                                                 \
-    (*__p_len)++;                                                              \
-}while(0)
-
-#define /* ELEM_TYPE */_da_remove(/* void* */darr, /* size_t */index)          \
-(                                                                              \
-    (/* "then" paren(s) */                                                     \
-    /* move element to be removed to the back of the array */                  \
-    _da_remove_mem_mov(darr, index)                                            \
-    ), /* then */                                                              \
-    /* return darr[--length] (i.e the removed element) */                      \
-    (darr)[--(*DA_P_LENGTH_FROM_HANDLE(darr))]                                 \
-)
-
-#define /* void */_da_fill(/* void* */darr, VALUE_TYPE, /* VALUE_TYPE */value) \
-do                                                                             \
+    memmove(darr + index + 1, darr + index,                                    \
+        (length - index)*sizeof(ELEM_TYPE));                                   \
+    darr[index] = value;                                                       \
+    *DA_P_LENGTH_FROM_HANDLE(darr) = length + 1;                               \
+    return darr;                                                               \
+}                                                                              \
+                                                                               \
+static inline ELEM_TYPE NAME##_pop(ELEM_TYPE** darr)                           \
 {                                                                              \
-    register size_t __len = *DA_P_LENGTH_FROM_HANDLE(darr);                    \
-    register VALUE_TYPE __value = (value);                                     \
-    for (size_t __i = 0; __i < __len; ++__i)                                   \
+    ELEM_TYPE* handle = (ELEM_TYPE*)_da_auto_shrink(*darr);                    \
+    *darr = handle;                                                            \
+    if (_da_is_shared(handle))                                                 \
     {                                                                          \
-        (darr)[__i] = (__value);                                               \
+        return handle[*DA_P_LENGTH_FROM_HANDLE(handle) - 1];                   \
     }                                                                          \
-}while(0)
-
-#define _da_foreach(/* void* */darr, ELEM_TYPE, itername)                      \
-for (ELEM_TYPE* itername = darr;                                               \
-    itername < (darr) + da_length(darr);                                       \
-    itername++)                                                                \
-
-#define _da_foreachr(/* void* */darr, ELEM_TYPE, itername)                     \
-for (ELEM_TYPE* itername = &(darr)[da_length(darr)-1];                         \
-    itername >= (darr);                                                        \
-    itername--)                                                                \
+    size_t length = --*DA_P_LENGTH_FROM_HANDLE(handle);                        \
+    return handle[length];                                                     \
+}                                                                              \
+                                                                               \
+static inline ELEM_TYPE NAME##_remove(ELEM_TYPE** darr, size_t index)          \
+{                                                                              \
+    ELEM_TYPE* handle = (ELEM_TYPE*)_da_auto_shrink(*darr);                    \
+    *darr = handle;                                                            \
+    size_t length = *DA_P_LENGTH_FROM_HANDLE(handle);                          \
+    ELEM_TYPE removed = handle[index];                                         \
+    if (_da_is_shared(handle))                                                 \
+    {                                                                          \
+        return removed;                                                        \
+    }                                                                          \
+    memmove(handle + index, handle + index + 1,                                \
+        (length - index - 1)*sizeof(ELEM_TYPE));                               \
+    *DA_P_LENGTH_FROM_HANDLE(handle) = length - 1;                             \
+    return removed;                                                            \
+}                                                                              \
+                                                                               \
+static inline ELEM_TYPE NAME##_swap_remove(ELEM_TYPE** darr, size_t index)     \
+{                                                                              \
+    ELEM_TYPE* handle = (ELEM_TYPE*)_da_auto_shrink(*darr);                    \
+    *darr = handle;                                                            \
+    size_t length = *DA_P_LENGTH_FROM_HANDLE(handle);                          \
+    ELEM_TYPE removed = handle[index];                                         \
+    if (_da_is_shared(handle))                                                 \
+    {                                                                          \
+        return removed;                                                        \
+    }                                                                          \
+    handle[index] = handle[length - 1];                                        \
+    *DA_P_LENGTH_FROM_HANDLE(handle) = length - 1;                             \
+    return removed;                                                            \
+}
 
 #endif // !_DARRAY_H_
-
-static inline void da_swap(void* darr, size_t index_a, size_t index_b)
-{
-    register size_t size = da_sizeof_elem(darr);
-    _da_memswap(
-        ((char*)darr) + (index_a * size),
-        ((char*)darr) + (index_b * size),
-        size
-    );
-}
@@ -0,0 +1,499 @@
+/* MIT License
+ *
+ * Copyright (c) 2017, Victor Cushman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef _DARRAY_HPP_
+#define _DARRAY_HPP_
+
+#include "darray.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/**@class
+ * @brief Type safe owner of a darray of `T`.
+ *
+ * The wrapper holds nothing but the darray handle, which is laid out exactly
+ * like a darray created with `da_alloc`, so handles can be passed to and from
+ * C code with `data`, `release` and `adopt`. Unlike the C macros, elements are
+ * constructed, moved and destroyed properly, so any movable `T` may be stored.
+ * An empty wrapper may not own a darray at all, in which case `data` returns
+ * `NULL`. An adopted handle may be shared with `da_share`; the wrapper copies
+ * the elements into a block of its own before it first modifies them, and only
+ * the last holder destroys them. As in C, writes through `operator[]` and
+ * iterators need an unshared darray, see `unshare`.
+ */
+template <typename T>
+class darray
+{
+public:
+    typedef T value_type;
+    typedef std::size_t size_type;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef T* iterator;
+    typedef const T* const_iterator;
+
+    darray() noexcept : handle_(NULL) {}
+
+    // The value is built before anything is allocated, in case `T()` throws.
+    explicit darray(size_type n) : darray(n, T()) {}
+
+    darray(size_type n, const T& value) : handle_(NULL)
+    {
+        reserve(n);
+        fill_construct(handle_, n, value);
+        *DA_P_LENGTH_FROM_HANDLE(handle_) = n;
+    }
+
+    darray(std::initializer_list<T> init) : handle_(NULL)
+    {
+        reserve(init.size());
+        copy_construct(init.begin(), init.end(), handle_);
+        *DA_P_LENGTH_FROM_HANDLE(handle_) = init.size();
+    }
+
+    darray(const darray& other) : handle_(NULL)
+    {
+        if (other.handle_ != NULL)
+        {
+            handle_ = alloc_like(other.handle_, other.size());
+            copy_construct(other.begin(), other.end(), handle_);
+            *DA_P_LENGTH_FROM_HANDLE(handle_) = other.size();
+        }
+    }
+
+    darray(darray&& other) noexcept : handle_(other.handle_)
+    {
+        other.handle_ = NULL;
+    }
+
+    ~darray()
+    {
+        destroy();
+    }
+
+    darray& operator=(const darray& other)
+    {
+        if (this != &other)
+        {
+            darray tmp(other);
+            swap(tmp);
+        }
+        return *this;
+    }
+
+    darray& operator=(darray&& other) noexcept
+    {
+        if (this != &other)
+        {
+            destroy();
+            handle_ = other.handle_;
+            other.handle_ = NULL;
+        }
+        return *this;
+    }
+
+    /**@function
+     * @brief Take ownership of a darray created by C code. `handle` must hold
+     *  elements of size `sizeof(T)` and may be `NULL`.
+     */
+    static darray adopt(T* handle) noexcept
+    {
+        darray darr;
+        darr.handle_ = handle;
+        return darr;
+    }
+
+    /**@function
+     * @brief Give up ownership of the darray, returning its handle. The caller
+     *  becomes responsible for destroying the elements and calling `da_free`.
+     */
+    T* release() noexcept
+    {
+        T* handle = handle_;
+        handle_ = NULL;
+        return handle;
+    }
+
+    /**@function
+     * @brief Copy the elements into a block of their own if the darray is
+     *  shared, so they may be written through `operator[]` and iterators.
+     */
+    void unshare()
+    {
+        if (handle_ != NULL && _da_is_shared(handle_))
+        {
+            reallocate(capacity());
+        }
+    }
+
+    T* data() noexcept { return handle_; }
+    const T* data() const noexcept { return handle_; }
+
+    size_type size() const noexcept
+    {
+        return handle_ == NULL ? 0 : da_length(handle_);
+    }
+
+    size_type capacity() const noexcept
+    {
+        return handle_ == NULL ? 0 : da_capacity(handle_);
+    }
+
+    bool empty() const noexcept { return size() == 0; }
+
+    reference operator[](size_type index) { return handle_[index]; }
+    const_reference operator[](size_type index) const { return handle_[index]; }
+    reference front() { return handle_[0]; }
+    const_reference front() const { return handle_[0]; }
+    reference back() { return handle_[size() - 1]; }
+    const_reference back() const { return handle_[size() - 1]; }
+
+    iterator begin() noexcept { return handle_; }
+    const_iterator begin() const noexcept { return handle_; }
+    iterator end() noexcept { return handle_ + size(); }
+    const_iterator end() const noexcept { return handle_ + size(); }
+
+    // Make room for at least `nelem` elements in total.
+    void reserve(size_type nelem)
+    {
+        if (nelem > capacity() || handle_ == NULL)
+        {
+            grow(nelem);
+        }
+    }
+
+    void shrink_to_fit()
+    {
+        if (handle_ != NULL && size() < capacity())
+        {
+            reallocate(size());
+        }
+    }
+
+    void clear() noexcept
+    {
+        // The elements of a shared darray still belong to the other holders.
+        if (handle_ != NULL && _da_is_shared(handle_))
+        {
+            destroy();
+        }
+        if (handle_ != NULL)
+        {
+            destroy_range(begin(), end());
+            *DA_P_LENGTH_FROM_HANDLE(handle_) = 0;
+        }
+    }
+
+    void resize(size_type nelem)
+    {
+        resize(nelem, T());
+    }
+
+    void resize(size_type nelem, const T& value)
+    {
+        unshare();
+        size_type length = size();
+        if (nelem < length)
+        {
+            destroy_range(handle_ + nelem, handle_ + length);
+        }
+        else
+        {
+            reserve(nelem);
+            std::uninitialized_fill(handle_ + length, handle_ + nelem, value);
+        }
+        if (handle_ != NULL)
+        {
+            *DA_P_LENGTH_FROM_HANDLE(handle_) = nelem;
+        }
+    }
+
+    void push_back(const T& value) { emplace_back(value); }
+    void push_back(T&& value) { emplace_back(std::move(value)); }
+
+    template <typename... Args>
+    reference emplace_back(Args&&... args)
+    {
+        unshare();
+        size_type length = size();
+        if (length == capacity())
+        {
+            // The arguments may refer to an element of this darray, so the
+            // new element is built before the elements are moved.
+            T tmp(std::forward<Args>(args)...);
+            grow(length + 1);
+            ::new (static_cast<void*>(handle_ + length)) T(std::move(tmp));
+        }
+        else
+        {
+            ::new (static_cast<void*>(handle_ + length))
+                T(std::forward<Args>(args)...);
+        }
+        *DA_P_LENGTH_FROM_HANDLE(handle_) = length + 1;
+        return handle_[length];
+    }
+
+    void pop_back()
+    {
+        unshare();
+        size_type length = size() - 1;
+        handle_[length].~T();
+        *DA_P_LENGTH_FROM_HANDLE(handle_) = length;
+    }
+
+    // Insert `value` before the element at `index`.
+    iterator insert(size_type index, const T& value)
+    {
+        return emplace(index, value);
+    }
+
+    iterator insert(size_type index, T&& value)
+    {
+        return emplace(index, std::move(value));
+    }
+
+    template <typename... Args>
+    iterator emplace(size_type index, Args&&... args)
+    {
+        size_type length = size();
+        if (index == length)
+        {
+            emplace_back(std::forward<Args>(args)...);
+            return handle_ + index;
+        }
+        T tmp(std::forward<Args>(args)...);
+        if (length == capacity())
+        {
+            grow(length + 1);
+        }
+        unshare();
+        ::new (static_cast<void*>(handle_ + length))
+            T(std::move(handle_[length - 1]));
+        *DA_P_LENGTH_FROM_HANDLE(handle_) = length + 1;
+        std::move_backward(handle_ + index, handle_ + length - 1,
+            handle_ + length);
+        handle_[index] = std::move(tmp);
+        return handle_ + index;
+    }
+
+    // Remove the element at `index`, preserving the order of the rest.
+    iterator erase(size_type index)
+    {
+        return erase(index, 1);
+    }
+
+    // Remove `count` elements starting at `first`.
+    iterator erase(size_type first, size_type count)
+    {
+        unshare();
+        size_type length = size();
+        std::move(handle_ + first + count, handle_ + length, handle_ + first);
+        destroy_range(handle_ + length - count, handle_ + length);
+        *DA_P_LENGTH_FROM_HANDLE(handle_) = length - count;
+        return handle_ + first;
+    }
+
+    // Remove the element at `index` in constant time by moving the last
+    // element into its place.
+    void swap_remove(size_type index)
+    {
+        unshare();
+        size_type length = size() - 1;
+        if (index != length)
+        {
+            handle_[index] = std::move(handle_[length]);
+        }
+        pop_back();
+    }
+
+    void swap(darray& other) noexcept
+    {
+        std::swap(handle_, other.handle_);
+    }
+
+private:
+    // Types that can be relocated with memcpy are grown with realloc like
+    // darrays in C. Everything else is moved element by element.
+    static const bool relocatable = std::is_trivially_copyable<T>::value;
+
+    // Allocate an empty darray with room for exactly `capacity` elements,
+    // inheriting the growth policy, allocator and flags of `like`, which may be
+    // `NULL`.
+    static T* alloc_like(const T* like, size_type capacity)
+    {
+        struct da_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.align = alignof(T) > DA_ALIGNMENT_DEFAULT
+            ? alignof(T) : DA_ALIGNMENT_DEFAULT;
+        if (like != NULL)
+        {
+            void* h = const_cast<T*>(like);
+            attr.align = da_alignment(h);
+            attr.growth = *DA_P_GROWTH_FROM_HANDLE(h);
+            attr.allocator = *DA_P_ALLOCATOR_FROM_HANDLE(h);
+            attr.flags = da_flags(h);
+            // Inline and mapped darrays can only be reallocated onto the
+            // heap.
+            if (attr.allocator != NULL && attr.allocator->alloc == NULL)
+            {
+                attr.allocator = NULL;
+            }
+        }
+        T* handle = static_cast<T*>(
+            _da_alloc_capacity(0, capacity, sizeof(T), &attr));
+        if (handle == NULL)
+        {
+            throw std::bad_alloc();
+        }
+        return handle;
+    }
+
+    // Construction helpers for a freshly allocated, empty darray `dst`. If a
+    // constructor throws, the elements already built are destroyed by the
+    // standard algorithm and `dst` is freed before rethrowing, since the
+    // destructor of a half built wrapper never runs.
+    static void fill_construct(T* dst, size_type n, const T& value)
+    {
+        try
+        {
+            std::uninitialized_fill_n(dst, n, value);
+        }
+        catch (...)
+        {
+            da_free(dst);
+            throw;
+        }
+    }
+
+    static void copy_construct(const T* first, const T* last, T* dst)
+    {
+        try
+        {
+            std::uninitialized_copy(first, last, dst);
+        }
+        catch (...)
+        {
+            da_free(dst);
+            throw;
+        }
+    }
+
+    static void destroy_range(T* first, T* last) noexcept
+    {
+        if (!std::is_trivially_destructible<T>::value)
+        {
+            for (; first != last; ++first)
+            {
+                first->~T();
+            }
+        }
+    }
+
+    void grow(size_type min_capacity)
+    {
+        if (handle_ == NULL)
+        {
+            handle_ = alloc_like(NULL, _da_new_capacity(NULL, min_capacity));
+        }
+        else
+        {
+            reallocate(_da_new_capacity(*DA_P_GROWTH_FROM_HANDLE(handle_),
+                min_capacity));
+        }
+    }
+
+    // A shared darray is copied rather than moved, since the other holders
+    // still use its elements, and is then released.
+    void reallocate(size_type new_capacity)
+    {
+        size_type length = size();
+        if (_da_is_shared(handle_))
+        {
+            T* handle = alloc_like(handle_, new_capacity);
+            copy_construct(handle_, handle_ + length, handle);
+            *DA_P_LENGTH_FROM_HANDLE(handle) = length;
+            destroy();
+            handle_ = handle;
+            return;
+        }
+        if (relocatable)
+        {
+            void* handle = _da_realloc(handle_, new_capacity, length);
+            if (handle == NULL)
+            {
+                throw std::bad_alloc();
+            }
+            handle_ = static_cast<T*>(handle);
+            return;
+        }
+        T* handle = alloc_like(handle_, new_capacity);
+        size_type i = 0;
+        try
+        {
+            for (; i < length; ++i)
+            {
+                ::new (static_cast<void*>(handle + i))
+                    T(std::move_if_noexcept(handle_[i]));
+            }
+        }
+        catch (...)
+        {
+            // Elements are only copied when moving could throw, so the
+            // originals are intact.
+            destroy_range(handle, handle + i);
+            da_free(handle);
+            throw;
+        }
+        *DA_P_LENGTH_FROM_HANDLE(handle) = length;
+        destroy();
+        handle_ = handle;
+    }
+
+    // Only the holder releasing the last reference destroys the elements. It
+    // then owns the block alone, so the count is reset for `da_free`.
+    void destroy() noexcept
+    {
+        if (handle_ != NULL)
+        {
+            size_t* p_refcount = DA_P_REFCOUNT_FROM_HANDLE(handle_);
+            if (_DA_REF_LOAD(p_refcount) == 1
+                || _DA_REF_RELEASE(p_refcount) == 0)
+            {
+                *p_refcount = 1;
+                destroy_range(begin(), end());
+                da_free(handle_);
+            }
+            handle_ = NULL;
+        }
+    }
+
+    T* handle_;
+};
+
+#endif // !_DARRAY_HPP_
@@ -0,0 +1,473 @@
+#if __linux__
+#   define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../darray.h"
+
+// Benchmarks for the core darray operations. Every benchmark is run
+// `warmup` times untimed followed by `samples` timed runs, and reports the
+// minimum, median and 99th percentile of the timed runs. Inputs (values,
+// indices) are generated up front from a fixed seed so the timed loops only
+// measure the darray operations and runs are comparable with each other.
+//
+// usage: bench [-f csv|json] [-n nelem] [-s samples] [-w warmup] [-r seed]
+//              [op...]
+// If any ops are listed only those are run.
+
+#define BENCH_NELEM   100000
+#define BENCH_SAMPLES 31
+#define BENCH_WARMUP  3
+#define BENCH_SEED    0x5eed
+// Inserting and removing at random indices is quadratic, so those
+// benchmarks run on a fraction of `nelem`.
+#define BENCH_QUADRATIC_DIVISOR 50
+// How far ahead `da_foreach_prefetch` reads, in bytes.
+#define BENCH_PREFETCH_BYTES 512
+
+struct bench_input
+{
+    size_t nelem;
+    const void* values; // nelem random elements of the largest element size
+    const size_t* push_indices; // push_indices[i] <= i
+    const size_t* remove_indices; // remove_indices[i] < nelem - i
+    const size_t* swap_indices; // 2*nelem indices < nelem
+};
+
+typedef uint64_t (*bench_fn)(const struct bench_input* in);
+
+struct bench
+{
+    const char* op;
+    const char* impl;
+    size_t elsz;
+    int quadratic;
+    bench_fn fn;
+};
+
+static volatile uint32_t bench_sink;
+
+static uint64_t bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t bench_rand(uint64_t* state)
+{
+    // xorshift64*
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1Dull;
+}
+
+// Elements are arrays of 32-bit words so that every size from 4 bytes up is
+// a plain assignable struct.
+#define BENCH_DECLARE(SZ)                                                      \
+typedef struct {uint32_t w[(SZ)/4];} elem##SZ;                                 \
+                                                                               \
+static uint64_t bench_push_##SZ(const struct bench_input* in)                  \
+{                                                                              \
+    const elem##SZ* values = in->values;                                       \
+    elem##SZ* darr = da_alloc(0, sizeof(elem##SZ));                            \
+    uint64_t begin = bench_now();                                              \
+    for (size_t i = 0; i < in->nelem; ++i)                                     \
+    {                                                                          \
+        da_push(darr, values[i]);                                              \
+    }                                                                          \
+    uint64_t end = bench_now();                                                \
+    bench_sink ^= darr[in->nelem - 1].w[0];                                    \
+    da_free(darr);                                                             \
+    return end - begin;                                                        \
+}                                                                              \
+                                                                               \
+static uint64_t bench_array_push_##SZ(const struct bench_input* in)            \
+{                                                                              \
+    const elem##SZ* values = in->values;                                       \
+    size_t capacity = 0;                                                       \
+    elem##SZ* arr = NULL;                                                      \
+    uint64_t begin = bench_now();                                              \
+    for (size_t i = 0; i < in->nelem; ++i)                                     \
+    {                                                                          \
+        if (i == capacity)                                                     \
+        {                                                                      \
+            capacity = DA_NEW_CAPACITY_FROM_LENGTH(capacity);                  \
+            arr = realloc(arr, capacity*sizeof(elem##SZ));                     \
+        }                                                                      \
+        arr[i] = values[i];                                                    \
+    }                                                                          \
+    uint64_t end = bench_now();                                                \
+    bench_sink ^= arr[in->nelem - 1].w[0];                                     \
+    free(arr);                                                                 \
+    return end - begin;                                                        \
+}                                                                              \
+                                                                               \
+static uint64_t bench_insert_##SZ(const struct bench_input* in)                \
+{                                                                              \
+    const elem##SZ* values = in->values;                                       \
+    elem##SZ* darr = da_alloc(0, sizeof(elem##SZ));                            \
+    uint64_t begin = bench_now();                                              \
+    for (size_t i = 0; i < in->nelem; ++i)                                     \
+    {                                                                          \
+        da_insert(darr, in->push_indices[i], values[i]);                       \
+    }                                                                          \
+    uint64_t end = bench_now();                                                \
+    bench_sink ^= darr[0].w[0];                                                \
+    da_free(darr);                                                             \
+    return end - begin;                                                        \
+}                                                                              \
+                                                                               \
+static uint64_t bench_remove_##SZ(const struct bench_input* in)                \
+{                                                                              \
+    elem##SZ* darr = da_append(da_alloc(0, sizeof(elem##SZ)), in->values,      \
+        in->nelem);                                                            \
+    uint32_t acc = 0;                                                          \
+    uint64_t begin = bench_now();                                              \
+    for (size_t i = 0; i < in->nelem; ++i)                                     \
+    {                                                                          \
+        acc ^= da_remove(darr, in->remove_indices[i]).w[0];                    \
+    }                                                                          \
+    uint64_t end = bench_now();                                                \
+    bench_sink ^= acc;                                                         \
+    da_free(darr);                                                             \
+    return end - begin;                                                        \
+}                                                                              \
+                                                                               \
+static uint64_t bench_swap_remove_##SZ(const struct bench_input* in)           \
+{                                                                              \
+    elem##SZ* darr = da_append(da_alloc(0, sizeof(elem##SZ)), in->values,      \
+        in->nelem);                                                            \
+    uint32_t acc = 0;                                                          \
+    uint64_t begin = bench_now();                                              \
+    for (size_t i = 0; i < in->nelem; ++i)                                     \
+    {                                                                          \
+        acc ^= da_swap_remove(darr, in->remove_indices[i]).w[0];               \
+    }                                                                          \
+    uint64_t end = bench_now();                                                \
+    bench_sink ^= acc;                                                         \
+    da_free(darr);                                                             \
+    return end - begin;                                                        \
+}                                                                              \
+                                                                               \
+static uint64_t bench_fill_##SZ(const struct bench_input* in)                  \
+{                                                                              \
+    const elem##SZ* values = in->values;                                       \
+    elem##SZ* darr = da_alloc(in->nelem, sizeof(elem##SZ));                    \
+    uint64_t begin = bench_now();                                              \
+    da_fill(darr, elem##SZ, values[0]);                                        \
+    uint64_t end = bench_now();                                                \
+    bench_sink ^= darr[in->nelem - 1].w[0];                                    \
+    da_free(darr);                                                             \
+    return end - begin;                                                        \
+}                                                                              \
+                                                                               \
+static uint64_t bench_array_fill_##SZ(const struct bench_input* in)            \
+{                                                                              \
+    const elem##SZ* values = in->values;                                       \
+    elem##SZ* arr = malloc(in->nelem*sizeof(elem##SZ));                        \
+    uint64_t begin = bench_now();                                              \
+    for (size_t i = 0; i < in->nelem; ++i)                                     \
+    {                                                                          \
+        arr[i] = values[0];                                                    \
+    }                                                                          \
+    uint64_t end = bench_now();                                                \
+    bench_sink ^= arr[in->nelem - 1].w[0];                                     \
+    free(arr);                                                                 \
+    return end - begin;                                                        \
+}                                                                              \
+                                                                               \
+static uint64_t bench_swap_##SZ(const struct bench_input* in)                  \
+{                                                                              \
+    elem##SZ* darr = da_append(da_alloc(0, sizeof(elem##SZ)), in->values,      \
+        in->nelem);                                                            \
+    const size_t* indices = in->swap_indices;                                  \
+    uint64_t begin = bench_now();                                              \
+    for (size_t i = 0; i < in->nelem; ++i)                                     \
+    {                                                                          \
+        da_swap(darr, indices[2*i], indices[2*i + 1]);                         \
+    }                                                                          \
+    uint64_t end = bench_now();                                                \
+    bench_sink ^= darr[0].w[0];                                                \
+    da_free(darr);                                                             \
+    return end - begin;                                                        \
+}                                                                              \
+                                                                               \
+static uint64_t bench_foreach_##SZ(const struct bench_input* in)               \
+{                                                                              \
+    elem##SZ* darr = da_append(da_alloc(0, sizeof(elem##SZ)), in->values,      \
+        in->nelem);                                                            \
+    uint32_t acc = 0;                                                          \
+    uint64_t begin = bench_now();                                              \
+    da_foreach(darr, elem##SZ, iter)                                           \
+    {                                                                          \
+        acc += iter->w[0];                                                     \
+    }                                                                          \
+    uint64_t end = bench_now();                                                \
+    bench_sink ^= acc;                                                         \
+    da_free(darr);                                                             \
+    return end - begin;                                                        \
+}                                                                              \
+                                                                               \
+static uint64_t bench_foreach_fast_##SZ(const struct bench_input* in)          \
+{                                                                              \
+    elem##SZ* darr = da_append(da_alloc(0, sizeof(elem##SZ)), in->values,      \
+        in->nelem);                                                            \
+    uint32_t acc = 0;                                                          \
+    uint64_t begin = bench_now();                                              \
+    da_foreach_fast(darr, elem##SZ, iter)                                      \
+    {                                                                          \
+        acc += iter->w[0];                                                     \
+    }                                                                          \
+    uint64_t end = bench_now();                                                \
+    bench_sink ^= acc;                                                         \
+    da_free(darr);                                                             \
+    return end - begin;                                                        \
+}                                                                              \
+                                                                               \
+static uint64_t bench_foreach_prefetch_##SZ(const struct bench_input* in)      \
+{                                                                              \
+    elem##SZ* darr = da_append(da_alloc(0, sizeof(elem##SZ)), in->values,      \
+        in->nelem);                                                            \
+    uint32_t acc = 0;                                                          \
+    uint64_t begin = bench_now();                                              \
+    da_foreach_prefetch(darr, elem##SZ, iter, BENCH_PREFETCH_BYTES/(SZ) + 1)   \
+    {                                                                          \
+        acc += iter->w[0];                                                     \
+    }                                                                          \
+    uint64_t end = bench_now();                                                \
+    bench_sink ^= acc;                                                         \
+    da_free(darr);                                                             \
+    return end - begin;                                                        \
+}                                                                              \
+                                                                               \
+static uint64_t bench_array_foreach_##SZ(const struct bench_input* in)         \
+{                                                                              \
+    const elem##SZ* values = in->values;                                       \
+    elem##SZ* arr = malloc(in->nelem*sizeof(elem##SZ));                        \
+    memcpy(arr, values, in->nelem*sizeof(elem##SZ));                           \
+    uint32_t acc = 0;                                                          \
+    uint64_t begin = bench_now();                                              \
+    for (size_t i = 0; i < in->nelem; ++i)                                     \
+    {                                                                          \
+        acc += arr[i].w[0];                                                    \
+    }                                                                          \
+    uint64_t end = bench_now();                                                \
+    bench_sink ^= acc;                                                         \
+    free(arr);                                                                 \
+    return end - begin;                                                        \
+}
+
+#define BENCH_ENTRIES(SZ)                                                      \
+    {"push",        "darray", SZ, 0, bench_push_##SZ},                         \
+    {"push",        "array",  SZ, 0, bench_array_push_##SZ},                   \
+    {"insert",      "darray", SZ, 1, bench_insert_##SZ},                       \
+    {"remove",      "darray", SZ, 1, bench_remove_##SZ},                       \
+    {"swap_remove", "darray", SZ, 0, bench_swap_remove_##SZ},                  \
+    {"fill",        "darray", SZ, 0, bench_fill_##SZ},                         \
+    {"fill",        "array",  SZ, 0, bench_array_fill_##SZ},                   \
+    {"swap",        "darray", SZ, 0, bench_swap_##SZ},                         \
+    {"foreach",     "darray", SZ, 0, bench_foreach_##SZ},                      \
+    {"foreach",     "darray_fast", SZ, 0, bench_foreach_fast_##SZ},            \
+    {"foreach",     "darray_prefetch", SZ, 0, bench_foreach_prefetch_##SZ},    \
+    {"foreach",     "array",  SZ, 0, bench_array_foreach_##SZ}
+
+#define BENCH_MAX_ELSZ 256
+BENCH_DECLARE(4)
+BENCH_DECLARE(8)
+BENCH_DECLARE(16)
+BENCH_DECLARE(32)
+BENCH_DECLARE(64)
+BENCH_DECLARE(128)
+BENCH_DECLARE(256)
+
+static const struct bench benches[] =
+{
+    BENCH_ENTRIES(4),
+    BENCH_ENTRIES(8),
+    BENCH_ENTRIES(16),
+    BENCH_ENTRIES(32),
+    BENCH_ENTRIES(64),
+    BENCH_ENTRIES(128),
+    BENCH_ENTRIES(256)
+};
+
+static int bench_cmp(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of the sorted `times`.
+static uint64_t bench_percentile(const uint64_t* times, size_t n, size_t pct)
+{
+    size_t rank = (pct*n + 99)/100;
+    return times[rank ? rank - 1 : 0];
+}
+
+static int bench_selected(const char* op, char** ops, int nops)
+{
+    if (nops == 0)
+    {
+        return 1;
+    }
+    for (int i = 0; i < nops; ++i)
+    {
+        if (strcmp(op, ops[i]) == 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void bench_usage(const char* prog)
+{
+    fprintf(stderr, "usage: %s [-f csv|json] [-n nelem] [-s samples] "
+        "[-w warmup] [-r seed] [op...]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char** argv)
+{
+    int json = 0;
+    size_t nelem = BENCH_NELEM;
+    size_t samples = BENCH_SAMPLES;
+    size_t warmup = BENCH_WARMUP;
+    uint64_t seed = BENCH_SEED;
+    int argi = 1;
+    for (; argi < argc && argv[argi][0] == '-'; ++argi)
+    {
+        if (argi + 1 == argc || argv[argi][1] == '\0' || argv[argi][2] != '\0')
+        {
+            bench_usage(argv[0]);
+        }
+        const char* arg = argv[++argi];
+        switch (argv[argi - 1][1])
+        {
+        case 'f':
+            if (strcmp(arg, "json") == 0)      json = 1;
+            else if (strcmp(arg, "csv") == 0)  json = 0;
+            else                               bench_usage(argv[0]);
+            break;
+        case 'n': nelem = strtoull(arg, NULL, 0);   break;
+        case 's': samples = strtoull(arg, NULL, 0); break;
+        case 'w': warmup = strtoull(arg, NULL, 0);  break;
+        case 'r': seed = strtoull(arg, NULL, 0);    break;
+        default:  bench_usage(argv[0]);
+        }
+    }
+    if (nelem < BENCH_QUADRATIC_DIVISOR || samples == 0 || seed == 0)
+    {
+        bench_usage(argv[0]);
+    }
+
+    // Pre-generate every input so that no random numbers are drawn inside
+    // the timed loops.
+    const size_t small = nelem/BENCH_QUADRATIC_DIVISOR;
+    uint32_t* values = malloc(nelem*BENCH_MAX_ELSZ);
+    size_t* push_indices = malloc(nelem*sizeof(size_t));
+    size_t* remove_indices = malloc(small*sizeof(size_t));
+    size_t* swap_remove_indices = malloc(nelem*sizeof(size_t));
+    size_t* swap_indices = malloc(2*nelem*sizeof(size_t));
+    uint64_t* times = malloc(samples*sizeof(uint64_t));
+    if (!values || !push_indices || !remove_indices || !swap_remove_indices
+        || !swap_indices || !times)
+    {
+        fputs("bench: out of memory\n", stderr);
+        return EXIT_FAILURE;
+    }
+    uint64_t state = seed;
+    for (size_t i = 0; i < nelem*BENCH_MAX_ELSZ/sizeof(uint32_t); ++i)
+    {
+        values[i] = (uint32_t)bench_rand(&state);
+    }
+    for (size_t i = 0; i < nelem; ++i)
+    {
+        push_indices[i] = bench_rand(&state) % (i + 1);
+        swap_remove_indices[i] = bench_rand(&state) % (nelem - i);
+        swap_indices[2*i] = bench_rand(&state) % nelem;
+        swap_indices[2*i + 1] = bench_rand(&state) % nelem;
+    }
+    for (size_t i = 0; i < small; ++i)
+    {
+        remove_indices[i] = bench_rand(&state) % (small - i);
+    }
+
+    if (json)
+    {
+        printf("{\"seed\": %llu, \"samples\": %zu, \"warmup\": %zu, "
+            "\"results\": [", (unsigned long long)seed, samples, warmup);
+    }
+    else
+    {
+        puts("op,impl,elsz,nelem,samples,min_ns,median_ns,p99_ns,ns_per_elem");
+    }
+
+    int first = 1;
+    for (size_t b = 0; b < sizeof(benches)/sizeof(benches[0]); ++b)
+    {
+        const struct bench* bench = &benches[b];
+        if (!bench_selected(bench->op, argv + argi, argc - argi))
+        {
+            continue;
+        }
+        struct bench_input in = {
+            .nelem = bench->quadratic ? small : nelem,
+            .values = values,
+            .push_indices = push_indices,
+            .remove_indices = strcmp(bench->op, "swap_remove") == 0
+                ? swap_remove_indices : remove_indices,
+            .swap_indices = swap_indices
+        };
+        for (size_t i = 0; i < warmup; ++i)
+        {
+            bench->fn(&in);
+        }
+        for (size_t i = 0; i < samples; ++i)
+        {
+            times[i] = bench->fn(&in);
+        }
+        qsort(times, samples, sizeof(uint64_t), bench_cmp);
+        uint64_t median = bench_percentile(times, samples, 50);
+        uint64_t p99 = bench_percentile(times, samples, 99);
+        double per_elem = (double)median/in.nelem;
+
+        if (json)
+        {
+            printf("%s\n  {\"op\": \"%s\", \"impl\": \"%s\", \"elsz\": %zu, "
+                "\"nelem\": %zu, \"samples\": %zu, \"min_ns\": %llu, "
+                "\"median_ns\": %llu, \"p99_ns\": %llu, "
+                "\"ns_per_elem\": %.3f}",
+                first ? "" : ",", bench->op, bench->impl, bench->elsz,
+                in.nelem, samples, (unsigned long long)times[0],
+                (unsigned long long)median, (unsigned long long)p99,
+                per_elem);
+        }
+        else
+        {
+            printf("%s,%s,%zu,%zu,%zu,%llu,%llu,%llu,%.3f\n",
+                bench->op, bench->impl, bench->elsz, in.nelem, samples,
+                (unsigned long long)times[0], (unsigned long long)median,
+                (unsigned long long)p99, per_elem);
+        }
+        fflush(stdout);
+        first = 0;
+    }
+    if (json)
+    {
+        puts("\n]}");
+    }
+
+    free(values);
+    free(push_indices);
+    free(remove_indices);
+    free(swap_remove_indices);
+    free(swap_indices);
+    free(times);
+    return EXIT_SUCCESS;
+}
@@ -1,23 +1,1166 @@
 #if __linux__
+#   define _GNU_SOURCE
 #   define _EMU_ENABLE_COLOR_
 #endif
 #include <EMUtest.h>
 #include <time.h>
 #include "../darray.h"
+#if defined(DA_HAVE_ATOMICS) && defined(__unix__)
+#   include <pthread.h>
+#   define DA_TEST_THREADS
+#endif
+
+#define INITIAL_NUM_ELEMS 10
+#define RESIZE_NUM_ELEMS 100
+
+EMU_TEST(alloc_and_free_functions)
+{
+    int* da = da_alloc(INITIAL_NUM_ELEMS, sizeof(int));
+    EMU_REQUIRE_NOT_NULL(da);
+    for (size_t i = 0; i < INITIAL_NUM_ELEMS; ++i) // writiable without crashing
+    {
+        da[i] = i;
+    }
+
+    da_free(da);
+    EMU_END_TEST();
+}
+
+EMU_TEST(da_alloc_aligned)
+{
+    const size_t aligns[] = {16, 32, 64, 4096};
+    for (size_t a = 0; a < sizeof(aligns)/sizeof(aligns[0]); ++a)
+    {
+        int* da = da_alloc_aligned(INITIAL_NUM_ELEMS, sizeof(int), aligns[a]);
+        EMU_REQUIRE_NOT_NULL(da);
+        EMU_EXPECT_EQ_UINT(da_alignment(da), aligns[a]);
+        EMU_EXPECT_EQ_UINT((uintptr_t)da % aligns[a], 0);
+        for (size_t i = 0; i < INITIAL_NUM_ELEMS; ++i)
+        {
+            da[i] = i;
+        }
+
+        // alignment and contents survive reallocation
+        da = da_resize(da, RESIZE_NUM_ELEMS);
+        EMU_REQUIRE_NOT_NULL(da);
+        EMU_EXPECT_EQ_UINT((uintptr_t)da % aligns[a], 0);
+        da = da_reserve(da, 10*RESIZE_NUM_ELEMS);
+        EMU_REQUIRE_NOT_NULL(da);
+        EMU_EXPECT_EQ_UINT((uintptr_t)da % aligns[a], 0);
+        for (int i = 0; i < 1000; ++i)
+        {
+            da_push(da, i);
+        }
+        EMU_EXPECT_EQ_UINT((uintptr_t)da % aligns[a], 0);
+        EMU_EXPECT_EQ_UINT(da_alignment(da), aligns[a]);
+        EMU_EXPECT_EQ_UINT(da_length(da), RESIZE_NUM_ELEMS + 1000);
+        for (size_t i = 0; i < INITIAL_NUM_ELEMS; ++i)
+        {
+            EMU_EXPECT_EQ_INT(da[i], (int)i);
+        }
+        EMU_EXPECT_EQ_INT(da[da_length(da)-1], 999);
+
+        da_free(da);
+    }
+
+    // alignment must be a power of two
+    EMU_EXPECT_NULL(da_alloc_aligned(INITIAL_NUM_ELEMS, sizeof(int), 0));
+    EMU_EXPECT_NULL(da_alloc_aligned(INITIAL_NUM_ELEMS, sizeof(int), 48));
+    EMU_END_TEST();
+}
+
+static size_t growth_callback(size_t nelem, void* ctx)
+{
+    ++*(int*)ctx;
+    return nelem + 7;
+}
+
+EMU_TEST(da_alloc_attr)
+{
+    // zero initialized attributes behave like da_alloc
+    struct da_attr attr = {0};
+    int* da = da_alloc_attr(INITIAL_NUM_ELEMS, sizeof(int), &attr);
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ_UINT(da_length(da), INITIAL_NUM_ELEMS);
+    EMU_EXPECT_EQ_UINT(da_alignment(da), DA_ALIGNMENT_DEFAULT);
+    da_free(da);
+
+    // geometric
+    static const struct da_growth twice = DA_GROWTH_GEOMETRIC_INIT(2.0, 4);
+    attr.growth = &twice;
+    da = da_alloc_attr(0, sizeof(int), &attr);
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ_UINT(da_capacity(da), 4);
+    for (int i = 0; i < 5; ++i)
+    {
+        da_push(da, i);
+    }
+    EMU_EXPECT_EQ_UINT(da_capacity(da), 10);
+    da = da_reserve(da, 20);
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ_UINT(da_capacity(da), 50);
+    da_free(da);
+
+    // fixed increment
+    static const struct da_growth inc = DA_GROWTH_INCREMENT_INIT(100, 0);
+    attr.growth = &inc;
+    da = da_alloc_attr(1, sizeof(int), &attr);
+    EMU_REQUIRE_NOT_NULL(da);
+    for (int i = 0; i < 250; ++i)
+    {
+        da_insert(da, 0, i);
+        EMU_EXPECT_EQ_UINT(da_capacity(da) % 100, 0);
+    }
+    EMU_EXPECT_EQ_UINT(da_capacity(da), 300);
+    da_free(da);
+
+    // power of two
+    static const struct da_growth pow2 = DA_GROWTH_POW2_INIT(16);
+    attr.growth = &pow2;
+    da = da_alloc_attr(3, sizeof(int), &attr);
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ_UINT(da_capacity(da), 16);
+    da = da_resize(da, 17);
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ_UINT(da_capacity(da), 32);
+    da_free(da);
+
+    // user callback
+    int ncalls = 0;
+    struct da_growth cb = DA_GROWTH_CALLBACK_INIT(growth_callback, &ncalls);
+    attr.growth = &cb;
+    da = da_alloc_attr(1, sizeof(int), &attr);
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ_UINT(da_capacity(da), 8);
+    for (int i = 0; i < 9; ++i)
+    {
+        da_push(da, i);
+    }
+    EMU_EXPECT_EQ_INT(ncalls, 2);
+    EMU_EXPECT_EQ_UINT(da_capacity(da), 16);
+
+    // switch policies on a live darray
+    da_set_growth(da, &pow2);
+    da = da_reserve(da, 40);
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ_UINT(da_capacity(da), 64);
+    EMU_EXPECT_EQ_INT(ncalls, 2);
+    for (int i = 1; i < 10; ++i)
+    {
+        EMU_EXPECT_EQ_INT(da[i], i - 1);
+    }
+    da_free(da);
+
+    // invalid alignment
+    attr.align = 3;
+    EMU_EXPECT_NULL(da_alloc_attr(1, sizeof(int), &attr));
+    EMU_END_TEST();
+}
+
+EMU_TEST(da_arena)
+{
+    struct da_arena arena;
+    da_arena_init(&arena, 4096);
+    struct da_attr attr = {0};
+    attr.allocator = &arena.allocator;
+
+    int* da1 = da_alloc_attr(0, sizeof(int), &attr);
+    EMU_REQUIRE_NOT_NULL(da1);
+    // the most recent allocation grows in place
+    int* first = da1;
+    for (int i = 0; i < 100; ++i)
+    {
+        da_push(da1, i);
+    }
+    EMU_EXPECT_EQ(da1, first);
+
+    // interleaved darrays, including an aligned darray and growth past the
+    // size of a single chunk
+    attr.align = 64;
+    int* da2 = da_alloc_attr(0, sizeof(int), &attr);
+    EMU_REQUIRE_NOT_NULL(da2);
+    for (int i = 0; i < 5000; ++i)
+    {
+        da_push(da1, i);
+        da_push(da2, -i);
+    }
+    EMU_EXPECT_EQ_UINT((uintptr_t)da2 % 64, 0);
+    EMU_EXPECT_EQ_UINT(da_length(da1), 5100);
+    EMU_EXPECT_EQ_UINT(da_length(da2), 5000);
+    for (int i = 0; i < 5000; ++i)
+    {
+        EMU_EXPECT_EQ_INT(da1[i + 100], i);
+        EMU_EXPECT_EQ_INT(da2[i], -i);
+    }
+    da_free(da1);
+    da_free(da2);
+
+    // after a reset, memory from the first chunk is handed out again
+    da_arena_reset(&arena);
+    attr.align = 0;
+    int* da3 = da_alloc_attr(0, sizeof(int), &attr);
+    EMU_REQUIRE_NOT_NULL(da3);
+    EMU_EXPECT_EQ(da3, first);
+
+    da_arena_destroy(&arena);
+    EMU_END_TEST();
+}
+
+EMU_TEST(da_pool)
+{
+    struct da_pool pool;
+    da_pool_init(&pool);
+    struct da_attr attr = {0};
+    attr.allocator = &pool.allocator;
+
+    int* da = da_alloc_attr(INITIAL_NUM_ELEMS, sizeof(int), &attr);
+    EMU_REQUIRE_NOT_NULL(da);
+    int* first = da;
+    da_free(da);
+
+    // same size class reuses the cached block
+    da = da_alloc_attr(INITIAL_NUM_ELEMS, sizeof(int), &attr);
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ(da, first);
+
+    // growth through several size classes and past the largest class
+    for (int i = 0; i < 500000; ++i)
+    {
+        da_push(da, i);
+    }
+    EMU_EXPECT_EQ_UINT(da_length(da), INITIAL_NUM_ELEMS + 500000);
+    for (int i = 0; i < 500000; ++i)
+    {
+        EMU_EXPECT_EQ_INT(da[INITIAL_NUM_ELEMS + i], i);
+    }
+    da_free(da);
+
+    da_pool_destroy(&pool);
+    EMU_END_TEST();
+}
+
+#ifdef DA_HAVE_MMAP
+EMU_TEST(da_vm)
+{
+    // growth within the reservation never moves the darray
+    struct da_vm vm;
+    da_vm_init(&vm, (size_t)1 << 30, DA_VM_HUGEPAGE);
+    struct da_attr attr = {0};
+    attr.allocator = &vm.allocator;
+    int* da = da_alloc_attr(0, sizeof(int), &attr);
+    EMU_REQUIRE_NOT_NULL(da);
+    int* first = da;
+    for (int i = 0; i < 1000000; ++i)
+    {
+        da_push(da, i);
+    }
+    EMU_EXPECT_EQ(da, first);
+    for (int i = 0; i < 1000000; ++i)
+    {
+        EMU_EXPECT_EQ_INT(da[i], i);
+    }
+
+    // shrinking decommits pages, but keeps the data
+    da = da_resize(da, 10);
+    da = da_shrink_to_fit(da);
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ(da, first);
+    EMU_EXPECT_EQ_INT(da[9], 9);
+    da_free(da);
+
+    // growth past a tiny reservation remaps the darray
+    da_vm_init(&vm, 1, 0);
+    da = da_alloc_attr(0, sizeof(int), &attr);
+    EMU_REQUIRE_NOT_NULL(da);
+    for (int i = 0; i < 100000; ++i)
+    {
+        da_push(da, i);
+    }
+    for (int i = 0; i < 100000; ++i)
+    {
+        EMU_EXPECT_EQ_INT(da[i], i);
+    }
+    da_free(da);
+    EMU_END_TEST();
+}
+
+EMU_TEST(da_map_file)
+{
+    const char* path = "darray.test.bin";
+    double* da = da_alloc_aligned(0, sizeof(double), 64);
+    EMU_REQUIRE_NOT_NULL(da);
+    for (int i = 0; i < 10000; ++i)
+    {
+        da_push(da, i*0.5);
+    }
+    EMU_EXPECT_EQ_INT(da_save(da, path), 0);
+    da_free(da);
+
+    // copy-on-write mapping
+    da = da_map_file(path, sizeof(double), 0);
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ_UINT(da_length(da), 10000);
+    EMU_EXPECT_EQ_UINT(da_alignment(da), 64);
+    EMU_EXPECT_EQ_UINT((uintptr_t)da % 64, 0);
+    for (int i = 0; i < 10000; ++i)
+    {
+        EMU_EXPECT_EQ(da[i], i*0.5);
+    }
+    da[0] = -1.0;
+    // growing moves the darray off of the mapping
+    da_push(da, 5000.0);
+    EMU_EXPECT_EQ_UINT(da_length(da), 10001);
+    EMU_EXPECT_EQ_UINT((uintptr_t)da % 64, 0);
+    EMU_EXPECT_EQ(da[0], -1.0);
+    EMU_EXPECT_EQ(da[9999], 9999*0.5);
+    EMU_EXPECT_EQ(da[10000], 5000.0);
+    da_free(da);
+
+    // read-only mapping sees none of the changes made above
+    da = da_map_file(path, sizeof(double), DA_MAP_READONLY);
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ_UINT(da_length(da), 10000);
+    EMU_EXPECT_EQ(da[0], 0.0);
+    da_free(da);
+
+    // element size mismatch and invalid files are rejected
+    EMU_EXPECT_NULL(da_map_file(path, sizeof(int), 0));
+    FILE* file = fopen(path, "r+b");
+    EMU_REQUIRE_NOT_NULL(file);
+    fputc('X', file);
+    fclose(file);
+    EMU_EXPECT_NULL(da_map_file(path, sizeof(double), 0));
+    EMU_EXPECT_NULL(da_map_file("darray.test.missing", sizeof(double), 0));
+    remove(path);
+    EMU_END_TEST();
+}
+#endif // DA_HAVE_MMAP
+
+#ifdef DA_HAVE_FD_IO
+EMU_TEST(da_write_read_fd)
+{
+    const char* path = "darray.test.fd.bin";
+    double* da = da_alloc_aligned(0, sizeof(double), 64);
+    EMU_REQUIRE_NOT_NULL(da);
+    for (int i = 0; i < 10000; ++i)
+    {
+        da_push(da, i*0.5);
+    }
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    EMU_REQUIRE_TRUE(fd >= 0);
+    EMU_EXPECT_EQ_INT(da_write_fd(da, fd), 0);
+    da_free(da);
+
+#ifdef DA_HAVE_MMAP
+    // the stream is a valid file for da_map_file
+    da = da_map_file(path, sizeof(double), DA_MAP_READONLY);
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ_UINT(da_length(da), 10000);
+    EMU_EXPECT_EQ(da[9999], 9999*0.5);
+    da_free(da);
+#endif
+
+    EMU_REQUIRE_TRUE(lseek(fd, 0, SEEK_SET) == 0);
+    EMU_EXPECT_NULL(da_read_fd(fd, sizeof(int), NULL));
+    EMU_REQUIRE_TRUE(lseek(fd, 0, SEEK_SET) == 0);
+    da = da_read_fd(fd, sizeof(double), NULL);
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ_UINT(da_length(da), 10000);
+    EMU_EXPECT_EQ_UINT(da_capacity(da), 10000);
+    EMU_EXPECT_EQ_UINT(da_alignment(da), 64);
+    EMU_EXPECT_EQ_UINT((uintptr_t)da % 64, 0);
+    for (int i = 0; i < 10000; ++i)
+    {
+        EMU_EXPECT_EQ(da[i], i*0.5);
+    }
+    da_free(da);
+    // nothing is left to read
+    EMU_EXPECT_NULL(da_read_fd(fd, sizeof(double), NULL));
+    close(fd);
+    remove(path);
+
+    // a gap buffer goes through a pipe in logical order
+    int* ints = da_alloc(0, sizeof(int));
+    for (int i = 0; i < 10; ++i)
+    {
+        int* tmp = da_gap_insert(ints, i, &i);
+        EMU_REQUIRE_NOT_NULL(tmp);
+        ints = tmp;
+    }
+    for (int i = 0; i < 40; ++i)
+    {
+        int value = 100 + i;
+        int* tmp = da_gap_insert(ints, i, &value);
+        EMU_REQUIRE_NOT_NULL(tmp);
+        ints = tmp;
+    }
+    EMU_REQUIRE_TRUE(da_flags(ints) & DA_FLAG_GAP);
+    int fds[2];
+    EMU_REQUIRE_TRUE(pipe(fds) == 0);
+    EMU_EXPECT_EQ_INT(da_write_fd(ints, fds[1]), 0);
+    close(fds[1]);
+    struct da_attr attr = {128, NULL, NULL, 0};
+    int* copy = da_read_fd(fds[0], sizeof(int), &attr);
+    close(fds[0]);
+    EMU_REQUIRE_NOT_NULL(copy);
+    EMU_EXPECT_EQ_UINT(da_length(copy), 50);
+    EMU_EXPECT_EQ_UINT((uintptr_t)copy % 128, 0);
+    EMU_EXPECT_FALSE(da_flags(copy) & DA_FLAG_GAP);
+    for (size_t i = 0; i < 50; ++i)
+    {
+        EMU_EXPECT_EQ_INT(copy[i], *(int*)da_gap_at(ints, i));
+    }
+    da_free(copy);
+    da_free(ints);
+    EMU_END_TEST();
+}
+
+EMU_TEST(da_write_read_fd_resume)
+{
+    // more than a pipe holds, through non-blocking ends
+    size_t* da = da_alloc(0, sizeof(size_t));
+    for (size_t i = 0; i < 100000; ++i)
+    {
+        da_push(da, i);
+    }
+    int fds[2];
+    EMU_REQUIRE_TRUE(pipe(fds) == 0);
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+    struct da_reader reader;
+    da_reader_init(&reader, sizeof(size_t), 100000, NULL);
+    // nothing written yet
+    size_t* copy = NULL;
+    EMU_EXPECT_EQ_INT(da_reader_read(&reader, fds[0], (void**)&copy), 1);
+
+    size_t offset = 0;
+    int wstatus = 1;
+    int rstatus = 1;
+    int blocked = 0;
+    while (wstatus == 1 || rstatus == 1)
+    {
+        if (wstatus == 1)
+        {
+            wstatus = da_write_fd_resume(da, fds[1], &offset);
+            blocked += wstatus == 1;
+        }
+        rstatus = da_reader_read(&reader, fds[0], (void**)&copy);
+        EMU_REQUIRE_TRUE(rstatus != -1);
+    }
+    EMU_EXPECT_EQ_INT(wstatus, 0);
+    EMU_EXPECT_GT_UINT(blocked, 0);
+    EMU_REQUIRE_NOT_NULL(copy);
+    EMU_EXPECT_EQ_UINT(da_length(copy), 100000);
+    EMU_EXPECT_EQ_UINT(copy[99999], 99999);
+    EMU_EXPECT_EQ_INT(memcmp(copy, da, 100000*sizeof(size_t)), 0);
+    da_free(copy);
+    da_reader_destroy(&reader);
+
+    // a darray longer than allowed is refused before it is allocated
+    da_reader_init(&reader, sizeof(size_t), 99999, NULL);
+    offset = 0;
+    EMU_EXPECT_EQ_INT(da_write_fd_resume(da, fds[1], &offset), 1);
+    EMU_EXPECT_EQ_INT(da_reader_read(&reader, fds[0], (void**)&copy), -1);
+    EMU_EXPECT_NULL(reader.darr);
+    da_reader_destroy(&reader);
+    close(fds[0]);
+    close(fds[1]);
+
+    // a stream cut short fails and the partial darray is freed
+    EMU_REQUIRE_TRUE(pipe(fds) == 0);
+    short* shorts = da_alloc(8, sizeof(short));
+    memset(shorts, 0, 8*sizeof(short));
+    offset = 0;
+    EMU_EXPECT_EQ_INT(da_write_fd_resume(shorts, fds[1], &offset), 0);
+    EMU_REQUIRE_TRUE(write(fds[1], shorts, 8) == 8);
+    close(fds[1]);
+    da_reader_init(&reader, sizeof(short), 8, NULL);
+    short* back = NULL;
+    EMU_EXPECT_EQ_INT(da_reader_read(&reader, fds[0], (void**)&back), 0);
+    EMU_REQUIRE_NOT_NULL(back);
+    EMU_EXPECT_EQ_UINT(da_length(back), 8);
+    EMU_EXPECT_EQ_INT(da_reader_read(&reader, fds[0], (void**)&back), -1);
+    da_reader_destroy(&reader);
+    close(fds[0]);
+    da_free(back);
+    da_free(shorts);
+    da_free(da);
+    EMU_END_TEST();
+}
+#endif // DA_HAVE_FD_IO
+
+#ifdef DA_TEST_THREADS
+#define CONCURRENT_THREADS 4
+#define CONCURRENT_PUSHES 100000
+
+struct concurrent_arg
+{
+    // struct da_concurrent or struct da_shared
+    void* target;
+    unsigned thread;
+};
+
+static void* concurrent_producer(void* arg)
+{
+    struct concurrent_arg* carg = (struct concurrent_arg*)arg;
+    for (unsigned i = 0; i < CONCURRENT_PUSHES; ++i)
+    {
+        unsigned value = (carg->thread << 24) | (i + 1);
+        if (da_concurrent_push(carg->target, &value) != 0)
+        {
+            return arg;
+        }
+    }
+    return NULL;
+}
+
+EMU_TEST(da_concurrent)
+{
+    struct da_concurrent cda;
+    EMU_REQUIRE_TRUE(0 == da_concurrent_init(&cda, sizeof(unsigned), NULL));
+    pthread_t threads[CONCURRENT_THREADS];
+    struct concurrent_arg args[CONCURRENT_THREADS];
+    for (unsigned t = 0; t < CONCURRENT_THREADS; ++t)
+    {
+        args[t].target = &cda;
+        args[t].thread = t;
+        pthread_create(&threads[t], NULL, concurrent_producer, &args[t]);
+    }
+
+    // every snapshot taken while producers run holds only written elements
+    int snapshot_ok = 1;
+    size_t previous = 0;
+    for (int s = 0; s < 100; ++s)
+    {
+        size_t length = da_concurrent_snapshot(&cda);
+        snapshot_ok &= length >= previous;
+        for (size_t i = previous; i < length; ++i)
+        {
+            unsigned value = *(unsigned*)da_concurrent_at(&cda, i);
+            snapshot_ok &= (value & 0xFFFFFF) != 0
+                && (value >> 24) < CONCURRENT_THREADS;
+        }
+        previous = length;
+    }
+    EMU_EXPECT_TRUE(snapshot_ok);
+
+    for (unsigned t = 0; t < CONCURRENT_THREADS; ++t)
+    {
+        void* ret;
+        pthread_join(threads[t], &ret);
+        EMU_EXPECT_NULL(ret);
+    }
+    unsigned* da = da_concurrent_release(&cda);
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ_UINT(da_length(da), CONCURRENT_THREADS*CONCURRENT_PUSHES);
+
+    // each producer's elements appear exactly once and in push order
+    unsigned next[CONCURRENT_THREADS] = {0};
+    int order_ok = 1;
+    da_foreach(da, unsigned, iter)
+    {
+        unsigned t = *iter >> 24;
+        order_ok &= t < CONCURRENT_THREADS && (*iter & 0xFFFFFF) == ++next[t];
+    }
+    EMU_EXPECT_TRUE(order_ok);
+    da_free(da);
+
+    // a producer stalled between claiming and writing its slot holds back
+    // the snapshot but not the other producers
+    EMU_REQUIRE_TRUE(0 == da_concurrent_init(&cda, sizeof(unsigned), NULL));
+    size_t stalled = __atomic_fetch_add(&cda.reserved, 1, __ATOMIC_RELAXED);
+    for (unsigned i = 1; i < 1000; ++i)
+    {
+        EMU_REQUIRE_TRUE(da_concurrent_push(&cda, &i) == 0);
+    }
+    EMU_EXPECT_EQ_UINT(da_concurrent_snapshot(&cda), 0);
+    unsigned zero = 0;
+    memcpy(da_concurrent_at(&cda, stalled), &zero, sizeof(zero));
+    __atomic_store_n(&cda.segments[0]->ready[stalled], 1, __ATOMIC_RELEASE);
+    EMU_EXPECT_EQ_UINT(da_concurrent_snapshot(&cda), 1000);
+    EMU_EXPECT_EQ_UINT(*(unsigned*)da_concurrent_at(&cda, 999), 999);
+    da = da_concurrent_release(&cda);
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ_UINT(da_length(da), 1000);
+    order_ok = 1;
+    for (unsigned i = 0; i < 1000; ++i)
+    {
+        order_ok &= da[i] == i;
+    }
+    EMU_EXPECT_TRUE(order_ok);
+    da_free(da);
+
+    // small darrays are handed over without a copy
+    EMU_REQUIRE_TRUE(0 == da_concurrent_init(&cda, sizeof(unsigned), NULL));
+    EMU_REQUIRE_TRUE(da_concurrent_push(&cda, &zero) == 0);
+    da = da_concurrent_release(&cda);
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ_UINT(da_length(da), 1);
+    EMU_EXPECT_EQ_UINT(da[0], 0);
+    da_free(da);
+    EMU_END_TEST();
+}
+
+#define BATCH_SIZE 64
+
+static void* batch_producer(void* arg)
+{
+    struct concurrent_arg* carg = (struct concurrent_arg*)arg;
+    struct da_batch batch;
+    if (da_batch_init(&batch, carg->target, sizeof(unsigned), BATCH_SIZE) != 0)
+    {
+        return arg;
+    }
+    for (unsigned i = 0; i < CONCURRENT_PUSHES; ++i)
+    {
+        unsigned value = (carg->thread << 24) | (i + 1);
+        if (da_batch_push(&batch, &value) != 0)
+        {
+            return arg;
+        }
+    }
+    return da_batch_destroy(&batch) == 0 ? NULL : arg;
+}
+
+EMU_TEST(da_batch)
+{
+    struct da_shared shared = {NULL, 0};
+    shared.darr = da_alloc(0, sizeof(unsigned));
+    EMU_REQUIRE_NOT_NULL(shared.darr);
+    pthread_t threads[CONCURRENT_THREADS];
+    struct concurrent_arg args[CONCURRENT_THREADS];
+    for (unsigned t = 0; t < CONCURRENT_THREADS; ++t)
+    {
+        args[t].target = &shared;
+        args[t].thread = t;
+        pthread_create(&threads[t], NULL, batch_producer, &args[t]);
+    }
+    for (unsigned t = 0; t < CONCURRENT_THREADS; ++t)
+    {
+        void* ret;
+        pthread_join(threads[t], &ret);
+        EMU_EXPECT_NULL(ret);
+    }
+    unsigned* da = shared.darr;
+    EMU_EXPECT_EQ_UINT(da_length(da), CONCURRENT_THREADS*CONCURRENT_PUSHES);
+
+    // batches land whole, so each producer's elements keep their order
+    unsigned next[CONCURRENT_THREADS] = {0};
+    int order_ok = 1;
+    da_foreach(da, unsigned, iter)
+    {
+        unsigned t = *iter >> 24;
+        order_ok &= t < CONCURRENT_THREADS && (*iter & 0xFFFFFF) == ++next[t];
+    }
+    EMU_EXPECT_TRUE(order_ok);
+    da_free(da);
+    EMU_END_TEST();
+}
+
+struct triple { unsigned a, b, c; };
+
+static void parallel_increment(void* darr, size_t begin, size_t end, void* ctx)
+{
+    (void)ctx;
+    struct triple* da = darr;
+    for (size_t i = begin; i < end; ++i)
+    {
+        da[i].a += 1;
+        da[i].c = (unsigned)i;
+    }
+}
+
+static void parallel_sum(void* acc, void* darr, size_t begin, size_t end,
+    void* ctx)
+{
+    (void)ctx;
+    unsigned long long* sum = acc;
+    unsigned* da = darr;
+    for (size_t i = begin; i < end; ++i)
+    {
+        *sum += da[i];
+    }
+}
+
+static void parallel_add(void* acc, const void* other, void* ctx)
+{
+    (void)ctx;
+    *(unsigned long long*)acc += *(const unsigned long long*)other;
+}
+
+EMU_TEST(da_parallel_for)
+{
+    const size_t lengths[] = {0, 1, 100, 100003};
+    const size_t nthreads[] = {0, 1, 3, 8};
+    for (size_t l = 0; l < sizeof(lengths)/sizeof(lengths[0]); ++l)
+    {
+        for (size_t t = 0; t < sizeof(nthreads)/sizeof(nthreads[0]); ++t)
+        {
+            struct triple* da = da_alloc(lengths[l], sizeof(struct triple));
+            EMU_REQUIRE_NOT_NULL(da);
+            memset(da, 0, lengths[l]*sizeof(struct triple));
+            da_parallel_for(da, nthreads[t], parallel_increment, NULL);
+            // every element is visited exactly once
+            int ok = 1;
+            for (size_t i = 0; i < lengths[l]; ++i)
+            {
+                ok &= da[i].a == 1 && da[i].c == i;
+            }
+            EMU_EXPECT_TRUE(ok);
+            da_free(da);
+        }
+    }
+    EMU_END_TEST();
+}
+
+EMU_TEST(da_parallel_reduce)
+{
+    unsigned* da = da_alloc(1000000, sizeof(unsigned));
+    EMU_REQUIRE_NOT_NULL(da);
+    for (unsigned i = 0; i < 1000000; ++i)
+    {
+        da[i] = i;
+    }
+    const size_t nthreads[] = {0, 1, 4, 16};
+    for (size_t t = 0; t < sizeof(nthreads)/sizeof(nthreads[0]); ++t)
+    {
+        unsigned long long sum = 0;
+        EMU_EXPECT_EQ_INT(da_parallel_reduce(da, nthreads[t], parallel_sum,
+            parallel_add, &sum, &sum, sizeof(sum), NULL), 0);
+        EMU_EXPECT_EQ_UINT(sum, 999999ULL*1000000ULL/2);
+    }
+    da_free(da);
+    EMU_END_TEST();
+}
+
+#define RING_ELEMENTS 1000000
+
+static void* ring_producer(void* arg)
+{
+    unsigned chunk[7];
+    for (unsigned next = 0; next < RING_ELEMENTS;)
+    {
+        // alternate single pushes with bulk writes of odd sizes
+        if (next % 2 == 0)
+        {
+            if (da_ring_push(arg, &next) == 0)
+            {
+                next += 1;
+            }
+            else
+            {
+                sched_yield();
+            }
+            continue;
+        }
+        unsigned n = 0;
+        while (n < 7 && next + n < RING_ELEMENTS)
+        {
+            chunk[n] = next + n;
+            n += 1;
+        }
+        size_t written = da_ring_write(arg, chunk, n);
+        if (written == 0)
+        {
+            sched_yield();
+        }
+        next += written;
+    }
+    return NULL;
+}
+
+EMU_TEST(da_ring_spsc)
+{
+    struct da_ring ring;
+    EMU_REQUIRE_TRUE(da_ring_init(&ring, 100, sizeof(unsigned), NULL) == 0);
+    // the indices written by each thread never share a cache line
+    EMU_EXPECT_GE_UINT((uintptr_t)&ring.head - (uintptr_t)&ring.elsz,
+        DA_CACHE_LINE_SIZE);
+    EMU_EXPECT_GE_UINT((uintptr_t)&ring.tail - (uintptr_t)&ring.head,
+        DA_CACHE_LINE_SIZE);
+    pthread_t producer;
+    pthread_create(&producer, NULL, ring_producer, &ring);
+    unsigned expected = 0;
+    int order_ok = 1;
+    unsigned buf[16];
+    while (expected < RING_ELEMENTS)
+    {
+        size_t n = da_ring_read(&ring, buf, 1 + expected % 16);
+        if (n == 0)
+        {
+            sched_yield();
+        }
+        for (size_t i = 0; i < n; ++i)
+        {
+            order_ok &= buf[i] == expected++;
+        }
+    }
+    pthread_join(producer, NULL);
+    EMU_EXPECT_TRUE(order_ok);
+    EMU_EXPECT_EQ_UINT(da_ring_length(&ring), 0);
+    da_ring_destroy(&ring);
+    EMU_END_TEST();
+}
+
+#define SHARE_THREADS 8
+static void* share_writer(void* arg)
+{
+    // every thread writes to its own copy of the shared darray
+    int* da = arg;
+    for (int i = 0; i < 100; ++i)
+    {
+        da_push(da, -i);
+    }
+    int ok = da_length(da) == 1100 && da[999] == 999 && da[1099] == -99;
+    da_free(da);
+    return ok ? arg : NULL;
+}
+
+EMU_TEST(da_share_threads)
+{
+    int* da = da_alloc(1000, sizeof(int));
+    EMU_REQUIRE_NOT_NULL(da);
+    for (int i = 0; i < 1000; ++i){da[i] = i;}
+    pthread_t threads[SHARE_THREADS];
+    for (int t = 0; t < SHARE_THREADS; ++t)
+    {
+        pthread_create(&threads[t], NULL, share_writer, da_share(da));
+    }
+    int ok = 1;
+    for (int t = 0; t < SHARE_THREADS; ++t)
+    {
+        void* result;
+        pthread_join(threads[t], &result);
+        ok &= result != NULL;
+    }
+    EMU_EXPECT_TRUE(ok);
+    EMU_EXPECT_EQ_UINT(da_refcount(da), 1);
+    EMU_EXPECT_EQ_UINT(da_length(da), 1000);
+    for (int i = 0; i < 1000; ++i)
+    {
+        ok &= da[i] == i;
+    }
+    EMU_EXPECT_TRUE(ok);
+    da_free(da);
+    EMU_END_TEST();
+}
+#endif // DA_TEST_THREADS
+
+static int cmp_int(const void* a, const void* b)
+{
+    int x = *(const int*)a;
+    int y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+struct keyed { int key; int seq; char pad[40]; };
+
+static int cmp_keyed(const void* a, const void* b)
+{
+    return cmp_int(&((const struct keyed*)a)->key, &((const struct keyed*)b)->key);
+}
+
+#define INT_LESS(a, b) ((a) < (b))
+DA_DECLARE_SORT(int, ints, INT_LESS)
+
+// Fill `da` with one of several input patterns that stress different paths.
+static void fill_sort_input(int* da, size_t n, int pattern)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        switch (pattern)
+        {
+        case 0: da[i] = rand() - RAND_MAX/2; break;
+        case 1: da[i] = (int)i; break;
+        case 2: da[i] = (int)(n - i); break;
+        case 3: da[i] = 7; break;
+        default: da[i] = rand() % 4; break;
+        }
+    }
+}
+
+static int is_sorted_int(const int* da, size_t n)
+{
+    for (size_t i = 1; i < n; ++i)
+    {
+        if (da[i - 1] > da[i])
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+EMU_TEST(da_sort)
+{
+    const size_t lengths[] = {0, 1, 2, 15, 17, 1000, 100000};
+    for (size_t l = 0; l < sizeof(lengths)/sizeof(lengths[0]); ++l)
+    {
+        for (int pattern = 0; pattern < 5; ++pattern)
+        {
+            int* da = da_alloc(lengths[l], sizeof(int));
+            EMU_REQUIRE_NOT_NULL(da);
+            fill_sort_input(da, lengths[l], pattern);
+            da_sort(da, cmp_int);
+            EMU_EXPECT_TRUE(is_sorted_int(da, lengths[l]));
+            fill_sort_input(da, lengths[l], pattern);
+            ints_sort(da);
+            EMU_EXPECT_TRUE(is_sorted_int(da, lengths[l]));
+            da_free(da);
+        }
+    }
+
+    // elements larger than a machine word
+    struct keyed* kda = da_alloc(5000, sizeof(struct keyed));
+    EMU_REQUIRE_NOT_NULL(kda);
+    for (int i = 0; i < 5000; ++i)
+    {
+        kda[i].key = rand() % 1000;
+        kda[i].seq = kda[i].key;
+    }
+    da_sort(kda, cmp_keyed);
+    int ok = 1;
+    for (int i = 1; i < 5000; ++i)
+    {
+        ok &= kda[i - 1].key <= kda[i].key && kda[i].seq == kda[i].key;
+    }
+    EMU_EXPECT_TRUE(ok);
+    da_free(kda);
+    EMU_END_TEST();
+}
+
+EMU_TEST(da_sort_radix)
+{
+    int* ida = da_alloc(10000, sizeof(int));
+    EMU_REQUIRE_NOT_NULL(ida);
+    fill_sort_input(ida, 10000, 0);
+    EMU_EXPECT_EQ_INT(da_sort_radix(ida, DA_SORT_SIGNED), 0);
+    EMU_EXPECT_TRUE(is_sorted_int(ida, 10000));
+    // all-equal input skips every pass
+    fill_sort_input(ida, 10000, 3);
+    EMU_EXPECT_EQ_INT(da_sort_radix(ida, DA_SORT_SIGNED), 0);
+    EMU_EXPECT_TRUE(is_sorted_int(ida, 10000));
+    da_free(ida);
+
+    uint64_t* uda = da_alloc(10000, sizeof(uint64_t));
+    EMU_REQUIRE_NOT_NULL(uda);
+    for (size_t i = 0; i < 10000; ++i)
+    {
+        uda[i] = ((uint64_t)rand() << 40) ^ (uint64_t)rand();
+    }
+    EMU_EXPECT_EQ_INT(da_sort_radix(uda, DA_SORT_UNSIGNED), 0);
+    int ok = 1;
+    for (size_t i = 1; i < 10000; ++i)
+    {
+        ok &= uda[i - 1] <= uda[i];
+    }
+    EMU_EXPECT_TRUE(ok);
+    da_free(uda);
+
+    double* dda = da_alloc(10000, sizeof(double));
+    EMU_REQUIRE_NOT_NULL(dda);
+    for (size_t i = 0; i < 10000; ++i)
+    {
+        dda[i] = (rand() - RAND_MAX/2) / 1000.0;
+    }
+    dda[0] = -0.0;
+    dda[1] = 0.0;
+    EMU_EXPECT_EQ_INT(da_sort_radix(dda, DA_SORT_FLOAT), 0);
+    ok = 1;
+    for (size_t i = 1; i < 10000; ++i)
+    {
+        ok &= dda[i - 1] <= dda[i];
+    }
+    EMU_EXPECT_TRUE(ok);
+    da_free(dda);
+
+    float* fda = da_alloc(3, sizeof(float));
+    EMU_REQUIRE_NOT_NULL(fda);
+    fda[0] = 1.5f; fda[1] = -2.5f; fda[2] = -0.5f;
+    EMU_EXPECT_EQ_INT(da_sort_radix(fda, DA_SORT_FLOAT), 0);
+    EMU_EXPECT_TRUE(fda[0] == -2.5f && fda[1] == -0.5f && fda[2] == 1.5f);
+    da_free(fda);
+
+    // element sizes without a radix key are rejected
+    struct keyed* kda = da_alloc(3, sizeof(struct keyed));
+    EMU_REQUIRE_NOT_NULL(kda);
+    EMU_EXPECT_EQ_INT(da_sort_radix(kda, DA_SORT_UNSIGNED), -1);
+    int16_t* sda = da_alloc(3, sizeof(int16_t));
+    EMU_REQUIRE_NOT_NULL(sda);
+    EMU_EXPECT_EQ_INT(da_sort_radix(sda, DA_SORT_FLOAT), -1);
+    da_free(kda);
+    da_free(sda);
+    EMU_END_TEST();
+}
+
+EMU_TEST(da_lower_upper_bound)
+{
+    int* da = da_alloc(0, sizeof(int));
+    EMU_REQUIRE_NOT_NULL(da);
+    int key = 5;
+    EMU_EXPECT_EQ_UINT(da_lower_bound(da, &key, cmp_int), 0);
+    EMU_EXPECT_EQ_UINT(da_upper_bound(da, &key, cmp_int), 0);
+
+    // 0 0 0 1 1 1 2 2 2 ... 99 99 99
+    for (int i = 0; i < 300; ++i)
+    {
+        da_push(da, i/3);
+    }
+    for (key = -1; key <= 100; ++key)
+    {
+        size_t expected_lower = key < 0 ? 0 : key > 99 ? 300 : (size_t)key*3;
+        size_t expected_upper = key < 0 ? 0 : key > 99 ? 300 : (size_t)key*3 + 3;
+        EMU_EXPECT_EQ_UINT(da_lower_bound(da, &key, cmp_int), expected_lower);
+        EMU_EXPECT_EQ_UINT(da_upper_bound(da, &key, cmp_int), expected_upper);
+    }
+    da_free(da);
+    EMU_END_TEST();
+}
+
+EMU_TEST(da_insert_remove_sorted)
+{
+    int* da = da_alloc(0, sizeof(int));
+    EMU_REQUIRE_NOT_NULL(da);
+    for (int i = 0; i < 1000; ++i)
+    {
+        int value = rand() % 100;
+        da = da_insert_sorted(da, &value, cmp_int);
+        EMU_REQUIRE_NOT_NULL(da);
+    }
+    EMU_EXPECT_EQ_UINT(da_length(da), 1000);
+    EMU_EXPECT_TRUE(is_sorted_int(da, 1000));
+
+    int missing = 1000;
+    EMU_EXPECT_EQ_INT(da_remove_sorted(da, &missing, cmp_int), 0);
+    size_t removed = 0;
+    for (int value = 0; value < 100; ++value)
+    {
+        while (da_remove_sorted(da, &value, cmp_int))
+        {
+            ++removed;
+            EMU_EXPECT_TRUE(is_sorted_int(da, da_length(da)));
+        }
+    }
+    EMU_EXPECT_EQ_UINT(removed, 1000);
+    EMU_EXPECT_EQ_UINT(da_length(da), 0);
+    da_free(da);
+    EMU_END_TEST();
+}
+
+EMU_TEST(da_merge_sorted)
+{
+    struct keyed* da = da_alloc(0, sizeof(struct keyed));
+    EMU_REQUIRE_NOT_NULL(da);
+    struct keyed batch[50];
+    int seq = 0;
+    for (int round = 0; round < 20; ++round)
+    {
+        for (int i = 0; i < 50; ++i)
+        {
+            batch[i].key = rand() % 200;
+        }
+        qsort(batch, 50, sizeof(batch[0]), cmp_keyed);
+        for (int i = 0; i < 50; ++i)
+        {
+            batch[i].seq = seq++;
+        }
+        da = da_merge_sorted(da, batch, 50, cmp_keyed);
+        EMU_REQUIRE_NOT_NULL(da);
+    }
+    EMU_EXPECT_EQ_UINT(da_length(da), 1000);
+    // sorted, with earlier insertions before later ones among equal keys
+    int ok = 1;
+    for (size_t i = 1; i < 1000; ++i)
+    {
+        ok &= da[i - 1].key < da[i].key
+            || (da[i - 1].key == da[i].key && da[i - 1].seq < da[i].seq);
+    }
+    EMU_EXPECT_TRUE(ok);
+    // merging nothing is a no-op
+    da = da_merge_sorted(da, batch, 0, cmp_keyed);
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ_UINT(da_length(da), 1000);
+    da_free(da);
+    EMU_END_TEST();
+}
 
-#define INITIAL_NUM_ELEMS 10
-#define RESIZE_NUM_ELEMS 100
+#ifdef DA_TEST_THREADS
+EMU_TEST(da_sort_parallel)
+{
+    const size_t nthreads[] = {0, 1, 3, 8};
+    for (size_t t = 0; t < sizeof(nthreads)/sizeof(nthreads[0]); ++t)
+    {
+        struct keyed* da = da_alloc(200000, sizeof(struct keyed));
+        EMU_REQUIRE_NOT_NULL(da);
+        for (int i = 0; i < 200000; ++i)
+        {
+            da[i].key = rand() % 1000;
+            da[i].seq = i;
+        }
+        EMU_EXPECT_EQ_INT(da_sort_parallel(da, nthreads[t], cmp_keyed), 0);
+        // sorted, and stable
+        int ok = 1;
+        for (int i = 1; i < 200000; ++i)
+        {
+            ok &= da[i - 1].key < da[i].key
+                || (da[i - 1].key == da[i].key && da[i - 1].seq < da[i].seq);
+        }
+        EMU_EXPECT_TRUE(ok);
+        da_free(da);
+    }
+    EMU_END_TEST();
+}
+#endif // DA_TEST_THREADS
 
-EMU_TEST(alloc_and_free_functions)
+struct vec3 { double x, y, z; };
+DA_DECLARE_TYPED(int, ints)
+DA_DECLARE_TYPED(struct vec3, vec3s)
+
+EMU_TEST(da_declare_typed)
 {
-    int* da = da_alloc(INITIAL_NUM_ELEMS, sizeof(int));
+    int* da = ints_alloc(0);
     EMU_REQUIRE_NOT_NULL(da);
-    for (size_t i = 0; i < INITIAL_NUM_ELEMS; ++i) // writiable without crashing
+    for (int i = 0; i < 100; ++i)
     {
-        da[i] = i;
+        da = ints_push(da, i);
+        EMU_REQUIRE_NOT_NULL(da);
+    }
+    da = ints_insert(da, 0, -1);
+    EMU_REQUIRE_NOT_NULL(da);
+    da = ints_insert(da, 50, -2);
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ_UINT(da_length(da), 102);
+    EMU_EXPECT_EQ_INT(da[0], -1);
+    EMU_EXPECT_EQ_INT(da[49], 48);
+    EMU_EXPECT_EQ_INT(da[50], -2);
+    EMU_EXPECT_EQ_INT(da[51], 49);
+
+    EMU_EXPECT_EQ_INT(ints_remove(&da, 50), -2);
+    EMU_EXPECT_EQ_INT(ints_remove(&da, 0), -1);
+    EMU_EXPECT_EQ_INT(ints_pop(&da), 99);
+    EMU_EXPECT_EQ_INT(ints_swap_remove(&da, 0), 0);
+    EMU_EXPECT_EQ_UINT(da_length(da), 98);
+    EMU_EXPECT_EQ_INT(da[0], 98);
+    for (int i = 1; i < 98; ++i)
+    {
+        EMU_EXPECT_EQ_INT(da[i], i);
     }
-
     da_free(da);
+
+    struct vec3* vs = vec3s_alloc(0);
+    EMU_REQUIRE_NOT_NULL(vs);
+    for (int i = 0; i < 20; ++i)
+    {
+        struct vec3 v = {i, 2*i, 3*i};
+        vs = vec3s_insert(vs, 0, v);
+        EMU_REQUIRE_NOT_NULL(vs);
+    }
+    struct vec3 r = vec3s_remove(&vs, 0);
+    EMU_EXPECT_EQ_INT(r.z, 57);
+    EMU_EXPECT_EQ_INT(vs[0].y, 36);
+    EMU_EXPECT_EQ_INT(vs[18].x, 0);
+    EMU_EXPECT_EQ_UINT(da_length(vs), 19);
+    da_free(vs);
     EMU_END_TEST();
 }
 
@@ -96,67 +1239,931 @@ EMU_TEST(da_reserve)
     EMU_REQUIRE_NOT_NULL(da);
     EMU_EXPECT_EQ(da2, da);
 
-    da_free(da);
+    da_free(da);
+    EMU_END_TEST();
+}
+
+EMU_TEST(da_shrink_to_fit)
+{
+    int* da = da_alloc(INITIAL_NUM_ELEMS, sizeof(int));
+    for (size_t i = 0; i < INITIAL_NUM_ELEMS; ++i)
+    {
+        da[i] = i;
+    }
+
+    // downsizing keeps the current block and capacity
+    da = da_reserve(da, RESIZE_NUM_ELEMS);
+    EMU_REQUIRE_NOT_NULL(da);
+    size_t capacity = da_capacity(da);
+    int* before = da;
+    da = da_resize(da, 5);
+    EMU_EXPECT_EQ(da, before);
+    EMU_EXPECT_EQ_UINT(da_capacity(da), capacity);
+
+    da = da_shrink_to_fit(da);
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ_UINT(da_capacity(da), 5);
+    EMU_EXPECT_EQ_UINT(da_length(da), 5);
+    for (size_t i = 0; i < 5; ++i)
+    {
+        EMU_EXPECT_EQ_INT(da[i], (int)i);
+    }
+
+    // still usable after shrinking
+    da_push(da, 5);
+    EMU_EXPECT_EQ_UINT(da_length(da), 6);
+    EMU_EXPECT_EQ_INT(da[5], 5);
+
+    da_free(da);
+    EMU_END_TEST();
+}
+
+EMU_TEST(da_auto_shrink)
+{
+    struct da_attr attr = {0};
+    attr.flags = DA_FLAG_AUTO_SHRINK;
+    int* da = da_alloc_attr(0, sizeof(int), &attr);
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ_UINT(da_flags(da), DA_FLAG_AUTO_SHRINK);
+    for (int i = 0; i < 1000; ++i)
+    {
+        da_push(da, i);
+    }
+    size_t peak = da_capacity(da);
+
+    // popped and removed values survive the shrinking of the block
+    for (int i = 999; i >= 100; --i)
+    {
+        EMU_EXPECT_EQ_INT(da_pop(da), i);
+        EMU_EXPECT_GE_UINT(da_length(da)*4 + 4, da_capacity(da)/2);
+    }
+    EMU_EXPECT_LT_UINT(da_capacity(da), peak/2);
+    for (int i = 0; i < 90; ++i)
+    {
+        EMU_EXPECT_EQ_INT(da_remove(da, 0), i);
+    }
+    EMU_EXPECT_EQ_UINT(da_length(da), 10);
+    for (int i = 0; i < 10; ++i)
+    {
+        EMU_EXPECT_EQ_INT(da[i], 90 + i);
+    }
+    EMU_EXPECT_LT_UINT(da_capacity(da), 100);
+
+    // resizing down far enough also shrinks
+    for (int i = 0; i < 1000; ++i)
+    {
+        da_push(da, i);
+    }
+    peak = da_capacity(da);
+    da = da_resize(da, 10);
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_LT_UINT(da_capacity(da), peak);
+    EMU_EXPECT_EQ_INT(da[9], 99);
+
+    da_free(da);
+    EMU_END_TEST();
+}
+
+EMU_TEST(da_push)
+{
+    const int max_index = 15;
+    int* da = da_alloc(0, sizeof(int));
+
+    for (int i = 0; i <= max_index; ++i)
+    {
+        da_push(da, i);
+    }
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ_UINT(da_length(da), max_index+1);
+    for (int i = 0; i <= max_index; ++i)
+    {
+        EMU_EXPECT_EQ_INT(da[i], i);
+    }
+
+    da_free(da);
+    EMU_END_TEST();
+}
+
+EMU_TEST(da_spush)
+{
+    const int max_index = 15;
+    int* da = da_alloc(0, sizeof(int));
+    int* bak = NULL;
+
+    for (int i = 0; i <= max_index; ++i)
+    {
+        da_spush(da, i, bak);
+        EMU_REQUIRE_NOT_NULL(da);
+    }
+    // The backup is only written when the darray grows. Whether realloc then
+    // moved the block depends on the allocator, so only that is checked.
+    EMU_EXPECT_NOT_NULL(bak);
+    da = da_reserve(da, 1);
+    EMU_REQUIRE_NOT_NULL(da);
+    bak = NULL;
+    da_spush(da, max_index + 1, bak);
+    EMU_EXPECT_NULL(bak);
+    EMU_EXPECT_EQ_INT(da_pop(da), max_index + 1);
+    EMU_EXPECT_EQ_UINT(da_length(da), max_index+1);
+    for (int i = 0; i <= max_index; ++i)
+    {
+        EMU_EXPECT_EQ_INT(da[i], i);
+    }
+
+    da_free(da);
+    EMU_END_TEST();
+}
+
+EMU_TEST(da_append)
+{
+    const int src[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+    int* da = da_alloc(0, sizeof(int));
+
+    da = da_append(da, src, 15);
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ_UINT(da_length(da), 15);
+    da = da_append(da, src, 3);
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ_UINT(da_length(da), 18);
+    for (int i = 0; i < 15; ++i)
+    {
+        EMU_EXPECT_EQ_INT(da[i], i+1);
+    }
+    EMU_EXPECT_EQ_INT(da[15], 1);
+    EMU_EXPECT_EQ_INT(da[17], 3);
+
+    // appending nothing leaves the darray untouched
+    da = da_append(da, src, 0);
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ_UINT(da_length(da), 18);
+
+    da_free(da);
+    EMU_END_TEST();
+}
+
+EMU_TEST(da_insert_n)
+{
+    const int src[] = {7, 8, 9};
+    int* da = da_alloc(2, sizeof(int));
+    da[0] = 3;
+    da[1] = 5;
+
+    // insert in middle
+    da = da_insert_n(da, 1, src, 3);
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ_UINT(da_length(da), 5);
+    EMU_EXPECT_EQ_INT(da[0], 3);
+    EMU_EXPECT_EQ_INT(da[1], 7);
+    EMU_EXPECT_EQ_INT(da[2], 8);
+    EMU_EXPECT_EQ_INT(da[3], 9);
+    EMU_EXPECT_EQ_INT(da[4], 5);
+
+    // insert at front
+    da = da_insert_n(da, 0, src, 2);
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ_UINT(da_length(da), 7);
+    EMU_EXPECT_EQ_INT(da[0], 7);
+    EMU_EXPECT_EQ_INT(da[1], 8);
+    EMU_EXPECT_EQ_INT(da[2], 3);
+
+    // insert at back
+    da = da_insert_n(da, 7, src, 3);
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ_UINT(da_length(da), 10);
+    EMU_EXPECT_EQ_INT(da[6], 5);
+    EMU_EXPECT_EQ_INT(da[7], 7);
+    EMU_EXPECT_EQ_INT(da[9], 9);
+
+    // growth past the current capacity
+    int big[100];
+    for (int i = 0; i < 100; ++i)
+    {
+        big[i] = -i;
+    }
+    da = da_insert_n(da, 5, big, 100);
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ_UINT(da_length(da), 110);
+    EMU_EXPECT_EQ_INT(da[4], 8);
+    EMU_EXPECT_EQ_INT(da[5], 0);
+    EMU_EXPECT_EQ_INT(da[104], -99);
+    EMU_EXPECT_EQ_INT(da[105], 9);
+    EMU_EXPECT_EQ_INT(da[109], 9);
+
+    da_free(da);
+    EMU_END_TEST();
+}
+
+EMU_TEST(da_pop)
+{
+    int* da = da_alloc(2, sizeof(int));
+    da[0] = 3;
+    da[1] = 5;
+
+    EMU_EXPECT_EQ_INT(da_pop(da), 5);
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ_UINT(da_length(da), 1);
+
+    EMU_EXPECT_EQ_INT(da_pop(da), 3);
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ_UINT(da_length(da), 0);
+
+    da_free(da);
+    EMU_END_TEST();
+}
+
+EMU_TEST(da_push_pop_front)
+{
+    int* da = da_alloc(2, sizeof(int));
+    da[0] = 3;
+    da[1] = 5;
+    for (int i = 0; i < 100; ++i)
+    {
+        int* tmp = da_push_front(da, &i);
+        EMU_REQUIRE_NOT_NULL(tmp);
+        da = tmp;
+    }
+    EMU_EXPECT_EQ_UINT(da_length(da), 102);
+    EMU_EXPECT_GE_UINT(da_capacity(da), 102);
+    EMU_EXPECT_EQ_INT(da[0], 99);
+    EMU_EXPECT_EQ_INT(da[99], 0);
+    EMU_EXPECT_EQ_INT(da[100], 3);
+    EMU_EXPECT_EQ_INT(da[101], 5);
+    EMU_EXPECT_EQ_UINT(da_sizeof_elem(da), sizeof(int));
+
+    int value = 0;
+    da = da_pop_front(da, &value);
+    EMU_EXPECT_EQ_INT(value, 99);
+    da = da_pop_front(da, NULL);
+    EMU_EXPECT_EQ_UINT(da_length(da), 100);
+    EMU_EXPECT_EQ_INT(da[0], 97);
+#ifdef DA_ENABLE_FRONT_SLACK
+    // every element size keeps its front slack
+    EMU_EXPECT_NE_UINT(*DA_P_FRONT_FROM_HANDLE(da), 0);
+#endif
+
+    // pushing at the back reuses the slots freed at the front
+    size_t slots = da_capacity(da) + *DA_P_FRONT_FROM_HANDLE(da);
+    while (da_length(da) < slots)
+    {
+        da_push(da, 7);
+    }
+    EMU_EXPECT_EQ_UINT(*DA_P_FRONT_FROM_HANDLE(da), 0);
+    EMU_EXPECT_GE_UINT(da_capacity(da), slots);
+    EMU_EXPECT_EQ_INT(da[0], 97);
+    EMU_EXPECT_EQ_INT(da[99], 5);
+    EMU_EXPECT_EQ_INT(da[slots-1], 7);
+    da_free(da);
+
+    // a FIFO of bytes, whose header must stay aligned
+    char* fifo = da_alloc(0, sizeof(char));
+    for (int round = 0; round < 3; ++round)
+    {
+        for (char c = 'a'; c <= 'z'; ++c)
+        {
+            da_push(fifo, c);
+        }
+        for (char c = 'a'; c <= 'z'; ++c)
+        {
+            char out;
+            fifo = da_pop_front(fifo, &out);
+            EMU_EXPECT_EQ_INT(out, c);
+        }
+        EMU_EXPECT_EQ_UINT(da_length(fifo), 0);
+    }
+    for (char c = 'a'; c <= 'z'; ++c)
+    {
+        fifo = da_push_front(fifo, &c);
+        EMU_REQUIRE_NOT_NULL(fifo);
+        EMU_EXPECT_EQ_INT(fifo[0], c);
+    }
+    EMU_EXPECT_EQ_INT(fifo[25], 'a');
+    fifo = da_shrink_to_fit(fifo);
+    EMU_REQUIRE_NOT_NULL(fifo);
+    EMU_EXPECT_EQ_UINT(*DA_P_FRONT_FROM_HANDLE(fifo), 0);
+    EMU_EXPECT_EQ_UINT(da_capacity(fifo), 26);
+    EMU_EXPECT_EQ_INT(fifo[0], 'z');
+    EMU_EXPECT_EQ_INT(fifo[25], 'a');
+    da_free(fifo);
+
+    // word sized elements always move their handle into front slack
+    size_t* words = da_alloc(1, sizeof(size_t));
+    words[0] = 1;
+    size_t two = 2;
+    words = da_push_front(words, &two);
+    EMU_REQUIRE_NOT_NULL(words);
+    EMU_EXPECT_NE_UINT(*DA_P_FRONT_FROM_HANDLE(words), 0);
+    EMU_EXPECT_EQ_UINT((uintptr_t)words % sizeof(size_t), 0);
+    EMU_EXPECT_EQ_UINT(words[0], 2);
+    EMU_EXPECT_EQ_UINT(words[1], 1);
+    da_free(words);
+    EMU_END_TEST();
+}
+
+// Allocator whose allocations fail while `*(int*)ctx` is nonzero.
+static void* failing_alloc(void* ctx, size_t size)
+{
+    return *(int*)ctx ? NULL : malloc(size);
+}
+
+static void* failing_realloc(void* ctx, void* ptr, size_t old_size,
+    size_t new_size)
+{
+    (void)old_size;
+    return *(int*)ctx ? NULL : realloc(ptr, new_size);
+}
+
+static void failing_free(void* ctx, void* ptr, size_t size)
+{
+    (void)ctx;
+    (void)size;
+    free(ptr);
+}
+
+EMU_TEST(da_share)
+{
+    int* da = da_alloc(RESIZE_NUM_ELEMS, sizeof(int));
+    EMU_REQUIRE_NOT_NULL(da);
+    for (size_t i = 0; i < da_length(da); ++i){da[i] = i;}
+    EMU_EXPECT_EQ_UINT(da_refcount(da), 1);
+    EMU_EXPECT_EQ(da_unshare(da), da);
+
+    // sharing is O(1) and returns the same block
+    int* shared = da_share(da);
+    EMU_EXPECT_EQ(shared, da);
+    EMU_EXPECT_EQ_UINT(da_refcount(da), 2);
+    EMU_EXPECT_TRUE(da_flags(da) & DA_FLAG_SHARED);
+    da_free(shared);
+    EMU_EXPECT_EQ_UINT(da_refcount(da), 1);
+    EMU_EXPECT_EQ(da_unshare(da), da);
+    EMU_EXPECT_FALSE(da_flags(da) & DA_FLAG_SHARED);
+
+    // the first push copies, even with spare capacity
+    da = da_reserve(da, 10);
+    int* pushed = da_share(da);
+    da_push(pushed, -1);
+    EMU_EXPECT_TRUE(pushed != da);
+    EMU_EXPECT_EQ_UINT(da_refcount(da), 1);
+    EMU_EXPECT_EQ_UINT(da_refcount(pushed), 1);
+    EMU_EXPECT_EQ_UINT(da_length(da), RESIZE_NUM_ELEMS);
+    EMU_EXPECT_EQ_UINT(da_length(pushed), RESIZE_NUM_ELEMS + 1);
+    EMU_EXPECT_EQ_INT(pushed[RESIZE_NUM_ELEMS], -1);
+    EMU_EXPECT_EQ_INT(pushed[RESIZE_NUM_ELEMS - 1], RESIZE_NUM_ELEMS - 1);
+    da_free(pushed);
+
+    int* inserted = da_share(da);
+    da_insert(inserted, 0, -1);
+    EMU_EXPECT_EQ_INT(inserted[0], -1);
+    EMU_EXPECT_EQ_INT(inserted[1], 0);
+    EMU_EXPECT_EQ_INT(da[0], 0);
+    da_free(inserted);
+
+    int* removed = da_share(da);
+    EMU_EXPECT_EQ_INT(da_remove(removed, 0), 0);
+    EMU_EXPECT_EQ_INT(da_swap_remove(removed, 0), 1);
+    EMU_EXPECT_EQ_INT(da_pop(removed), RESIZE_NUM_ELEMS - 2);
+    EMU_EXPECT_EQ_UINT(da_length(removed), RESIZE_NUM_ELEMS - 3);
+    EMU_EXPECT_EQ_INT(removed[0], RESIZE_NUM_ELEMS - 1);
+    da_free(removed);
+
+    int* resized = da_resize(da_share(da), 10);
+    EMU_EXPECT_EQ_UINT(da_length(resized), 10);
+    da_free(resized);
+
+    int* appended = da_append(da_share(da), da, 5);
+    EMU_EXPECT_EQ_UINT(da_length(appended), RESIZE_NUM_ELEMS + 5);
+    EMU_EXPECT_EQ_INT(appended[RESIZE_NUM_ELEMS + 4], 4);
+    da_free(appended);
+
+    int* fronted = da_share(da);
+    int value = -1;
+    fronted = da_push_front(fronted, &value);
+    EMU_EXPECT_EQ_INT(fronted[0], -1);
+    int* popped = da_pop_front(da_share(fronted), &value);
+    EMU_EXPECT_EQ_INT(popped[0], 0);
+    EMU_EXPECT_EQ_UINT(da_refcount(popped), 1);
+    EMU_EXPECT_EQ_UINT(da_refcount(fronted), 1);
+    EMU_EXPECT_EQ_INT(fronted[0], -1);
+    da_free(popped);
+    da_free(fronted);
+
+    // writes through the bracket operator need an unshared darray
+    int* written = da_unshare(da_share(da));
+    EMU_EXPECT_TRUE(written != da);
+    written[0] = -1;
+    EMU_EXPECT_EQ_INT(da[0], 0);
+    da_free(written);
+
+    int* shrunk = da_shrink_to_fit(da_share(da));
+    EMU_EXPECT_EQ_UINT(da_capacity(shrunk), RESIZE_NUM_ELEMS);
+    da_free(shrunk);
+
+    // removals that return nothing else return the handle of the copy
+    int* ranged = da_remove_range(da_share(da), 0, 5);
+    EMU_REQUIRE_NOT_NULL(ranged);
+    EMU_EXPECT_TRUE(ranged != da);
+    EMU_EXPECT_EQ_UINT(da_length(ranged), RESIZE_NUM_ELEMS - 5);
+    EMU_EXPECT_EQ_INT(ranged[0], 5);
+    da_free(ranged);
+
+    size_t indices[2] = {0, 1};
+    int* swapped = da_swap_remove_many(da_share(da), indices, 2);
+    EMU_REQUIRE_NOT_NULL(swapped);
+    EMU_EXPECT_TRUE(swapped != da);
+    EMU_EXPECT_EQ_UINT(da_length(swapped), RESIZE_NUM_ELEMS - 2);
+    EMU_EXPECT_EQ_INT(swapped[0], RESIZE_NUM_ELEMS - 2);
+    EMU_EXPECT_EQ_INT(swapped[1], RESIZE_NUM_ELEMS - 1);
+    da_free(swapped);
+
+    int sorted_key = 3;
+    int* sorted = da_share(da);
+    EMU_EXPECT_EQ_INT(da_remove_sorted(sorted, &sorted_key, cmp_int), -1);
+    sorted = da_unshare(sorted);
+    EMU_REQUIRE_NOT_NULL(sorted);
+    EMU_EXPECT_EQ_INT(da_remove_sorted(sorted, &sorted_key, cmp_int), 1);
+    EMU_EXPECT_EQ_UINT(da_length(sorted), RESIZE_NUM_ELEMS - 1);
+    da_free(sorted);
+
+    int gap_value = -1;
+    int* gapped = da_gap_insert(da_share(da), 10, &gap_value);
+    EMU_REQUIRE_NOT_NULL(gapped);
+    EMU_EXPECT_TRUE(gapped != da);
+    EMU_EXPECT_EQ_INT(*(int*)da_gap_at(gapped, 10), -1);
+    EMU_EXPECT_EQ_UINT(da_length(gapped), RESIZE_NUM_ELEMS + 1);
+    da_free(gapped);
+
+    int* gap_removed = da_gap_remove(da_share(da), 10);
+    EMU_REQUIRE_NOT_NULL(gap_removed);
+    EMU_EXPECT_TRUE(gap_removed != da);
+    EMU_EXPECT_EQ_UINT(da_length(gap_removed), RESIZE_NUM_ELEMS - 1);
+    EMU_EXPECT_EQ_INT(*(int*)da_gap_at(gap_removed, 10), 11);
+    da_free(gap_removed);
+
+    // nothing above touched the original
+    EMU_EXPECT_EQ_UINT(da_refcount(da), 1);
+    EMU_EXPECT_EQ_UINT(da_length(da), RESIZE_NUM_ELEMS);
+    for (size_t i = 0; i < da_length(da); ++i)
+    {
+        EMU_EXPECT_EQ_INT(da[i], (int)i);
+    }
+    da_free(da);
+
+    // a shared darray that cannot be copied is only read
+    int fail = 0;
+    struct da_allocator failing =
+        {failing_alloc, failing_realloc, failing_free, &fail};
+    struct da_attr attr = {0, NULL, &failing, 0};
+    da = da_alloc_attr(3, sizeof(int), &attr);
+    EMU_REQUIRE_NOT_NULL(da);
+    da[0] = 10; da[1] = 11; da[2] = 12;
+    int* orig = da;
+    da_share(da);
+    fail = 1;
+    EMU_EXPECT_EQ_INT(da_pop(da), 12);
+    EMU_EXPECT_EQ_INT(da_remove(da, 0), 10);
+    EMU_EXPECT_EQ_INT(da_swap_remove(da, 1), 11);
+    EMU_EXPECT_EQ_INT(ints_pop(&da), 12);
+    EMU_EXPECT_EQ_INT(ints_remove(&da, 0), 10);
+    EMU_EXPECT_EQ_INT(ints_swap_remove(&da, 1), 11);
+    EMU_EXPECT_NULL(da_remove_range(da, 0, 1));
+    EMU_EXPECT_NULL(da_swap_remove_many(da, indices, 1));
+    EMU_EXPECT_NULL(da_gap_remove(da, 0));
+    EMU_EXPECT_NULL(da_gap_insert(da, 0, &gap_value));
+    EMU_EXPECT_EQ(da, orig);
+    EMU_EXPECT_EQ_UINT(da_refcount(da), 2);
+    EMU_EXPECT_EQ_UINT(da_length(da), 3);
+    EMU_EXPECT_EQ_INT(da[0], 10);
+    EMU_EXPECT_EQ_INT(da[2], 12);
+    fail = 0;
+    EMU_EXPECT_EQ_INT(da_pop(da), 12);
+    EMU_EXPECT_TRUE(da != orig);
+    EMU_EXPECT_EQ_UINT(da_refcount(orig), 1);
+    EMU_EXPECT_EQ_UINT(da_length(orig), 3);
+    EMU_EXPECT_EQ_UINT(da_length(da), 2);
+    da_free(orig);
+    da_free(da);
+
+    // copies keep the alignment, and leave inline storage for the heap
+    da = da_alloc_aligned(10, sizeof(int), 64);
+    int* aligned = da_unshare(da_share(da));
+    EMU_EXPECT_EQ_UINT((uintptr_t)aligned % 64, 0);
+    da_free(aligned);
+    da_free(da);
+
+    char buf[DA_INLINE_BUFFER_SIZE(4, sizeof(int))];
+    da = da_init_inline(buf, sizeof(buf), sizeof(int));
+    da_push(da, 1);
+    int* spilled = da_share(da);
+    da_push(spilled, 2);
+    EMU_EXPECT_NULL(*DA_P_ALLOCATOR_FROM_HANDLE(spilled));
+    EMU_EXPECT_EQ_UINT(da_length(da), 1);
+    EMU_EXPECT_EQ_UINT(da_length(spilled), 2);
+    da_free(spilled);
+    da_free(da);
+    EMU_END_TEST();
+}
+
+EMU_TEST(da_init_inline)
+{
+    char small[DA_HANDLE_OFFSET - 1];
+    EMU_EXPECT_NULL(da_init_inline(small, sizeof(small), sizeof(int)));
+
+    char buf[DA_INLINE_BUFFER_SIZE(16, sizeof(int))];
+    EMU_EXPECT_NULL(da_init_inline(buf, sizeof(buf), 0));
+    int* da = da_init_inline(buf, sizeof(buf), sizeof(int));
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ_UINT(da_length(da), 0);
+    EMU_EXPECT_GE_UINT(da_capacity(da), 16);
+    EMU_EXPECT_EQ_UINT((uintptr_t)da % DA_ALIGNMENT_DEFAULT, 0);
+    EMU_EXPECT_TRUE((char*)da > buf && (char*)da < buf + sizeof(buf));
+    for (int i = 0; i < 16; ++i)
+    {
+        da_push(da, i);
+    }
+    EMU_EXPECT_TRUE((char*)da > buf && (char*)da < buf + sizeof(buf));
+
+    // the first growth moves the darray to the heap
+    size_t capacity = da_capacity(da);
+    while (da_length(da) <= capacity)
+    {
+        da_push(da, -1);
+    }
+    EMU_EXPECT_FALSE((char*)da > buf && (char*)da < buf + sizeof(buf));
+    EMU_EXPECT_NULL(*DA_P_ALLOCATOR_FROM_HANDLE(da));
+    for (int i = 0; i < 16; ++i)
+    {
+        EMU_EXPECT_EQ_INT(da[i], i);
+    }
+    EMU_EXPECT_EQ_INT(da[capacity], -1);
+    da_free(da);
+
+    // storage that is not aligned still works, and freeing it is harmless
+    double* unaligned = da_init_inline(buf + 1, sizeof(buf) - 1,
+        sizeof(double));
+    EMU_REQUIRE_NOT_NULL(unaligned);
+    EMU_EXPECT_EQ_UINT((uintptr_t)unaligned % DA_ALIGNMENT_DEFAULT, 0);
+    da_push(unaligned, 1.0);
+    da_free(unaligned);
+    unaligned = da_init_inline(buf + 1, sizeof(buf) - 1, sizeof(double));
+    unaligned = da_reserve(unaligned, da_capacity(unaligned) + 1);
+    EMU_REQUIRE_NOT_NULL(unaligned);
+    EMU_EXPECT_NULL(*DA_P_ALLOCATOR_FROM_HANDLE(unaligned));
+    EMU_EXPECT_EQ_UINT((uintptr_t)unaligned % DA_ALIGNMENT_DEFAULT, 0);
+    da_free(unaligned);
+    EMU_END_TEST();
+}
+
+EMU_TEST(da_soa)
+{
+    const size_t sizes[] = {sizeof(float), sizeof(int), sizeof(char)};
+    struct da_soa soa;
+    EMU_REQUIRE_TRUE(da_soa_init(&soa, 3, sizes, 0) == 0);
+    EMU_EXPECT_EQ_UINT(soa.length, 0);
+    for (int i = 0; i < 1000; ++i)
+    {
+        float x = i*0.5f;
+        char flag = (char)(i % 2);
+        const void* values[] = {&x, &i, &flag};
+        EMU_REQUIRE_TRUE(da_soa_push(&soa, values) == 0);
+    }
+    EMU_EXPECT_EQ_UINT(soa.length, 1000);
+    EMU_EXPECT_GE_UINT(soa.capacity, 1000);
+    for (size_t i = 0; i < soa.ncolumns; ++i)
+    {
+        EMU_EXPECT_EQ_UINT((uintptr_t)soa.columns[i] % DA_SOA_ALIGNMENT, 0);
+    }
+    float* xs = da_soa_column(&soa, float, 0);
+    int* ids = da_soa_column(&soa, int, 1);
+    char* flags = da_soa_column(&soa, char, 2);
+    EMU_EXPECT_TRUE(xs[999] == 499.5f);
+    EMU_EXPECT_EQ_INT(ids[999], 999);
+    EMU_EXPECT_EQ_INT(flags[999], 1);
+
+    float x = -1.0f;
+    int id = -1;
+    char flag = 7;
+    const void* values[] = {&x, &id, &flag};
+    EMU_REQUIRE_TRUE(da_soa_insert(&soa, 0, values) == 0);
+    ids = da_soa_column(&soa, int, 1);
+    flags = da_soa_column(&soa, char, 2);
+    EMU_EXPECT_EQ_UINT(soa.length, 1001);
+    EMU_EXPECT_EQ_INT(ids[0], -1);
+    EMU_EXPECT_EQ_INT(flags[0], 7);
+    EMU_EXPECT_EQ_INT(ids[1], 0);
+    EMU_EXPECT_EQ_INT(ids[1000], 999);
+
+    da_soa_remove(&soa, 0);
+    EMU_EXPECT_EQ_INT(ids[0], 0);
+    EMU_EXPECT_EQ_INT(flags[1], 1);
+    da_soa_swap_remove(&soa, 0);
+    xs = da_soa_column(&soa, float, 0);
+    EMU_EXPECT_EQ_UINT(soa.length, 999);
+    EMU_EXPECT_EQ_INT(ids[0], 999);
+    EMU_EXPECT_TRUE(xs[0] == 499.5f);
+    EMU_EXPECT_EQ_INT(flags[0], 1);
+    EMU_EXPECT_EQ_INT(ids[998], 998);
+
+    EMU_REQUIRE_TRUE(da_soa_reserve(&soa, 5000) == 0);
+    EMU_EXPECT_GE_UINT(soa.capacity, 5999);
+    ids = da_soa_column(&soa, int, 1);
+    EMU_EXPECT_EQ_INT(ids[0], 999);
+    EMU_EXPECT_EQ_INT(ids[998], 998);
+    da_soa_destroy(&soa);
+    EMU_END_TEST();
+}
+
+EMU_TEST(da_seg)
+{
+    struct da_seg seg;
+    // Rounded up to 8 elements per segment.
+    EMU_REQUIRE_TRUE(da_seg_init(&seg, sizeof(int), 5) == 0);
+    EMU_EXPECT_EQ_UINT(seg.shift, 3);
+    EMU_EXPECT_EQ_UINT(seg.length, 0);
+    int visits = 0;
+    da_seg_foreach(&seg, int, it)
+    {
+        visits += 1;
+    }
+    da_seg_foreach_chunk(&seg, int, chunk, count)
+    {
+        (void)chunk;
+        visits += (int)count;
+    }
+    EMU_EXPECT_EQ_INT(visits, 0);
+    EMU_EXPECT_TRUE(da_seg_pop(&seg, NULL) == -1);
+
+    int i = 0;
+    EMU_REQUIRE_TRUE(da_seg_push(&seg, &i) == 0);
+    int* first = (int*)da_seg_at(&seg, 0);
+    for (i = 1; i < 100; ++i)
+    {
+        EMU_REQUIRE_TRUE(da_seg_push(&seg, &i) == 0);
+    }
+    EMU_EXPECT_EQ_UINT(seg.length, 100);
+    EMU_EXPECT_EQ_UINT(da_length(seg.segments), 13);
+    // Growth never moves elements.
+    EMU_EXPECT_EQ(first, (int*)da_seg_at(&seg, 0));
+    EMU_EXPECT_EQ_INT(*first, 0);
+    EMU_EXPECT_EQ_INT(*(int*)da_seg_at(&seg, 8), 8);
+    EMU_EXPECT_EQ_INT(*(int*)da_seg_at(&seg, 99), 99);
+
+    int expected = 0;
+    da_seg_foreach(&seg, int, it)
+    {
+        EMU_EXPECT_EQ_INT(*it, expected);
+        expected += 1;
+    }
+    EMU_EXPECT_EQ_INT(expected, 100);
+    expected = 0;
+    size_t chunks = 0;
+    da_seg_foreach_chunk(&seg, int, chunk, count)
+    {
+        EMU_EXPECT_EQ_UINT(count, chunks < 12 ? 8 : 4);
+        for (size_t k = 0; k < count; ++k)
+        {
+            EMU_EXPECT_EQ_INT(chunk[k], expected);
+            expected += 1;
+        }
+        chunks += 1;
+    }
+    EMU_EXPECT_EQ_UINT(chunks, 13);
+    EMU_EXPECT_EQ_INT(expected, 100);
+
+    int value = -1;
+    EMU_EXPECT_TRUE(da_seg_pop(&seg, &value) == 0);
+    EMU_EXPECT_EQ_INT(value, 99);
+    for (i = 0; i < 3; ++i)
+    {
+        EMU_EXPECT_TRUE(da_seg_pop(&seg, NULL) == 0);
+    }
+    // Exactly 12 full segments are left.
+    EMU_EXPECT_EQ_UINT(seg.length, 96);
+    EMU_EXPECT_EQ_UINT(da_length(seg.segments), 13);
+    chunks = 0;
+    da_seg_foreach_chunk(&seg, int, chunk, count)
+    {
+        EMU_EXPECT_EQ_INT(chunk[0], (int)(chunks*8));
+        EMU_EXPECT_EQ_UINT(count, 8);
+        chunks += 1;
+    }
+    EMU_EXPECT_EQ_UINT(chunks, 12);
+    expected = 0;
+    da_seg_foreach(&seg, int, it)
+    {
+        expected += 1;
+    }
+    EMU_EXPECT_EQ_INT(expected, 96);
+
+    EMU_REQUIRE_TRUE(da_seg_reserve(&seg, 100) == 0);
+    EMU_EXPECT_EQ_UINT(da_length(seg.segments), 25);
+    EMU_EXPECT_EQ(first, (int*)da_seg_at(&seg, 0));
+    da_seg_destroy(&seg);
+
+    EMU_REQUIRE_TRUE(da_seg_init(&seg, sizeof(double), 0) == 0);
+    EMU_EXPECT_EQ_UINT((size_t)1 << seg.shift,
+        DA_SEG_SEGMENT_BYTES/sizeof(double));
+    da_seg_destroy(&seg);
+
+    EMU_EXPECT_TRUE(da_seg_init(&seg, 0, 0) == -1);
+    EMU_EXPECT_TRUE(da_seg_init_aligned(&seg, 64, 4, 3) == -1);
+    // every segment of an over-aligned type is aligned
+    EMU_REQUIRE_TRUE(da_seg_init_aligned(&seg, 64, 4, 128) == 0);
+    char line[64] = {0};
+    for (i = 0; i < 20; ++i)
+    {
+        EMU_REQUIRE_TRUE(da_seg_push(&seg, line) == 0);
+    }
+    for (size_t k = 0; k < da_length(seg.segments); ++k)
+    {
+        EMU_EXPECT_EQ_UINT((uintptr_t)seg.segments[k] % 128, 0);
+    }
+    EMU_EXPECT_EQ_UINT((uintptr_t)da_seg_at(&seg, 4) % 128, 0);
+    da_seg_destroy(&seg);
     EMU_END_TEST();
 }
 
-EMU_TEST(da_push)
+EMU_TEST(da_packed)
 {
-    const int max_index = 15;
-    int* da = da_alloc(0, sizeof(int));
-
-    for (int i = 0; i <= max_index; ++i)
+    struct da_packed packed;
+    EMU_EXPECT_TRUE(da_packed_init(&packed, 65, 0) == -1);
+    EMU_REQUIRE_TRUE(da_packed_init(&packed, 0, 1000) == 0);
+    for (int i = 0; i < 100; ++i)
     {
-        da_push(da, i);
+        EMU_REQUIRE_TRUE(da_packed_push(&packed, 1000) == 0);
     }
-    EMU_REQUIRE_NOT_NULL(da);
-    EMU_EXPECT_EQ_UINT(da_length(da), max_index+1);
-    for (int i = 0; i <= max_index; ++i)
+    EMU_EXPECT_EQ_UINT(packed.bits, 0);
+    EMU_EXPECT_EQ_UINT(da_length(packed.words), 0);
+    EMU_EXPECT_EQ_UINT(da_packed_get(&packed, 99), 1000);
+
+    // widening repacks the values already stored
+    EMU_REQUIRE_TRUE(da_packed_push(&packed, 1005) == 0);
+    EMU_EXPECT_EQ_UINT(packed.bits, 3);
+    EMU_EXPECT_EQ_UINT(packed.length, 101);
+    EMU_EXPECT_EQ_UINT(da_length(packed.words), 5);
+    EMU_EXPECT_EQ_UINT(da_packed_get(&packed, 0), 1000);
+    EMU_EXPECT_EQ_UINT(da_packed_get(&packed, 100), 1005);
+    EMU_REQUIRE_TRUE(da_packed_set(&packed, 21, 1007) == 0);
+    EMU_EXPECT_EQ_UINT(packed.bits, 3);
+    // values 21 and 22 straddle the first two words
+    EMU_EXPECT_EQ_UINT(da_packed_get(&packed, 20), 1000);
+    EMU_EXPECT_EQ_UINT(da_packed_get(&packed, 21), 1007);
+    EMU_EXPECT_EQ_UINT(da_packed_get(&packed, 22), 1000);
+    // values below the base wrap around to the full width
+    EMU_REQUIRE_TRUE(da_packed_set(&packed, 50, 1) == 0);
+    EMU_EXPECT_EQ_UINT(packed.bits, 64);
+    EMU_EXPECT_EQ_UINT(da_packed_get(&packed, 50), 1);
+    EMU_EXPECT_EQ_UINT(da_packed_get(&packed, 21), 1007);
+    EMU_EXPECT_EQ_UINT(da_packed_get(&packed, 100), 1005);
+    da_packed_destroy(&packed);
+
+    uint32_t* ids = da_alloc(0, sizeof(uint32_t));
+    for (uint32_t i = 0; i < 5000; ++i)
     {
-        EMU_EXPECT_EQ_INT(da[i], i);
+        da_push(ids, (i*7919u) % 3000u);
     }
-
-    da_free(da);
+    EMU_REQUIRE_TRUE(da_packed_init(&packed, 0, 0) == 0);
+    EMU_REQUIRE_TRUE(da_packed_reserve(&packed, 10) == 0);
+    EMU_REQUIRE_TRUE(da_packed_encode(&packed, ids) == 0);
+    EMU_EXPECT_EQ_UINT(packed.bits, 12);
+    EMU_EXPECT_EQ_UINT(packed.length, 5000);
+    EMU_EXPECT_EQ_UINT(da_length(packed.words), (5000*12 + 63)/64);
+    EMU_REQUIRE_TRUE(da_packed_encode(&packed, ids) == 0);
+    EMU_EXPECT_EQ_UINT(packed.length, 10000);
+    size_t mismatches = 0;
+    for (size_t i = 0; i < 10000; ++i)
+    {
+        mismatches += da_packed_get(&packed, i) != ids[i % 5000];
+    }
+    EMU_EXPECT_EQ_UINT(mismatches, 0);
+
+    // bulk decode appends to darrays of any supported element size
+    uint32_t* out32 = da_alloc(0, sizeof(uint32_t));
+    da_push(out32, 42);
+    out32 = da_packed_decode(&packed, 4999, 5001, out32);
+    EMU_REQUIRE_NOT_NULL(out32);
+    EMU_EXPECT_EQ_UINT(da_length(out32), 5002);
+    EMU_EXPECT_EQ_UINT(out32[0], 42);
+    EMU_EXPECT_EQ_UINT(out32[1], ids[4999]);
+    mismatches = 0;
+    for (size_t i = 0; i < 5000; ++i)
+    {
+        mismatches += out32[i + 2] != ids[i];
+    }
+    EMU_EXPECT_EQ_UINT(mismatches, 0);
+    uint64_t* out64 = da_alloc(0, sizeof(uint64_t));
+    out64 = da_packed_decode(&packed, 0, 10000, out64);
+    EMU_REQUIRE_NOT_NULL(out64);
+    EMU_EXPECT_EQ_UINT(out64[9999], ids[4999]);
+    uint16_t* out16 = da_alloc(0, sizeof(uint16_t));
+    out16 = da_packed_decode(&packed, 10, 3, out16);
+    EMU_REQUIRE_NOT_NULL(out16);
+    EMU_EXPECT_EQ_UINT(out16[2], ids[12]);
+    void* bad = da_alloc(0, 3);
+    EMU_EXPECT_NULL(da_packed_decode(&packed, 0, 1, bad));
+    EMU_EXPECT_TRUE(da_packed_encode(&packed, bad) == -1);
+    da_free(bad);
+    da_free(out16);
+    da_free(out64);
+    da_free(out32);
+    da_free(ids);
+    da_packed_destroy(&packed);
     EMU_END_TEST();
 }
 
-EMU_TEST(da_spush)
+#ifdef DA_ENABLE_STATS
+static void count_stats(struct da_stats* stats, void* ctx)
 {
-    const int max_index = 15;
-    int* da = da_alloc(0, sizeof(int));
-    int* bak = NULL;
+    (void)stats;
+    *(size_t*)ctx += 1;
+}
 
-    for (int i = 0; i <= max_index; ++i)
+EMU_TEST(da_stats)
+{
+    size_t before = 0;
+    da_stats_foreach(count_stats, &before);
+
+    int* da = da_alloc(0, sizeof(int));
+    struct da_stats* stats = da_stats(da);
+    EMU_REQUIRE_NOT_NULL(stats);
+    EMU_EXPECT_EQ_UINT(stats->elsz, sizeof(int));
+    for (int i = 0; i < 1000; ++i)
     {
-        da_spush(da, i, bak);
-        EMU_REQUIRE_NOT_NULL(da);
+        da_push(da, i);
     }
-    EMU_EXPECT_EQ(da, bak);
-    EMU_EXPECT_EQ_UINT(da_length(da), max_index+1);
-    for (int i = 0; i <= max_index; ++i)
+    EMU_EXPECT_TRUE(da_stats(da) == stats);
+    EMU_EXPECT_GE_UINT(stats->reallocs, 1);
+    EMU_EXPECT_EQ_UINT(stats->peak_length, 1000);
+    EMU_EXPECT_EQ_UINT(stats->peak_capacity, da_capacity(da));
+    size_t pushes = 0;
+    for (size_t i = 0; i < DA_STATS_LATENCY_BUCKETS; ++i)
     {
-        EMU_EXPECT_EQ_INT(da[i], i);
+        pushes += stats->push_latency[i];
     }
-
+    EMU_EXPECT_EQ_UINT(pushes, 1000);
+
+    EMU_EXPECT_EQ_UINT(stats->bytes_moved, 0);
+    da_insert(da, 0, -1);
+    EMU_EXPECT_EQ_UINT(stats->bytes_moved, 1000*sizeof(int));
+    (void)da_remove(da, 0);
+    EMU_EXPECT_EQ_UINT(stats->bytes_moved, 2000*sizeof(int));
+
+    int* other = da_alloc(1, sizeof(int));
+    size_t during = 0;
+    da_stats_foreach(count_stats, &during);
+    EMU_EXPECT_EQ_UINT(during, before + 2);
+    da_stats_dump(stats, stdout);
+    da_free(other);
     da_free(da);
+    size_t after = 0;
+    da_stats_foreach(count_stats, &after);
+    EMU_EXPECT_EQ_UINT(after, before);
     EMU_END_TEST();
 }
+#endif // DA_ENABLE_STATS
 
-EMU_TEST(da_pop)
+EMU_TEST(da_ring)
 {
-    int* da = da_alloc(2, sizeof(int));
-    da[0] = 3;
-    da[1] = 5;
+    struct da_ring ring;
+    EMU_REQUIRE_TRUE(da_ring_init(&ring, 5, sizeof(int), NULL) == 0);
+    EMU_EXPECT_EQ_UINT(da_capacity(ring.darr), 8);
+    EMU_EXPECT_EQ_UINT(da_ring_length(&ring), 0);
+
+    int value = 0;
+    EMU_EXPECT_EQ_INT(da_ring_pop(&ring, &value), -1);
+    for (int i = 0; i < 8; ++i)
+    {
+        EMU_EXPECT_EQ_INT(da_ring_push(&ring, &i), 0);
+    }
+    EMU_EXPECT_EQ_INT(da_ring_push(&ring, &value), -1);
+    EMU_EXPECT_EQ_UINT(da_ring_length(&ring), 8);
 
-    EMU_EXPECT_EQ_INT(da_pop(da), 5);
-    EMU_REQUIRE_NOT_NULL(da);
-    EMU_EXPECT_EQ_UINT(da_length(da), 1);
+    // wrap around one element at a time
+    for (int i = 8; i < 20; ++i)
+    {
+        EMU_EXPECT_EQ_INT(da_ring_pop(&ring, &value), 0);
+        EMU_EXPECT_EQ_INT(value, i - 8);
+        EMU_EXPECT_EQ_INT(da_ring_push(&ring, &i), 0);
+    }
+    EMU_EXPECT_EQ_UINT(da_ring_length(&ring), 8);
 
-    EMU_EXPECT_EQ_INT(da_pop(da), 3);
-    EMU_REQUIRE_NOT_NULL(da);
-    EMU_EXPECT_EQ_UINT(da_length(da), 0);
+    // bulk reads and writes split across the end of the block
+    int out[8];
+    EMU_EXPECT_EQ_UINT(da_ring_read(&ring, out, 5), 5);
+    for (int i = 0; i < 5; ++i)
+    {
+        EMU_EXPECT_EQ_INT(out[i], 12 + i);
+    }
+    const int in[] = {20, 21, 22, 23, 24, 25};
+    EMU_EXPECT_EQ_UINT(da_ring_write(&ring, in, 6), 5);
+    EMU_EXPECT_EQ_UINT(da_ring_write(&ring, in, 1), 0);
+    EMU_EXPECT_EQ_UINT(da_ring_read(&ring, out, 8), 8);
+    for (int i = 0; i < 8; ++i)
+    {
+        EMU_EXPECT_EQ_INT(out[i], 17 + i);
+    }
+    EMU_EXPECT_EQ_UINT(da_ring_read(&ring, out, 8), 0);
+    EMU_EXPECT_EQ_INT(da_ring_pop(&ring, NULL), -1);
 
-    da_free(da);
+    da_ring_destroy(&ring);
     EMU_END_TEST();
 }
 
@@ -235,7 +2242,14 @@ EMU_TEST(da_sinsert)
         da_sinsert(da, 0, i, bak);
         EMU_REQUIRE_NOT_NULL(da);
     }
-    EMU_EXPECT_EQ(da, bak);
+    // As in da_spush, only whether the backup was written is deterministic.
+    EMU_EXPECT_NOT_NULL(bak);
+    da = da_reserve(da, 1);
+    EMU_REQUIRE_NOT_NULL(da);
+    bak = NULL;
+    da_sinsert(da, 0, -1, bak);
+    EMU_EXPECT_NULL(bak);
+    EMU_EXPECT_EQ_INT(da_remove(da, 0), -1);
     EMU_EXPECT_EQ_UINT(da_length(da), max_index+1);
     for (int i = max_index; i >= 0; --i)
     {
@@ -276,6 +2290,213 @@ EMU_TEST(da_remove)
     da_remove(bda, 0); // remove from front
     da_remove(bda, 1); // remove from back
 
+    da_free(bda);
+
+    // large elements, both with spare capacity and in a full darray
+    static const struct da_growth exact = DA_GROWTH_INCREMENT_INIT(1, 0);
+    struct da_attr attr = {0};
+    attr.growth = &exact;
+    const size_t len = 6;
+    for (size_t spare = 0; spare <= 1; ++spare)
+    {
+        bda = da_alloc_attr(len, sizeof(struct bigstruct), &attr);
+        EMU_REQUIRE_NOT_NULL(bda);
+        bda = da_reserve(bda, spare);
+        EMU_REQUIRE_NOT_NULL(bda);
+        EMU_EXPECT_EQ_UINT(da_capacity(bda), len + spare);
+        for (size_t i = 0; i < len; ++i)
+        {
+            for (size_t j = 0; j < 500; ++j)
+            {
+                bda[i].A[j] = i*1000 + j;
+            }
+        }
+        struct bigstruct removed = da_remove(bda, 1);
+        EMU_EXPECT_EQ_UINT(da_length(bda), len-1);
+        EMU_EXPECT_EQ_INT(removed.A[0], 1000);
+        EMU_EXPECT_EQ_INT(removed.A[499], 1499);
+        for (size_t i = 0; i < len-1; ++i)
+        {
+            int expect = (i < 1 ? i : i+1)*1000;
+            EMU_EXPECT_EQ_INT(bda[i].A[0], expect);
+            EMU_EXPECT_EQ_INT(bda[i].A[499], expect + 499);
+        }
+        da_free(bda);
+    }
+
+    da_free(da);
+    EMU_END_TEST();
+}
+
+EMU_TEST(da_remove_range)
+{
+    int* da = da_alloc(INITIAL_NUM_ELEMS, sizeof(int));
+    for (size_t i = 0; i < INITIAL_NUM_ELEMS; ++i)
+    {
+        da[i] = i;
+    }
+
+    // remove from middle
+    da_remove_range(da, 2, 3);
+    EMU_EXPECT_EQ_UINT(da_length(da), INITIAL_NUM_ELEMS-3);
+    EMU_EXPECT_EQ_INT(da[1], 1);
+    EMU_EXPECT_EQ_INT(da[2], 5);
+    EMU_EXPECT_EQ_INT(da[6], 9);
+
+    // remove from front
+    da_remove_range(da, 0, 2);
+    EMU_EXPECT_EQ_UINT(da_length(da), INITIAL_NUM_ELEMS-5);
+    EMU_EXPECT_EQ_INT(da[0], 5);
+
+    // remove nothing
+    da_remove_range(da, 1, 0);
+    EMU_EXPECT_EQ_UINT(da_length(da), INITIAL_NUM_ELEMS-5);
+
+    // remove from back
+    da_remove_range(da, 3, 2);
+    EMU_EXPECT_EQ_UINT(da_length(da), 3);
+    EMU_EXPECT_EQ_INT(da[0], 5);
+    EMU_EXPECT_EQ_INT(da[1], 6);
+    EMU_EXPECT_EQ_INT(da[2], 7);
+
+    // remove everything
+    da_remove_range(da, 0, 3);
+    EMU_EXPECT_EQ_UINT(da_length(da), 0);
+
+    da_free(da);
+    EMU_END_TEST();
+}
+
+EMU_TEST(da_swap_remove)
+{
+    int* da = da_alloc(4, sizeof(int));
+    da[0] = 3;
+    da[1] = 5;
+    da[2] = 7;
+    da[3] = 9;
+
+    // remove from middle
+    EMU_EXPECT_EQ_INT(da_swap_remove(da, 1), 5);
+    EMU_EXPECT_EQ_UINT(da_length(da), 3);
+    EMU_EXPECT_EQ_INT(da[0], 3);
+    EMU_EXPECT_EQ_INT(da[1], 9);
+    EMU_EXPECT_EQ_INT(da[2], 7);
+
+    // remove from back
+    EMU_EXPECT_EQ_INT(da_swap_remove(da, 2), 7);
+    EMU_EXPECT_EQ_UINT(da_length(da), 2);
+
+    // remove from front
+    EMU_EXPECT_EQ_INT(da_swap_remove(da, 0), 3);
+    EMU_EXPECT_EQ_UINT(da_length(da), 1);
+    EMU_EXPECT_EQ_INT(da[0], 9);
+
+    // remove last remaining element
+    EMU_EXPECT_EQ_INT(da_swap_remove(da, 0), 9);
+    EMU_EXPECT_EQ_UINT(da_length(da), 0);
+
+    da_free(da);
+    EMU_END_TEST();
+}
+
+EMU_TEST(da_swap_remove_many)
+{
+    int* da = da_alloc(INITIAL_NUM_ELEMS, sizeof(int));
+    for (size_t i = 0; i < INITIAL_NUM_ELEMS; ++i)
+    {
+        da[i] = i;
+    }
+
+    // includes indices at the back that must not be moved into holes
+    const size_t indices[] = {0, 4, 8, 9};
+    da_swap_remove_many(da, indices, 4);
+    EMU_EXPECT_EQ_UINT(da_length(da), INITIAL_NUM_ELEMS-4);
+    int seen[INITIAL_NUM_ELEMS] = {0};
+    for (size_t i = 0; i < da_length(da); ++i)
+    {
+        seen[da[i]] += 1;
+    }
+    for (size_t i = 0; i < INITIAL_NUM_ELEMS; ++i)
+    {
+        EMU_EXPECT_EQ_INT(seen[i], (i == 0 || i == 4 || i >= 8) ? 0 : 1);
+    }
+    EMU_EXPECT_EQ_INT(da[1], 1);
+    EMU_EXPECT_EQ_INT(da[2], 2);
+    EMU_EXPECT_EQ_INT(da[3], 3);
+
+    // remove everything
+    const size_t all[] = {0, 1, 2, 3, 4, 5};
+    da_swap_remove_many(da, all, 6);
+    EMU_EXPECT_EQ_UINT(da_length(da), 0);
+
+    da_free(da);
+    EMU_END_TEST();
+}
+
+EMU_TEST(da_gap_buffer)
+{
+    int* da = da_alloc(0, sizeof(int));
+    // type "0123456789" at the cursor
+    for (int i = 0; i < 10; ++i)
+    {
+        int* tmp = da_gap_insert(da, i, &i);
+        EMU_REQUIRE_NOT_NULL(tmp);
+        da = tmp;
+    }
+    EMU_EXPECT_EQ_UINT(da_length(da), 10);
+    EMU_EXPECT_FALSE(da_flags(da) & DA_FLAG_GAP);
+
+    // move the cursor to the front and type through a regrowth
+    for (int i = 0; i < 40; ++i)
+    {
+        int value = 100 + i;
+        int* tmp = da_gap_insert(da, i, &value);
+        EMU_REQUIRE_NOT_NULL(tmp);
+        da = tmp;
+    }
+    EMU_EXPECT_EQ_UINT(da_length(da), 50);
+    EMU_EXPECT_TRUE(da_flags(da) & DA_FLAG_GAP);
+    EMU_EXPECT_EQ_UINT(*DA_P_GAP_FROM_HANDLE(da), 40);
+    EMU_EXPECT_EQ_INT(*(int*)da_gap_at(da, 0), 100);
+    EMU_EXPECT_EQ_INT(*(int*)da_gap_at(da, 39), 139);
+    EMU_EXPECT_EQ_INT(*(int*)da_gap_at(da, 40), 0);
+    EMU_EXPECT_EQ_INT(*(int*)da_gap_at(da, 49), 9);
+
+    // backspace and delete around the cursor
+    da_gap_remove(da, 39);
+    da_gap_remove(da, 39);
+    EMU_EXPECT_EQ_UINT(da_length(da), 48);
+    EMU_EXPECT_EQ_UINT(*DA_P_GAP_FROM_HANDLE(da), 39);
+    EMU_EXPECT_EQ_INT(*(int*)da_gap_at(da, 38), 138);
+    EMU_EXPECT_EQ_INT(*(int*)da_gap_at(da, 39), 1);
+
+    // far away edits move the gap
+    da_gap_remove(da, 0);
+    int value = -1;
+    da = da_gap_insert(da, 46, &value);
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ_UINT(da_length(da), 48);
+
+    da_gap_materialize(da);
+    EMU_EXPECT_FALSE(da_flags(da) & DA_FLAG_GAP);
+    for (int i = 0; i < 38; ++i)
+    {
+        EMU_EXPECT_EQ_INT(da[i], 101 + i);
+    }
+    for (int i = 38; i < 46; ++i)
+    {
+        EMU_EXPECT_EQ_INT(da[i], i - 37);
+    }
+    EMU_EXPECT_EQ_INT(da[46], -1);
+    EMU_EXPECT_EQ_INT(da[47], 9);
+
+    // a materialized gap buffer is an ordinary darray
+    da_push(da, 10);
+    EMU_EXPECT_EQ_UINT(da_length(da), 49);
+    EMU_EXPECT_EQ_INT(da[48], 10);
+    da_gap_remove(da, 48);
+    EMU_EXPECT_FALSE(da_flags(da) & DA_FLAG_GAP);
+    EMU_EXPECT_EQ_UINT(da_length(da), 48);
 
     da_free(da);
     EMU_END_TEST();
@@ -306,6 +2527,108 @@ EMU_TEST(da_fill)
     EMU_END_TEST();
 }
 
+struct rgb {unsigned char r, g, b;};
+
+EMU_TEST(da_fill_patterns)
+{
+    // uniform bytes
+    int* ida = da_alloc(RESIZE_NUM_ELEMS, sizeof(int));
+    da_fill(ida, int, -1);
+    for (size_t i = 0; i < da_length(ida); ++i)
+    {
+        EMU_EXPECT_EQ_INT(ida[i], -1);
+    }
+    da_fill(ida, int, 0);
+    for (size_t i = 0; i < da_length(ida); ++i)
+    {
+        EMU_EXPECT_EQ_INT(ida[i], 0);
+    }
+    da_free(ida);
+
+    // value is converted to the element type
+    double* dda = da_alloc(INITIAL_NUM_ELEMS, sizeof(double));
+    da_fill(dda, int, 3);
+    for (size_t i = 0; i < da_length(dda); ++i)
+    {
+        EMU_EXPECT_TRUE(dda[i] == 3.0);
+    }
+    da_free(dda);
+
+    // odd element size that doesn't divide the pattern buffer
+    struct rgb* cda = da_alloc(1000, sizeof(struct rgb));
+    struct rgb color = {1, 2, 3};
+    da_fill(cda, struct rgb, color);
+    for (size_t i = 0; i < da_length(cda); ++i)
+    {
+        EMU_EXPECT_EQ_UINT(cda[i].r, 1);
+        EMU_EXPECT_EQ_UINT(cda[i].g, 2);
+        EMU_EXPECT_EQ_UINT(cda[i].b, 3);
+    }
+    da_free(cda);
+
+    // elements larger than the pattern buffer
+    struct bigstruct* bda = da_alloc(5, sizeof(struct bigstruct));
+    struct bigstruct big;
+    for (int i = 0; i < 500; ++i)
+    {
+        big.A[i] = i;
+    }
+    da_fill(bda, struct bigstruct, big);
+    for (size_t i = 0; i < da_length(bda); ++i)
+    {
+        EMU_EXPECT_EQ_INT(bda[i].A[0], 0);
+        EMU_EXPECT_EQ_INT(bda[i].A[499], 499);
+    }
+    da_free(bda);
+    EMU_END_TEST();
+}
+
+EMU_TEST(da_fill_range)
+{
+    int* da = da_alloc(RESIZE_NUM_ELEMS, sizeof(int));
+    da_fill(da, int, 1);
+
+    da_fill_range(da, int, 7, 10, 50);
+    for (size_t i = 0; i < da_length(da); ++i)
+    {
+        EMU_EXPECT_EQ_INT(da[i], (i >= 10 && i < 60) ? 7 : 1);
+    }
+
+    // empty range
+    da_fill_range(da, int, 9, 0, 0);
+    EMU_EXPECT_EQ_INT(da[0], 1);
+
+    da_free(da);
+    EMU_END_TEST();
+}
+
+EMU_TEST(da_resize_fill)
+{
+    int* da = da_alloc(INITIAL_NUM_ELEMS, sizeof(int));
+    for (size_t i = 0; i < INITIAL_NUM_ELEMS; ++i)
+    {
+        da[i] = i;
+    }
+
+    const int value = 42;
+    da = da_resize_fill(da, RESIZE_NUM_ELEMS, &value);
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ_UINT(da_length(da), RESIZE_NUM_ELEMS);
+    for (size_t i = 0; i < RESIZE_NUM_ELEMS; ++i)
+    {
+        EMU_EXPECT_EQ_INT(da[i], i < INITIAL_NUM_ELEMS ? (int)i : 42);
+    }
+
+    // downsizing doesn't fill anything
+    da = da_resize_fill(da, 5, &value);
+    EMU_REQUIRE_NOT_NULL(da);
+    EMU_EXPECT_EQ_UINT(da_length(da), 5);
+    EMU_EXPECT_EQ_INT(da[4], 4);
+
+    da_free(da);
+    EMU_END_TEST();
+}
+
 EMU_TEST(da_foreach)
 {
     int* da = da_alloc(INITIAL_NUM_ELEMS, sizeof(int));
@@ -368,6 +2691,100 @@ EMU_TEST(da_foreachr)
     EMU_END_TEST();
 }
 
+EMU_TEST(da_foreach_fast_prefetch)
+{
+    struct big {int value; char pad[124];};
+    struct big* da = da_alloc(RESIZE_NUM_ELEMS, sizeof(struct big));
+    for (size_t i = 0; i < da_length(da); ++i){da[i].value = i;}
+
+    int expected = 0;
+    da_foreach_fast(da, struct big, iter)
+    {
+        EMU_EXPECT_EQ_INT(iter->value, expected++);
+        iter->value *= 2;
+    }
+    EMU_EXPECT_EQ_INT(expected, RESIZE_NUM_ELEMS);
+
+    // prefetch distances both shorter and longer than the darray
+    const size_t distances[] = {0, 1, 8, 2*RESIZE_NUM_ELEMS};
+    for (size_t d = 0; d < sizeof(distances)/sizeof(distances[0]); ++d)
+    {
+        int sum = 0;
+        da_foreach_prefetch(da, struct big, iter, distances[d])
+        {
+            sum += iter->value;
+        }
+        EMU_EXPECT_EQ_INT(sum, RESIZE_NUM_ELEMS*(RESIZE_NUM_ELEMS - 1));
+    }
+
+    // break ends the whole loop
+    int visited = 0;
+    da_foreach_prefetch(da, struct big, iter, 4)
+    {
+        if (iter->value == 20)
+            break;
+        ++visited;
+    }
+    EMU_EXPECT_EQ_INT(visited, 10);
+
+    da = da_resize(da, 0);
+    visited = 0;
+    da_foreach_fast(da, struct big, iter)
+    {
+        ++visited;
+    }
+    EMU_EXPECT_EQ_INT(visited, 0);
+
+    da_free(da);
+    EMU_END_TEST();
+}
+
+EMU_TEST(da_foreach_chunk)
+{
+    int* da = da_alloc(RESIZE_NUM_ELEMS, sizeof(int));
+    for (size_t i = 0; i < da_length(da); ++i){da[i] = i;}
+
+    const size_t chunk_sizes[] = {1, 7, 16, RESIZE_NUM_ELEMS, 1000};
+    for (size_t c = 0; c < sizeof(chunk_sizes)/sizeof(chunk_sizes[0]); ++c)
+    {
+        int expected = 0;
+        size_t nchunks = 0;
+        da_foreach_chunk(da, int, chunk, count, chunk_sizes[c])
+        {
+            EMU_EXPECT_TRUE(count == chunk_sizes[c]
+                || chunk + count == da + da_length(da));
+            for (size_t i = 0; i < count; ++i)
+            {
+                EMU_EXPECT_EQ_INT(chunk[i], expected++);
+            }
+            ++nchunks;
+        }
+        EMU_EXPECT_EQ_INT(expected, RESIZE_NUM_ELEMS);
+        EMU_EXPECT_EQ_UINT(nchunks,
+            (RESIZE_NUM_ELEMS + chunk_sizes[c] - 1)/chunk_sizes[c]);
+    }
+
+    size_t nchunks = 0;
+    da_foreach_chunk(da, int, chunk, count, 16)
+    {
+        if (chunk[0] == 32)
+            break;
+        ++nchunks;
+    }
+    EMU_EXPECT_EQ_UINT(nchunks, 2);
+
+    da = da_resize(da, 0);
+    nchunks = 0;
+    da_foreach_chunk(da, int, chunk, count, 16)
+    {
+        ++nchunks;
+    }
+    EMU_EXPECT_EQ_UINT(nchunks, 0);
+
+    da_free(da);
+    EMU_END_TEST();
+}
+
 EMU_TEST(da_swap)
 {
     int* da = da_alloc(INITIAL_NUM_ELEMS, sizeof(int));
@@ -392,24 +2809,130 @@ EMU_TEST(da_swap)
     EMU_END_TEST();
 }
 
+EMU_TEST(da_swap_sizes)
+{
+    // exercise the fixed size fast paths as well as chunked swaps with an
+    // odd sized remainder
+    const size_t sizes[] = {1, 3, 4, 8, 16, 24, 32, 48, 61, 256};
+    for (size_t s = 0; s < sizeof(sizes)/sizeof(sizes[0]); ++s)
+    {
+        unsigned char* da = da_alloc(2, sizes[s]);
+        EMU_REQUIRE_NOT_NULL(da);
+        for (size_t i = 0; i < sizes[s]; ++i)
+        {
+            da[i] = i;
+            da[sizes[s] + i] = 255 - i;
+        }
+        da_swap(da, 0, 1);
+        for (size_t i = 0; i < sizes[s]; ++i)
+        {
+            EMU_EXPECT_EQ_UINT(da[i], 255 - i);
+            EMU_EXPECT_EQ_UINT(da[sizes[s] + i], i);
+        }
+        da_free(da);
+    }
+    EMU_END_TEST();
+}
+
+EMU_TEST(da_swap_range)
+{
+    int* da = da_alloc(INITIAL_NUM_ELEMS, sizeof(int));
+    for (size_t i = 0; i < INITIAL_NUM_ELEMS; ++i)
+    {
+        da[i] = i;
+    }
+
+    da_swap_range(da, 1, 6, 3);
+    EMU_EXPECT_EQ_INT(da[0], 0);
+    EMU_EXPECT_EQ_INT(da[1], 6);
+    EMU_EXPECT_EQ_INT(da[2], 7);
+    EMU_EXPECT_EQ_INT(da[3], 8);
+    EMU_EXPECT_EQ_INT(da[4], 4);
+    EMU_EXPECT_EQ_INT(da[5], 5);
+    EMU_EXPECT_EQ_INT(da[6], 1);
+    EMU_EXPECT_EQ_INT(da[7], 2);
+    EMU_EXPECT_EQ_INT(da[8], 3);
+    EMU_EXPECT_EQ_INT(da[9], 9);
+
+    // swapping an empty range is a no-op
+    da_swap_range(da, 0, 5, 0);
+    EMU_EXPECT_EQ_INT(da[0], 0);
+    EMU_EXPECT_EQ_INT(da[5], 5);
+
+    da_free(da);
+    EMU_END_TEST();
+}
+
 EMU_GROUP(all_tests)
 {
     EMU_ADD(alloc_and_free_functions);
+    EMU_ADD(da_alloc_aligned);
+    EMU_ADD(da_alloc_attr);
+    EMU_ADD(da_arena);
+    EMU_ADD(da_pool);
+#ifdef DA_HAVE_MMAP
+    EMU_ADD(da_vm);
+    EMU_ADD(da_map_file);
+#endif
+#ifdef DA_HAVE_FD_IO
+    EMU_ADD(da_write_read_fd);
+    EMU_ADD(da_write_read_fd_resume);
+#endif
+    EMU_ADD(da_sort);
+    EMU_ADD(da_sort_radix);
+    EMU_ADD(da_lower_upper_bound);
+    EMU_ADD(da_insert_remove_sorted);
+    EMU_ADD(da_merge_sorted);
+#ifdef DA_TEST_THREADS
+    EMU_ADD(da_sort_parallel);
+    EMU_ADD(da_concurrent);
+    EMU_ADD(da_batch);
+    EMU_ADD(da_parallel_for);
+    EMU_ADD(da_parallel_reduce);
+    EMU_ADD(da_ring_spsc);
+    EMU_ADD(da_share_threads);
+#endif
+    EMU_ADD(da_declare_typed);
     EMU_ADD(da_length);
     EMU_ADD(da_capacity);
     EMU_ADD(da_sizeof_elem);
     EMU_ADD(da_resize);
     EMU_ADD(da_reserve);
+    EMU_ADD(da_shrink_to_fit);
+    EMU_ADD(da_auto_shrink);
     EMU_ADD(da_push);
     EMU_ADD(da_spush);
+    EMU_ADD(da_append);
+    EMU_ADD(da_insert_n);
     EMU_ADD(da_pop);
+    EMU_ADD(da_push_pop_front);
+    EMU_ADD(da_share);
+    EMU_ADD(da_init_inline);
+    EMU_ADD(da_soa);
+    EMU_ADD(da_seg);
+    EMU_ADD(da_packed);
+#ifdef DA_ENABLE_STATS
+    EMU_ADD(da_stats);
+#endif
+    EMU_ADD(da_ring);
     EMU_ADD(da_insert);
     EMU_ADD(da_sinsert);
     EMU_ADD(da_remove);
+    EMU_ADD(da_remove_range);
+    EMU_ADD(da_swap_remove);
+    EMU_ADD(da_swap_remove_many);
+    EMU_ADD(da_gap_buffer);
     EMU_ADD(da_fill);
+    EMU_ADD(da_fill_patterns);
+    EMU_ADD(da_fill_range);
+    EMU_ADD(da_resize_fill);
     EMU_ADD(da_foreach);
     EMU_ADD(da_foreachr);
+    EMU_ADD(da_foreach_fast_prefetch);
+    EMU_ADD(da_foreach_chunk);
     EMU_ADD(da_swap);
+    EMU_ADD(da_swap_sizes);
+    EMU_ADD(da_swap_range);
     EMU_END_GROUP();
 }
 
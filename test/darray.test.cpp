@@ -0,0 +1,276 @@
+#if __linux__
+#   define _EMU_ENABLE_COLOR_
+#endif
+#include <EMUtest.h>
+#include <string>
+#include "../darray.hpp"
+
+// Element type that counts live instances, to catch leaked or doubly
+// destroyed elements.
+struct tracked
+{
+    static int live;
+    int value;
+    tracked(int v = 0) : value(v) { ++live; }
+    tracked(const tracked& other) : value(other.value) { ++live; }
+    tracked(tracked&& other) noexcept : value(other.value)
+    {
+        other.value = -1;
+        ++live;
+    }
+    tracked& operator=(const tracked& other) = default;
+    tracked& operator=(tracked&& other) noexcept
+    {
+        value = other.value;
+        other.value = -1;
+        return *this;
+    }
+    ~tracked() { --live; }
+};
+int tracked::live = 0;
+
+// Element type whose copies start throwing once `budget` runs out. Its move
+// constructor may throw too, so darray<T> copies it when growing.
+struct throwing
+{
+    static int budget;
+    static int live;
+    int value;
+    throwing(int v = 0) : value(v) { take(); ++live; }
+    throwing(const throwing& other) : value(other.value) { take(); ++live; }
+    throwing& operator=(const throwing& other) = default;
+    ~throwing() { --live; }
+    static void take()
+    {
+        if (budget == 0)
+        {
+            throw 1;
+        }
+        if (budget > 0)
+        {
+            --budget;
+        }
+    }
+};
+int throwing::budget = -1;
+int throwing::live = 0;
+
+EMU_TEST(darray_push_back)
+{
+    darray<int> da;
+    EMU_EXPECT_EQ_UINT(da.size(), 0);
+    EMU_EXPECT_NULL(da.data());
+    for (int i = 0; i < 1000; ++i)
+    {
+        da.push_back(i);
+    }
+    EMU_EXPECT_EQ_UINT(da.size(), 1000);
+    EMU_EXPECT_GE_UINT(da.capacity(), 1000);
+    int expected = 0;
+    for (int i : da)
+    {
+        EMU_EXPECT_EQ_INT(i, expected++);
+    }
+    // pushing an element of the darray itself while it grows
+    while (da.size() < da.capacity())
+    {
+        da.push_back(0);
+    }
+    da.push_back(da[1]);
+    EMU_EXPECT_EQ_INT(da.back(), 1);
+    EMU_END_TEST();
+}
+
+EMU_TEST(darray_non_trivial)
+{
+    {
+        darray<std::string> da;
+        for (int i = 0; i < 100; ++i)
+        {
+            da.emplace_back(40, (char)('a' + i % 26));
+        }
+        EMU_EXPECT_TRUE(da[27] == std::string(40, 'b'));
+        std::string moved(50, 'z');
+        da.push_back(std::move(moved));
+        EMU_EXPECT_TRUE(da.back() == std::string(50, 'z'));
+
+        da.insert(0, std::string("front"));
+        EMU_EXPECT_TRUE(da[0] == "front");
+        EMU_EXPECT_TRUE(da[1] == std::string(40, 'a'));
+        da.erase(0);
+        EMU_EXPECT_TRUE(da[0] == std::string(40, 'a'));
+        EMU_EXPECT_EQ_UINT(da.size(), 101);
+
+        darray<std::string> copy(da);
+        EMU_EXPECT_EQ_UINT(copy.size(), 101);
+        EMU_EXPECT_TRUE(copy[100] == da[100]);
+        darray<std::string> stolen(std::move(copy));
+        EMU_EXPECT_EQ_UINT(copy.size(), 0);
+        EMU_EXPECT_EQ_UINT(stolen.size(), 101);
+    }
+
+    {
+        darray<tracked> da;
+        for (int i = 0; i < 100; ++i)
+        {
+            da.emplace_back(i);
+        }
+        EMU_EXPECT_EQ_INT(tracked::live, 100);
+        da.resize(200);
+        EMU_EXPECT_EQ_INT(tracked::live, 200);
+        da.resize(50);
+        EMU_EXPECT_EQ_INT(tracked::live, 50);
+        da.erase(10, 20);
+        EMU_EXPECT_EQ_INT(tracked::live, 30);
+        EMU_EXPECT_EQ_INT(da[10].value, 30);
+        da.swap_remove(0);
+        EMU_EXPECT_EQ_INT(tracked::live, 29);
+        EMU_EXPECT_EQ_INT(da[0].value, 49);
+        da.shrink_to_fit();
+        EMU_EXPECT_EQ_UINT(da.capacity(), 29);
+        EMU_EXPECT_EQ_INT(tracked::live, 29);
+        da.pop_back();
+        EMU_EXPECT_EQ_INT(tracked::live, 28);
+    }
+    EMU_EXPECT_EQ_INT(tracked::live, 0);
+    EMU_END_TEST();
+}
+
+EMU_TEST(darray_c_interop)
+{
+    int* handle = (int*)da_alloc(3, sizeof(int));
+    EMU_REQUIRE_NOT_NULL(handle);
+    handle[0] = 1; handle[1] = 2; handle[2] = 3;
+
+    darray<int> da = darray<int>::adopt(handle);
+    da.push_back(4);
+    EMU_EXPECT_EQ_UINT(da_length(da.data()), 4);
+
+    handle = da.release();
+    EMU_EXPECT_NULL(da.data());
+    EMU_EXPECT_EQ_INT(handle[3], 4);
+    da_free(handle);
+
+    // inline storage spills to the heap when elements are moved
+    char buf[DA_INLINE_BUFFER_SIZE(4, sizeof(std::string))];
+    {
+        darray<std::string> inl = darray<std::string>::adopt(
+            static_cast<std::string*>(
+                da_init_inline(buf, sizeof(buf), sizeof(std::string))));
+        for (int i = 0; i < 20; ++i)
+        {
+            inl.emplace_back(30, (char)('a' + i));
+        }
+        EMU_EXPECT_TRUE(inl[19] == std::string(30, 't'));
+        EMU_EXPECT_NULL(*DA_P_ALLOCATOR_FROM_HANDLE(inl.data()));
+    }
+
+    darray<double> aligned = {1.0, 2.0, 3.0};
+    EMU_EXPECT_EQ_UINT(da_sizeof_elem(aligned.data()), sizeof(double));
+    EMU_EXPECT_EQ_UINT(da_length(aligned.data()), 3);
+    EMU_END_TEST();
+}
+
+EMU_TEST(darray_shared)
+{
+    int* a = (int*)da_alloc(2, sizeof(int));
+    EMU_REQUIRE_NOT_NULL(a);
+    a[0] = 1; a[1] = 2;
+    {
+        darray<int> da = darray<int>::adopt((int*)da_share(a));
+        da.push_back(42);
+        EMU_EXPECT_TRUE(da.data() != a);
+        EMU_EXPECT_EQ_UINT(da.size(), 3);
+        EMU_EXPECT_EQ_UINT(da_length(a), 2);
+        EMU_EXPECT_EQ_UINT(da_refcount(a), 1);
+
+        darray<int> other = darray<int>::adopt((int*)da_share(a));
+        other.unshare();
+        other[0] = -1;
+        EMU_EXPECT_EQ_INT(a[0], 1);
+        EMU_EXPECT_EQ_UINT(da_refcount(a), 1);
+    }
+    EMU_EXPECT_EQ_UINT(da_refcount(a), 1);
+    da_free(a);
+
+    // elements are copied out of a shared block and destroyed once
+    {
+        darray<tracked> first;
+        for (int i = 0; i < 10; ++i)
+        {
+            first.emplace_back(i);
+        }
+        darray<tracked> second =
+            darray<tracked>::adopt((tracked*)da_share(first.data()));
+        EMU_EXPECT_EQ_INT(tracked::live, 10);
+        second.erase(0);
+        EMU_EXPECT_EQ_INT(tracked::live, 19);
+        EMU_EXPECT_EQ_INT(first[0].value, 0);
+        EMU_EXPECT_EQ_INT(second[0].value, 1);
+        darray<tracked> third =
+            darray<tracked>::adopt((tracked*)da_share(first.data()));
+        third.clear();
+        EMU_EXPECT_EQ_INT(tracked::live, 19);
+        EMU_EXPECT_EQ_UINT(da_refcount(first.data()), 1);
+        darray<tracked> fourth =
+            darray<tracked>::adopt((tracked*)da_share(first.data()));
+        first = darray<tracked>();
+        EMU_EXPECT_EQ_INT(tracked::live, 19);
+        EMU_EXPECT_EQ_INT(fourth[9].value, 9);
+    }
+    EMU_EXPECT_EQ_INT(tracked::live, 0);
+    EMU_END_TEST();
+}
+
+// A throwing constructor leaves no elements or blocks behind. Leaks are caught
+// by LeakSanitizer in the sanitized build.
+EMU_TEST(darray_exceptions)
+{
+    int caught = 0;
+    throwing::budget = 5;
+    try { darray<throwing> da(10); } catch (int) { ++caught; }
+    throwing::budget = 5;
+    try { darray<throwing> da(10, throwing(1)); } catch (int) { ++caught; }
+    throwing::budget = 5;
+    try { darray<throwing> da = {1, 2, 3, 4, 5}; } catch (int) { ++caught; }
+    EMU_EXPECT_EQ_INT(caught, 3);
+    EMU_EXPECT_EQ_INT(throwing::live, 0);
+
+    throwing::budget = -1;
+    {
+        darray<throwing> da;
+        for (int i = 0; i < 8; ++i)
+        {
+            da.emplace_back(i);
+        }
+        da.shrink_to_fit();
+        throwing::budget = 3;
+        try { da.emplace_back(8); } catch (int) { ++caught; }
+        EMU_EXPECT_EQ_INT(caught, 4);
+        EMU_EXPECT_EQ_UINT(da.size(), 8);
+        EMU_EXPECT_EQ_INT(da[7].value, 7);
+        EMU_EXPECT_EQ_INT(throwing::live, 8);
+        throwing::budget = 3;
+        try { darray<throwing> copy(da); } catch (int) { ++caught; }
+        EMU_EXPECT_EQ_INT(caught, 5);
+        EMU_EXPECT_EQ_INT(throwing::live, 8);
+        throwing::budget = -1;
+    }
+    EMU_EXPECT_EQ_INT(throwing::live, 0);
+    EMU_END_TEST();
+}
+
+EMU_GROUP(all_tests)
+{
+    EMU_ADD(darray_push_back);
+    EMU_ADD(darray_non_trivial);
+    EMU_ADD(darray_c_interop);
+    EMU_ADD(darray_shared);
+    EMU_ADD(darray_exceptions);
+    EMU_END_GROUP();
+}
+
+int main(void)
+{
+    return EMU_RUN(all_tests);
+}